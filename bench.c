@@ -0,0 +1,514 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+// ld_bench: decode throughput and latency benchmark
+// Each file is read into memory once, then opened and decoded to the end
+// repeatedly. Results are printed as JSON, one result per line so that a
+// previous run can be passed back with -b to compare against.
+// Throughput mode reports medians. Latency mode reports percentiles of the
+// open-to-first-block time and of every block read by a simulated audio
+// callback, since occasional slow reads are what cause dropouts.
+#include <lancerdecode.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define BUFFER_SIZE 32768
+#define MAX_ITERATIONS 100
+#define HISTOGRAM_BUCKETS 24
+
+static double now_seconds(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* allocations made through the options allocator */
+static size_t alloc_count = 0;
+
+static void *count_malloc(size_t size, void *userdata)
+{
+    alloc_count++;
+    return malloc(size);
+}
+
+static void *count_realloc(void *ptr, size_t size, void *userdata)
+{
+    alloc_count++;
+    return realloc(ptr, size);
+}
+
+static void count_free(void *ptr, void *userdata)
+{
+    free(ptr);
+}
+
+/* in-memory source so the benchmark measures decoding rather than disk I/O */
+typedef struct {
+    const unsigned char *data;
+    int32_t size;
+    int32_t position;
+} memory_stream_t;
+
+static size_t memory_read(void *buffer, size_t size, ld_stream_t stream)
+{
+    memory_stream_t *mem = (memory_stream_t*)stream->userData;
+    size_t remaining = (size_t)(mem->size - mem->position);
+    if(size > remaining) size = remaining;
+    memcpy(buffer, mem->data + mem->position, size);
+    mem->position += (int32_t)size;
+    return size;
+}
+
+static int memory_seek(ld_stream_t stream, int32_t offset, LDSEEK origin)
+{
+    memory_stream_t *mem = (memory_stream_t*)stream->userData;
+    int32_t position;
+    switch(origin) {
+        case LDSEEK_SET: position = offset; break;
+        case LDSEEK_CUR: position = mem->position + offset; break;
+        case LDSEEK_END: position = mem->size + offset; break;
+        default: return -1;
+    }
+    if(position < 0 || position > mem->size) return -1;
+    mem->position = position;
+    return 0;
+}
+
+static int32_t memory_tell(ld_stream_t stream)
+{
+    return ((memory_stream_t*)stream->userData)->position;
+}
+
+static void memory_close(ld_stream_t stream)
+{
+    free(stream->userData);
+    ld_stream_destroy(stream);
+}
+
+static ld_stream_t memory_stream(const unsigned char *data, int32_t size)
+{
+    memory_stream_t *mem = (memory_stream_t*)malloc(sizeof(memory_stream_t));
+    mem->data = data;
+    mem->size = size;
+    mem->position = 0;
+    ld_stream_t stream = ld_stream_new();
+    stream->userData = mem;
+    stream->read = &memory_read;
+    stream->seek = &memory_seek;
+    stream->tell = &memory_tell;
+    stream->close = &memory_close;
+    return stream;
+}
+
+static unsigned char *read_file(const char *path, int32_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if(!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *data = (unsigned char*)malloc(length > 0 ? length : 1);
+    if(fread(data, 1, length, f) != (size_t)length) {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *size = (int32_t)length;
+    return data;
+}
+
+static int frame_size(ld_pcmstream_t audio)
+{
+    switch(audio->format) {
+        case LDFORMAT_MONO8: return 1;
+        case LDFORMAT_MONO16: return 2;
+        case LDFORMAT_STEREO8: return 2;
+        case LDFORMAT_STEREO16: return 4;
+        case LDFORMAT_S16: return 2 * audio->channels;
+        case LDFORMAT_F32: return 4 * audio->channels;
+        case LDFORMAT_S24: return 4 * audio->channels;
+        case LDFORMAT_S32: return 4 * audio->channels;
+        default: return 0;
+    }
+}
+
+typedef struct {
+    const char *file;
+    char codec[32];
+    char container[32];
+    int32_t frequency;
+    int64_t frames;
+    int64_t bytes;
+    double openSeconds; /* median time spent in ld_pcmstream_open */
+    double decodeSeconds; /* median time spent reading the decoded data */
+    size_t openAllocs;
+    size_t decodeAllocs;
+} bench_result_t;
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static int bench_file(const char *path, int iterations, ld_options_t options, bench_result_t *result)
+{
+    int32_t size;
+    unsigned char *data = read_file(path, &size);
+    if(!data) {
+        fprintf(stderr, "unable to read %s\n", path);
+        return 0;
+    }
+    static unsigned char buffer[BUFFER_SIZE];
+    double openTimes[MAX_ITERATIONS];
+    double decodeTimes[MAX_ITERATIONS];
+    memset(result, 0, sizeof(bench_result_t));
+    result->file = path;
+    for(int i = 0; i < iterations; i++) {
+        const char *error = NULL;
+        ld_stream_t input = memory_stream(data, size);
+        size_t allocsBefore = alloc_count;
+        double start = now_seconds();
+        ld_pcmstream_t audio = ld_pcmstream_open(input, options, &error);
+        double opened = now_seconds();
+        if(!audio) {
+            fprintf(stderr, "unable to decode %s: %s\n", path, error ? error : "unknown error");
+            free(data);
+            return 0;
+        }
+        size_t allocsOpened = alloc_count;
+        int64_t bytes = 0;
+        size_t readlen;
+        while((readlen = audio->stream->read(buffer, BUFFER_SIZE, audio->stream)) > 0) {
+            bytes += readlen;
+        }
+        double finished = now_seconds();
+        openTimes[i] = opened - start;
+        decodeTimes[i] = finished - opened;
+        result->openAllocs = allocsOpened - allocsBefore;
+        result->decodeAllocs = alloc_count - allocsOpened;
+        result->bytes = bytes;
+        result->frequency = audio->frequency;
+        int fs = frame_size(audio);
+        result->frames = fs ? bytes / fs : 0;
+        if(!ld_pcmstream_get_string_id(audio, LD_PROPERTY_ID_CODEC, result->codec, sizeof(result->codec)))
+            strcpy(result->codec, "unknown");
+        if(!ld_pcmstream_get_string_id(audio, LD_PROPERTY_ID_CONTAINER, result->container, sizeof(result->container)))
+            result->container[0] = '\0';
+        ld_pcmstream_close(audio);
+    }
+    qsort(openTimes, iterations, sizeof(double), compare_double);
+    qsort(decodeTimes, iterations, sizeof(double), compare_double);
+    result->openSeconds = openTimes[iterations / 2];
+    result->decodeSeconds = decodeTimes[iterations / 2];
+    free(data);
+    return 1;
+}
+
+static double ns_per_frame(const bench_result_t *r)
+{
+    return r->frames ? (r->decodeSeconds * 1e9) / (double)r->frames : 0;
+}
+
+/* Finds a numeric field of the result for path in a file written by a previous run.
+ * Only understands the one-result-per-line layout this program writes */
+static int baseline_lookup(const char *baseline, const char *path, const char *name, double *value)
+{
+    char pattern[1100];
+    snprintf(pattern, sizeof(pattern), "\"file\": \"%s\"", path);
+    const char *line = strstr(baseline, pattern);
+    if(!line) return 0;
+    const char *end = strchr(line, '\n');
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", name);
+    const char *field = strstr(line, pattern);
+    if(!field || (end && field > end)) return 0;
+    return sscanf(field + strlen(pattern), "%lf", value) == 1;
+}
+
+/* sorted samples in seconds */
+typedef struct {
+    double *values;
+    size_t count;
+    size_t capacity;
+} samples_t;
+
+static void samples_add(samples_t *s, double value)
+{
+    if(s->count == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 1024;
+        s->values = (double*)realloc(s->values, s->capacity * sizeof(double));
+    }
+    s->values[s->count++] = value;
+}
+
+static double samples_percentile(const samples_t *s, double pct)
+{
+    if(!s->count) return 0;
+    size_t index = (size_t)(pct / 100.0 * (double)(s->count - 1) + 0.5);
+    return s->values[index];
+}
+
+typedef struct {
+    const char *file;
+    char codec[32];
+    char container[32];
+    int32_t size;
+    int32_t frequency;
+    int blockFrames;
+    samples_t open; /* ld_pcmstream_open until the first block is filled */
+    samples_t reads; /* time to fill each block after the first */
+    size_t overruns; /* blocks that took longer than the audio they contain */
+    size_t histogram[HISTOGRAM_BUCKETS]; /* reads by power of two microseconds */
+} latency_result_t;
+
+static int latency_file(const char *path, int iterations, int blockFrames, ld_options_t options, latency_result_t *result)
+{
+    int32_t size;
+    unsigned char *data = read_file(path, &size);
+    if(!data) {
+        fprintf(stderr, "unable to read %s\n", path);
+        return 0;
+    }
+    static unsigned char buffer[BUFFER_SIZE * 4];
+    memset(result, 0, sizeof(latency_result_t));
+    result->file = path;
+    result->size = size;
+    result->blockFrames = blockFrames;
+    for(int i = 0; i < iterations; i++) {
+        const char *error = NULL;
+        ld_stream_t input = memory_stream(data, size);
+        double start = now_seconds();
+        ld_pcmstream_t audio = ld_pcmstream_open(input, options, &error);
+        if(!audio) {
+            fprintf(stderr, "unable to decode %s: %s\n", path, error ? error : "unknown error");
+            free(data);
+            return 0;
+        }
+        size_t blockBytes = (size_t)blockFrames * frame_size(audio);
+        if(!blockBytes || blockBytes > sizeof(buffer)) {
+            fprintf(stderr, "block size not supported for %s\n", path);
+            ld_pcmstream_close(audio);
+            free(data);
+            return 0;
+        }
+        double period = (double)blockFrames / audio->frequency;
+        int first = 1;
+        for(;;) {
+            /* a callback keeps reading until its block is full */
+            size_t filled = 0, readlen = 1;
+            while(filled < blockBytes && readlen) {
+                readlen = audio->stream->read(buffer + filled, blockBytes - filled, audio->stream);
+                filled += readlen;
+            }
+            double finished = now_seconds();
+            if(!filled) break;
+            double elapsed = finished - start;
+            start = finished;
+            if(first) {
+                samples_add(&result->open, elapsed);
+                first = 0;
+                continue;
+            }
+            if(filled < blockBytes) break; /* last partial block */
+            samples_add(&result->reads, elapsed);
+            if(elapsed > period) result->overruns++;
+            int bucket = 0;
+            double us = elapsed * 1e6;
+            while(us >= 1.0 && bucket < HISTOGRAM_BUCKETS - 1) {
+                us /= 2.0;
+                bucket++;
+            }
+            result->histogram[bucket]++;
+        }
+        result->frequency = audio->frequency;
+        if(!ld_pcmstream_get_string_id(audio, LD_PROPERTY_ID_CODEC, result->codec, sizeof(result->codec)))
+            strcpy(result->codec, "unknown");
+        if(!ld_pcmstream_get_string_id(audio, LD_PROPERTY_ID_CONTAINER, result->container, sizeof(result->container)))
+            result->container[0] = '\0';
+        ld_pcmstream_close(audio);
+    }
+    qsort(result->open.values, result->open.count, sizeof(double), compare_double);
+    qsort(result->reads.values, result->reads.count, sizeof(double), compare_double);
+    free(data);
+    return 1;
+}
+
+static void print_json_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for(; *str; str++) {
+        if(*str == '"' || *str == '\\') fputc('\\', out);
+        fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+static void print_result_header(FILE *out, int printed, const char *file, const char *codec, const char *container)
+{
+    fprintf(out, "%s    {\"file\": ", printed ? ",\n" : "");
+    print_json_string(out, file);
+    fprintf(out, ", \"codec\": ");
+    print_json_string(out, codec);
+    fprintf(out, ", \"container\": ");
+    print_json_string(out, container);
+}
+
+/* Prints the baseline fields and returns 1 when current regressed past threshold percent */
+static int compare_baseline(FILE *out, const char *baseline, const char *file, const char *name,
+    double current, double threshold)
+{
+    double before;
+    if(!baseline || !baseline_lookup(baseline, file, name, &before) || before <= 0) return 0;
+    double delta = (current - before) / before * 100.0;
+    fprintf(out, ", \"baseline_%s\": %.2f, \"delta_pct\": %.2f", name, before, delta);
+    fprintf(stderr, "%-40s %10.2f -> %10.2f %s (%+.2f%%)%s\n", file, before, current, name, delta,
+        delta > threshold ? " REGRESSION" : "");
+    return delta > threshold;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-l] [-c frames] [-n iterations] [-o output.json] [-b baseline.json] [-t threshold%%] files...\n", name);
+    fprintf(stderr, "  -l  measure latency instead of throughput\n");
+    fprintf(stderr, "  -c  with -l, frames pulled per simulated audio callback (default 512)\n");
+    fprintf(stderr, "  -n  decodes of each file (default 5, or 20 with -l)\n");
+    fprintf(stderr, "  -o  write the JSON results to a file instead of stdout\n");
+    fprintf(stderr, "  -b  compare ns_per_frame (read_p99_us with -l) against a previous run\n");
+    fprintf(stderr, "  -t  with -b, exit with 1 if any file is this many percent slower (default 5)\n");
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 0;
+    int latency = 0;
+    int blockFrames = 512;
+    const char *outputPath = NULL;
+    const char *baselinePath = NULL;
+    double threshold = 5.0;
+    int first = 1;
+    for(; first < argc && argv[first][0] == '-'; first++) {
+        if(!strcmp(argv[first], "-l")) {
+            latency = 1;
+            continue;
+        }
+        if(first + 1 >= argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        if(!strcmp(argv[first], "-n")) iterations = atoi(argv[++first]);
+        else if(!strcmp(argv[first], "-o")) outputPath = argv[++first];
+        else if(!strcmp(argv[first], "-b")) baselinePath = argv[++first];
+        else if(!strcmp(argv[first], "-t")) threshold = atof(argv[++first]);
+        else if(!strcmp(argv[first], "-c")) blockFrames = atoi(argv[++first]);
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if(!iterations) iterations = latency ? 20 : 5;
+    if(first >= argc || iterations < 1 || blockFrames < 1 || (!latency && iterations > MAX_ITERATIONS)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    char *baseline = NULL;
+    if(baselinePath) {
+        int32_t baselineSize;
+        baseline = (char*)read_file(baselinePath, &baselineSize);
+        if(!baseline) {
+            fprintf(stderr, "unable to read baseline %s\n", baselinePath);
+            return 2;
+        }
+        baseline = (char*)realloc(baseline, baselineSize + 1);
+        baseline[baselineSize] = '\0';
+    }
+    FILE *out = stdout;
+    if(outputPath && !(out = fopen(outputPath, "w"))) {
+        fprintf(stderr, "unable to open file %s for writing\n", outputPath);
+        return 2;
+    }
+
+    ld_init();
+    ld_options_t options = ld_options_new();
+    ld_options_set_allocator(options, count_malloc, count_realloc, count_free, NULL);
+
+    int regressions = 0;
+    int failures = 0;
+    fprintf(out, "{\n  \"mode\": \"%s\",\n  \"iterations\": %d,\n  \"results\": [\n",
+        latency ? "latency" : "throughput", iterations);
+    int printed = 0;
+    for(int i = first; i < argc; i++) {
+        if(latency) {
+            latency_result_t r;
+            if(!latency_file(argv[i], iterations, blockFrames, options, &r)) {
+                failures++;
+                continue;
+            }
+            print_result_header(out, printed++, r.file, r.codec, r.container);
+            double readP99 = samples_percentile(&r.reads, 99) * 1e6;
+            fprintf(out, ", \"size\": %d, \"block_frames\": %d, \"block_us\": %.1f"
+                ", \"open_p50_us\": %.1f, \"open_p99_us\": %.1f, \"open_max_us\": %.1f"
+                ", \"read_p50_us\": %.2f, \"read_p99_us\": %.2f, \"read_p999_us\": %.2f, \"read_max_us\": %.2f"
+                ", \"reads\": %zu, \"overruns\": %zu",
+                r.size, r.blockFrames, r.frequency ? r.blockFrames * 1e6 / r.frequency : 0,
+                samples_percentile(&r.open, 50) * 1e6, samples_percentile(&r.open, 99) * 1e6,
+                samples_percentile(&r.open, 100) * 1e6,
+                samples_percentile(&r.reads, 50) * 1e6, readP99,
+                samples_percentile(&r.reads, 99.9) * 1e6, samples_percentile(&r.reads, 100) * 1e6,
+                r.reads.count, r.overruns);
+            /* upper bound in microseconds -> reads */
+            fprintf(out, ", \"read_histogram_us\": {");
+            int bucketsPrinted = 0;
+            for(int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+                if(!r.histogram[b]) continue;
+                fprintf(out, "%s\"%lu\": %zu", bucketsPrinted++ ? ", " : "", 1UL << b, r.histogram[b]);
+            }
+            fprintf(out, "}");
+            regressions += compare_baseline(out, baseline, r.file, "read_p99_us", readP99, threshold);
+            fprintf(out, "}");
+            free(r.open.values);
+            free(r.reads.values);
+            continue;
+        }
+        bench_result_t r;
+        if(!bench_file(argv[i], iterations, options, &r)) {
+            failures++;
+            continue;
+        }
+        double seconds = r.frequency ? (double)r.frames / r.frequency : 0;
+        double mbps = r.decodeSeconds > 0 ? (r.bytes / (1024.0 * 1024.0)) / r.decodeSeconds : 0;
+        double realtime = r.decodeSeconds > 0 ? seconds / r.decodeSeconds : 0;
+        double nsFrame = ns_per_frame(&r);
+        double allocsFrame = r.frames ? (double)r.decodeAllocs / (double)r.frames : 0;
+        print_result_header(out, printed++, r.file, r.codec, r.container);
+        fprintf(out, ", \"frames\": %lld, \"frequency\": %d, \"open_us\": %.1f, \"open_allocs\": %zu"
+            ", \"mb_per_s\": %.2f, \"realtime\": %.1f, \"ns_per_frame\": %.2f, \"allocs_per_frame\": %.6f",
+            (long long)r.frames, r.frequency, r.openSeconds * 1e6, r.openAllocs,
+            mbps, realtime, nsFrame, allocsFrame);
+        regressions += compare_baseline(out, baseline, r.file, "ns_per_frame", nsFrame, threshold);
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if(out != stdout) fclose(out);
+    ld_options_free(options);
+    free(baseline);
+    if(failures) return 1;
+    return regressions ? 1 : 0;
+}
@@ -52,9 +52,11 @@ int main(int argc, char **argv)
     
     printf("frequency: %d\n", audio->frequency);
     const char* formats[] = {
-        "", "mono8", "mono16", "stereo8", "stereo16"
+        "", "mono8", "mono16", "stereo8", "stereo16", "s16", "f32", "s24", "s32"
     };
     printf("format: %s\n", formats[audio->format]);
+    if(audio->channels > 2)
+        printf("channels: %d\n", audio->channels);
     ld_pcmstream_print_properties(audio);
     riff_header_t riff;
     memcpy(riff.chunkID, "RIFF", 4);
@@ -64,10 +66,13 @@ int main(int argc, char **argv)
     wave_format_t wav;
     memcpy(wav.subChunkID, "fmt ", 4);
     wav.subChunkSize = 16;
-    wav.audioFormat = 0x1;
-    wav.numChannels = (audio->format == LDFORMAT_MONO8 || audio->format == LDFORMAT_MONO16) ? 1 : 2;
+    wav.audioFormat = audio->format == LDFORMAT_F32 ? 0x3 : 0x1;
+    wav.numChannels = audio->channels;
     wav.sampleRate = audio->frequency;
-    wav.bitsPerSample = (audio->format == LDFORMAT_MONO8 || audio->format == LDFORMAT_STEREO8) ? 8 : 16;
+    if(audio->format == LDFORMAT_F32)
+        wav.bitsPerSample = 32;
+    else
+        wav.bitsPerSample = (audio->format == LDFORMAT_MONO8 || audio->format == LDFORMAT_STEREO8) ? 8 : 16;
     wav.blockAlign = (wav.numChannels * wav.bitsPerSample) / 8;
     wav.byteRate = wav.blockAlign * wav.sampleRate;
     fwrite(&wav, sizeof(wave_format_t), 1, output);
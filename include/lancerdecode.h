@@ -15,6 +15,10 @@ typedef int32_t LDFORMAT;
 #define LDFORMAT_MONO16 2
 #define LDFORMAT_STEREO8 3
 #define LDFORMAT_STEREO16 4
+#define LDFORMAT_S16 5 /* interleaved int16_t with more than two channels */
+#define LDFORMAT_F32 6 /* interleaved float, nominally in [-1, 1], any channel count */
+#define LDFORMAT_S24 7 /* interleaved int32_t holding sign-extended 24-bit samples, any channel count */
+#define LDFORMAT_S32 8 /* interleaved int32_t, full scale, any channel count */
 
 typedef int32_t LDSEEK;
 
@@ -35,13 +39,73 @@ typedef int32_t LDSEEK;
 #endif
 
 typedef void (*ld_msgcallback_t)(const char*);
+typedef void *(*ld_malloc_t)(size_t size, void *userdata);
+typedef void *(*ld_realloc_t)(void *ptr, size_t size, void *userdata);
+typedef void (*ld_free_t)(void *ptr, void *userdata);
 
 
+/* One-time global initialisation (CPU feature detection, decoder tables).
+ * The ld_pcmstream_open functions and ld_probe call it, so it is optional; it is safe to
+ * call from any thread, call it at startup to keep the work off the first open */
+LDEXPORT void ld_init(void);
+
 typedef struct ld_options *ld_options_t;
 
 LDEXPORT ld_options_t ld_options_new();
 LDEXPORT void ld_options_set_msginfo(ld_options_t opts, ld_msgcallback_t cb);
 LDEXPORT void ld_options_set_msgerror(ld_options_t opts, ld_msgcallback_t cb);
+
+/* Sample type and channel limit of decoded output. sampleType is LDFORMAT_S16 (default),
+ * LDFORMAT_F32, LDFORMAT_S24 or LDFORMAT_S32. Decoders without float output (WAV PCM, FLAC) keep
+ * 16-bit for F32, S24 and S32 are only produced by FLAC (S32 for sources deeper than 24 bits),
+ * other decoders keep their 16-bit or float output. Sources with more than maxChannels channels
+ * are downmixed to stereo where the decoder can, default 2.
+ * Check format and channels of the opened stream */
+LDEXPORT void ld_options_set_output(ld_options_t opts, LDFORMAT sampleType, int32_t maxChannels);
+
+typedef int32_t LDLOGLEVEL;
+#define LDLOG_NONE 0
+#define LDLOG_ERROR 1 /* sent to msgerror/stderr */
+#define LDLOG_WARNING 2 /* sent to msgerror/stderr */
+#define LDLOG_INFO 3 /* sent to msginfo/stdout */
+#define LDLOG_DEBUG 4 /* sent to msginfo/stdout */
+
+#define LDLOG_CAT_OPEN 0x1 /* format detection and decoder setup */
+#define LDLOG_CAT_DECODE 0x2 /* errors reading or seeking an open stream */
+#define LDLOG_CAT_PROPERTIES 0x4 /* ld_pcmstream_print_properties */
+#define LDLOG_CAT_ALL 0x7
+/* Only messages at or below level in one of the categories are logged, others are
+ * dropped before they are formatted. Defaults to LDLOG_INFO, LDLOG_CAT_ALL.
+ * A stream logs the same message at most 3 times in a row, further repeats are
+ * counted and reported once another message is logged or the stream is closed */
+LDEXPORT void ld_options_set_loglevel(ld_options_t opts, LDLOGLEVEL level, uint32_t categories);
+/* Routes the allocations of streams opened with these options (decoder state,
+ * buffers, properties) through the given functions. All three must be set,
+ * passing NULL restores the libc allocator */
+LDEXPORT void ld_options_set_allocator(ld_options_t opts, ld_malloc_t mallocfn, ld_realloc_t reallocfn, ld_free_t freefn, void *userdata);
+
+typedef int32_t LDSPAN;
+#define LDSPAN_OPEN 1 /* ld_pcmstream_open, format detection until the decoder is ready */
+#define LDSPAN_DETECT 2 /* format detection and header parsing */
+#define LDSPAN_READ 3 /* decoding through the PCM stream's read */
+#define LDSPAN_SEEK 4 /* seek on the PCM stream */
+#define LDSPAN_IO_READ 5 /* read on the stream the PCM stream was opened from */
+#define LDSPAN_IO_SEEK 6 /* seek on the stream the PCM stream was opened from */
+
+typedef struct {
+	LDSPAN type;
+	const char *codec; /* LD_PROPERTY_CODEC value, NULL until the format is detected */
+	int64_t bytes; /* READ, IO_READ: bytes requested at begin, bytes returned at end */
+	int64_t frames; /* READ: PCM frames requested at begin, returned at end */
+	int32_t offset; /* SEEK, IO_SEEK: the offset passed to seek */
+	int32_t result; /* at end: 1 if OPEN or DETECT succeeded, the return value of seeks */
+} ld_span_t;
+typedef void (*ld_spancallback_t)(const ld_span_t *span, void *userdata);
+/* Calls begin and end around opens, format detection, decoding reads and seeks, and the reads
+ * and seeks made on the source stream, e.g. to feed a profiler timeline. Spans nest and are reported
+ * on the calling thread. Both must be set, passing NULL disables tracing.
+ * Streams opened without callbacks take no tracing overhead */
+LDEXPORT void ld_options_set_tracing(ld_options_t opts, ld_spancallback_t begin, ld_spancallback_t end, void *userdata);
 LDEXPORT void ld_options_free(ld_options_t opts);
 
 
@@ -51,6 +115,7 @@ typedef struct ld_pcmstream_internal *ld_pcmstream_internal_t;
 
 struct ld_stream {
     size_t (*read)(void* buffer,size_t size,ld_stream_t stream);
+    /* NULL for forward-only streams such as pipes, see ld_pcmstream_open */
     int (*seek)(ld_stream_t stream,int32_t offset,LDSEEK origin);
     int32_t (*tell)(ld_stream_t stream); //Only set for base file streams
     void (*close)(ld_stream_t stream);
@@ -80,11 +145,30 @@ struct ld_pcmstream {
 	LDFORMAT format; /* format */
 	int32_t blockSize; /* suggested buffer size when reading this audio data */
 	ld_pcmstream_internal_t _internal; /* internal use */
+	int32_t channels; /* interleaved channels in each frame */
 };
 
-/* Opens an audio file from stream, initialising a decoder if necessary */
+/* Opens an audio file from stream, initialising a decoder if necessary.
+ * The file starts at offset 0 of seekable streams, use ld_stream_wrap for one inside a larger file.
+ * Forward-only streams are buffered while the decoder opens, PCM streams opened
+ * from them can't loop or seek to frames, and seeking their stream returns -1 */
 LDEXPORT ld_pcmstream_t ld_pcmstream_open(ld_stream_t stream, ld_options_t options, const char **error);
 
+/* Opens stream as the codec hint names, e.g. from an asset database, skipping format detection.
+ * hint is a codec name ("pcm", "mp3", "vorbis", "flac", "opus" or one added with ld_codec_register)
+ * or a file extension ("wav", ".ogg"), case insensitive. "wav" covers every codec in a RIFF file,
+ * "ogg" and "vorbis" every Ogg codec, "flac" native and Ogg FLAC.
+ * Falls back to ld_pcmstream_open when the hint is unknown or its decoder fails,
+ * a NULL hint always does */
+LDEXPORT ld_pcmstream_t ld_pcmstream_open_hinted(ld_stream_t stream, const char *hint, ld_options_t options, const char **error);
+
+typedef void (*ld_linkcallback_t)(ld_pcmstream_t stream, int32_t link, void *userdata);
+/* Called from read when a chained Ogg file (Vorbis, Opus) moves on to its next logical
+ * stream, link counts from 0. frequency, format and channels already describe the new link,
+ * a single read never returns frames of two links with different formats.
+ * Passing NULL disables it */
+LDEXPORT void ld_options_set_linkcallback(ld_options_t opts, ld_linkcallback_t cb, void *userdata);
+
 /* STRING: Codec of the audio file */
 #define LD_PROPERTY_CODEC ("ld.codec")
 /* STRING: Container of the audio file */
@@ -97,6 +181,14 @@ LDEXPORT ld_pcmstream_t ld_pcmstream_open(ld_stream_t stream, ld_options_t optio
 #define LD_PROPERTY_MP3_TRIM ("mp3.trim")
 /* INTEGER: max samples in mp3 (applied when not .wav container) */
 #define LD_PROPERTY_MP3_SAMPLES ("mp3.samples")
+/* STRING: speaker order of the interleaved channels for more than two, e.g. "FL,FC,FR,RL,RR,LFE" */
+#define LD_PROPERTY_CHANNEL_ORDER ("ld.channelorder")
+/* INTEGER: bit depth of the source samples (WAV PCM, FLAC) */
+#define LD_PROPERTY_BITS_PER_SAMPLE ("ld.bitspersample")
+/* INTEGER: first frame of the file's loop region (RIFF smpl chunk, LOOPSTART comment) */
+#define LD_PROPERTY_LOOP_START ("ld.loopstart")
+/* INTEGER: frames in the file's loop region (RIFF smpl chunk, LOOPLENGTH comment) */
+#define LD_PROPERTY_LOOP_LENGTH ("ld.looplength")
 /* Gets an integer property from an open ld_pcmstream_t */
 /* Returns 1 on success */
 LDEXPORT int ld_pcmstream_get_int(ld_pcmstream_t stream, const char *property, int* value);
@@ -106,6 +198,126 @@ LDEXPORT int ld_pcmstream_get_int(ld_pcmstream_t stream, const char *property, i
 LDEXPORT int ld_pcmstream_get_string(ld_pcmstream_t stream, const char *property, char *buffer, int size);
 /* Prints all properties to msginfo/stdout on an open ld_pcmstream_t */
 LDEXPORT void ld_pcmstream_print_properties(ld_pcmstream_t stream);
+
+/* Makes read wrap from frame end back to frame start, with no gap and without reinitialising
+ * the decoder. Frames count from the first frame read returns, end -1 loops at the end of the
+ * stream and start -1 stops looping. Reads then only return whole frames. In chained Ogg files
+ * start must be in link 0, or the loop set before read moves past start's link.
+ * Returns 0 on success, -1 if the decoder can't seek to start */
+LDEXPORT int ld_pcmstream_set_loop(ld_pcmstream_t stream, int32_t start, int32_t end);
+/* ld_pcmstream_set_loop over LD_PROPERTY_LOOP_START and LD_PROPERTY_LOOP_LENGTH,
+ * returns -1 if the file has no loop region */
+LDEXPORT int ld_pcmstream_loop_file(ld_pcmstream_t stream);
+
+/* Lends the next decoded frames straight from the decoder's output, one float buffer per channel
+ * in the channel order of read, skipping the copy and interleave done by read. Samples are float
+ * whatever the stream's format. planes must not be written and stay valid until
+ * ld_pcmstream_release_frame, which must be called before the next acquire, read or seek.
+ * Loops set with ld_pcmstream_set_loop apply as they do to read.
+ * Returns 1 and sets frames, 0 at the end of the stream, or -1 if the decoder can't lend its
+ * output (only Vorbis without downmixing can), read still works then */
+LDEXPORT int ld_pcmstream_acquire_frame(ld_pcmstream_t stream, float ***planes, int32_t *frames);
+/* Returns frames lent by ld_pcmstream_acquire_frame to the decoder */
+LDEXPORT void ld_pcmstream_release_frame(ld_pcmstream_t stream);
+
+/* Bytes held by an open stream, or by all open streams */
+typedef struct ld_memory_usage {
+	size_t decoder; /* codec state: stb_vorbis setup and codebooks, drmp3, drflac */
+	size_t buffers; /* I/O and conversion buffers: sbuffer, mp3 float buffer */
+	size_t properties; /* property table */
+	size_t overhead; /* stream objects and reserved but unused space */
+	size_t total; /* sum of the above */
+} ld_memory_usage_t;
+/* Process-wide totals of every open ld_pcmstream_t */
+typedef struct ld_memory_totals {
+	ld_memory_usage_t current;
+	size_t highWater; /* highest current.total since start or the last reset */
+	int32_t streams; /* open streams */
+	int32_t streamsHighWater; /* highest streams since start or the last reset */
+} ld_memory_totals_t;
+/* Fills usage with the memory held by stream. State libopusfile allocates itself is not included */
+LDEXPORT void ld_pcmstream_memory_usage(ld_pcmstream_t stream, ld_memory_usage_t *usage);
+/* Fills totals, safe to call from any thread */
+LDEXPORT void ld_memory_totals(ld_memory_totals_t *totals);
+/* Resets the high-water marks to the current values */
+LDEXPORT void ld_memory_reset_high_water(void);
+
+/* IDs of the LD_PROPERTY_* keys, for lookups without string compares */
+#define LD_PROPERTY_ID_CODEC 0
+#define LD_PROPERTY_ID_CONTAINER 1
+#define LD_PROPERTY_ID_FL_TRIM 2
+#define LD_PROPERTY_ID_FL_SAMPLES 3
+#define LD_PROPERTY_ID_MP3_TRIM 4
+#define LD_PROPERTY_ID_MP3_SAMPLES 5
+#define LD_PROPERTY_ID_LOOP_START 6
+#define LD_PROPERTY_ID_LOOP_LENGTH 7
+#define LD_PROPERTY_ID_CHANNEL_ORDER 8
+#define LD_PROPERTY_ID_BITS_PER_SAMPLE 9
+#define LD_PROPERTY_ID_COUNT 10
+/* Returns the ID of a property name (case-insensitive), or -1 if it has none */
+LDEXPORT int ld_property_id(const char *property);
+/* ld_pcmstream_get_int/ld_pcmstream_get_string taking a property ID */
+LDEXPORT int ld_pcmstream_get_int_id(ld_pcmstream_t stream, int id, int* value);
+LDEXPORT int ld_pcmstream_get_string_id(ld_pcmstream_t stream, int id, char *buffer, int size);
+/* Format information returned by ld_probe */
+typedef struct ld_probe_info {
+	const char *container; /* LD_PROPERTY_CONTAINER value e.g. "wav" */
+	const char *codec; /* LD_PROPERTY_CODEC value e.g. "mp3" */
+	int32_t channels; /* channel count of the encoded stream */
+	int32_t frequency; /* sample rate e.g. 44100 */
+	int32_t bitsPerSample; /* source bit depth, or 0 for lossy codecs */
+	int64_t totalFrames; /* PCM frames the decoder will produce after trimming, or -1 */
+	int32_t flTrim; /* LD_PROPERTY_FL_TRIM, or -1 */
+	int32_t flSamples; /* LD_PROPERTY_FL_SAMPLES, or -1 */
+	int32_t mp3Trim; /* LD_PROPERTY_MP3_TRIM, or -1 */
+	int32_t mp3Samples; /* LD_PROPERTY_MP3_SAMPLES, or -1 */
+} ld_probe_info_t;
+/* Reads format information from the headers of stream without initialising a decoder.
+ * The stream is left open and seeked back to the start, forward-only streams are left
+ * where probing stopped reading.
+ * Returns 1 on success */
+LDEXPORT int ld_probe(ld_stream_t stream, ld_probe_info_t *info);
+/* Cache of format detection and header parsing results, for files that are opened repeatedly.
+ * Safe to share between threads */
+typedef struct ld_probecache *ld_probecache_t;
+LDEXPORT ld_probecache_t ld_probecache_new();
+LDEXPORT void ld_probecache_clear(ld_probecache_t cache);
+LDEXPORT void ld_probecache_free(ld_probecache_t cache);
+/* Opens an audio file like ld_pcmstream_open, storing the parsed headers in cache under key.
+ * Repeat opens of the same key skip straight to decoder initialisation at the known data offset,
+ * so key must uniquely identify the file contents (e.g. a path inside an immutable archive) */
+LDEXPORT ld_pcmstream_t ld_pcmstream_open_cached(ld_stream_t stream, ld_probecache_t cache, const char *key, ld_options_t options, const char **error);
+
+/* Format detection reads the first LD_PEEK_SIZE bytes of a file once and lets every enabled codec
+ * score them, the highest score opens the file. Ties go to the codec registered first */
+#define LD_PEEK_SIZE 512
+#define LD_SCORE_MAX 100 /* the peek buffer is certainly this codec's format */
+#define LDCODEC_SEEKABLE 0x1 /* seeks to any frame, ld_pcmstream_set_loop works */
+#define LDCODEC_FLOAT 0x2 /* can output LDFORMAT_F32 */
+#define LDCODEC_HIRES 0x4 /* can output LDFORMAT_S24 and LDFORMAT_S32 */
+#define LDCODEC_PARALLEL 0x8 /* streams can be decoded on different threads at the same time */
+typedef struct ld_codec {
+	const char *name; /* LD_PROPERTY_CODEC value e.g. "vorbis", not copied */
+	uint32_t flags; /* LDCODEC_* */
+	/* Scores peek, the first peekSize bytes of the file (fewer than LD_PEEK_SIZE for short files).
+	 * 0 if the codec can't decode it, up to LD_SCORE_MAX */
+	int32_t (*probe)(const unsigned char *peek, int32_t peekSize, void *userdata);
+	/* Opens the file, stream is at its start. On failure sets error and returns NULL,
+	 * leaving stream to the caller. See ld_pcmstream_new. NULL for the built-in codecs */
+	ld_pcmstream_t (*open)(ld_stream_t stream, ld_options_t options, const char **error, void *userdata);
+	void *userdata;
+} ld_codec_t;
+/* Adds a codec after the built-in ones (pcm, mp3, vorbis, flac, opus). Safe to call from any thread.
+ * Returns 1 on success, 0 if the name is taken or the registry is full */
+LDEXPORT int ld_codec_register(const ld_codec_t *codec);
+/* Stops or resumes detecting files of the codec called name, returns 0 if there is none */
+LDEXPORT int ld_codec_set_enabled(const char *name, int enabled);
+/* Copies the registered codec at index, returns 0 past the last one */
+LDEXPORT int ld_codec_get(int32_t index, ld_codec_t *codec, int *enabled);
+/* Creates the PCM stream of a registered codec's open over decoded, which then belongs to it:
+ * ld_pcmstream_close calls its close */
+LDEXPORT ld_pcmstream_t ld_pcmstream_new(ld_stream_t decoded, ld_options_t options, int32_t frequency, LDFORMAT format, int32_t channels);
+
 /* Closes the PCM stream */
 LDEXPORT void ld_pcmstream_close(ld_pcmstream_t stream);
 #ifdef __cplusplus
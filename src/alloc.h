@@ -0,0 +1,38 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//ALLOC
+//allocator set through ld_options_set_allocator, falls back to libc when unset
+#ifndef _ALLOC_H_
+#define _ALLOC_H_
+#include <lancerdecode.h>
+#include <stdlib.h>
+
+typedef struct {
+    ld_malloc_t malloc;
+    ld_realloc_t realloc;
+    ld_free_t free;
+    void *userdata;
+} ld_allocator_t;
+
+static inline void *mem_alloc(const ld_allocator_t *alloc, size_t size)
+{
+    if(alloc && alloc->malloc) return alloc->malloc(size, alloc->userdata);
+    return malloc(size);
+}
+
+static inline void *mem_realloc(const ld_allocator_t *alloc, void *ptr, size_t size)
+{
+    if(alloc && alloc->malloc) return alloc->realloc(ptr, size, alloc->userdata);
+    return realloc(ptr, size);
+}
+
+static inline void mem_free(const ld_allocator_t *alloc, void *ptr)
+{
+    if(!ptr) return;
+    if(alloc && alloc->malloc) alloc->free(ptr, alloc->userdata);
+    else free(ptr);
+}
+
+#endif
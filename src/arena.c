@@ -0,0 +1,196 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "arena.h"
+#include "atomics.h"
+#include <string.h>
+
+#define ARENA_ALIGN 16
+#define ALIGN_UP(x) (((x) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+//heap fallbacks are prefixed with their size and zone so frees can be accounted
+#define HEAP_HEADER ARENA_ALIGN
+
+typedef struct {
+    size_t size;
+    size_t category;
+} heap_header_t;
+
+typedef struct {
+    ld_arena_t *arena;
+    size_t bytes;
+} arena_zone_t;
+
+struct ld_arena {
+    ld_allocator_t parent;
+    size_t size;
+    size_t used;
+    size_t last; //offset of the most recent allocation
+    arena_category_t lastCategory;
+    size_t heap; //bytes in heap fallbacks
+    arena_zone_t zones[ARENA_CATEGORY_COUNT];
+    unsigned char *data;
+};
+
+//process-wide, see arena_totals
+static volatile size_t total_categories[ARENA_CATEGORY_COUNT];
+static volatile size_t total_bytes;
+static volatile size_t total_high_water;
+static volatile size_t total_arenas;
+static volatile size_t total_arenas_high_water;
+
+static void charge(arena_zone_t *zone, ptrdiff_t bytes)
+{
+    zone->bytes += bytes;
+    atomic_add_size(&total_categories[zone - zone->arena->zones], bytes);
+}
+
+static void charge_heap(arena_zone_t *zone, ptrdiff_t bytes)
+{
+    charge(zone, bytes);
+    zone->arena->heap += bytes;
+    size_t total = atomic_add_size(&total_bytes, bytes);
+    if(bytes > 0) atomic_max_size(&total_high_water, total);
+}
+
+static int arena_owns(const ld_arena_t *arena, const void *ptr)
+{
+    const unsigned char *p = (const unsigned char*)ptr;
+    return p >= arena->data && p < arena->data + arena->size;
+}
+
+static void *arena_malloc(size_t size, void *userdata)
+{
+    arena_zone_t *zone = (arena_zone_t*)userdata;
+    ld_arena_t *arena = zone->arena;
+    size_t sz = ALIGN_UP(size ? size : 1);
+    if(sz <= arena->size - arena->used) {
+        arena->last = arena->used;
+        arena->lastCategory = (arena_category_t)(zone - arena->zones);
+        arena->used += sz;
+        charge(zone, sz);
+        return arena->data + arena->last;
+    }
+    heap_header_t *block = (heap_header_t*)mem_alloc(&arena->parent, size + HEAP_HEADER);
+    if(!block) return NULL;
+    block->size = size;
+    block->category = (size_t)(zone - arena->zones);
+    charge_heap(zone, size);
+    return (unsigned char*)block + HEAP_HEADER;
+}
+
+static void arena_free(void *ptr, void *userdata)
+{
+    arena_zone_t *zone = (arena_zone_t*)userdata;
+    ld_arena_t *arena = zone->arena;
+    if(!ptr) return;
+    if(!arena_owns(arena, ptr)) {
+        heap_header_t *block = (heap_header_t*)((unsigned char*)ptr - HEAP_HEADER);
+        charge_heap(&arena->zones[block->category], -(ptrdiff_t)block->size);
+        mem_free(&arena->parent, block);
+        return;
+    }
+    //stack-like temporary buffers (e.g. stb_vorbis setup) give their space back
+    if((unsigned char*)ptr == arena->data + arena->last && arena->used > arena->last) {
+        charge(&arena->zones[arena->lastCategory], -(ptrdiff_t)(arena->used - arena->last));
+        arena->used = arena->last;
+    }
+}
+
+static void *arena_realloc(void *ptr, size_t size, void *userdata)
+{
+    arena_zone_t *zone = (arena_zone_t*)userdata;
+    ld_arena_t *arena = zone->arena;
+    if(!ptr) return arena_malloc(size, userdata);
+    if(!arena_owns(arena, ptr)) {
+        heap_header_t *block = (heap_header_t*)((unsigned char*)ptr - HEAP_HEADER);
+        size_t oldsize = block->size;
+        block = (heap_header_t*)mem_realloc(&arena->parent, block, size + HEAP_HEADER);
+        if(!block) return NULL;
+        block->size = size;
+        charge_heap(&arena->zones[block->category], (ptrdiff_t)size - (ptrdiff_t)oldsize);
+        return (unsigned char*)block + HEAP_HEADER;
+    }
+    size_t offset = (size_t)((unsigned char*)ptr - arena->data);
+    if(offset == arena->last && ALIGN_UP(size) <= arena->size - offset) {
+        charge(&arena->zones[arena->lastCategory], (ptrdiff_t)(offset + ALIGN_UP(size)) - (ptrdiff_t)arena->used);
+        arena->used = offset + ALIGN_UP(size);
+        return ptr;
+    }
+    //the old size isn't known, copy what can belong to it
+    size_t avail = arena->used - offset;
+    void *newptr = arena_malloc(size, userdata);
+    if(newptr) memcpy(newptr, ptr, avail < size ? avail : size);
+    return newptr;
+}
+
+ld_arena_t *arena_create(const ld_allocator_t *parent, size_t size)
+{
+    size = ALIGN_UP(size);
+    size_t header = ALIGN_UP(sizeof(ld_arena_t));
+    ld_arena_t *arena = (ld_arena_t*)mem_alloc(parent, header + size + ARENA_ALIGN);
+    if(!arena) return NULL;
+    memset(arena, 0, sizeof(ld_arena_t));
+    if(parent) {
+        arena->parent = *parent;
+    }
+    arena->size = size;
+    for(int i = 0; i < ARENA_CATEGORY_COUNT; i++) {
+        arena->zones[i].arena = arena;
+    }
+    //the parent allocator may only guarantee malloc alignment
+    arena->data = (unsigned char*)ALIGN_UP((uintptr_t)((unsigned char*)arena + header));
+    atomic_max_size(&total_high_water, atomic_add_size(&total_bytes, (ptrdiff_t)size));
+    atomic_max_size(&total_arenas_high_water, atomic_add_size(&total_arenas, 1));
+    return arena;
+}
+
+void arena_destroy(ld_arena_t *arena)
+{
+    ld_allocator_t parent;
+    if(!arena) return;
+    for(int i = 0; i < ARENA_CATEGORY_COUNT; i++) {
+        atomic_add_size(&total_categories[i], -(ptrdiff_t)arena->zones[i].bytes);
+    }
+    atomic_add_size(&total_bytes, -(ptrdiff_t)(arena->size + arena->heap));
+    atomic_add_size(&total_arenas, -1);
+    parent = arena->parent;
+    mem_free(&parent, arena);
+}
+
+ld_allocator_t arena_allocator(ld_arena_t *arena, arena_category_t category)
+{
+    ld_allocator_t alloc;
+    alloc.malloc = arena_malloc;
+    alloc.realloc = arena_realloc;
+    alloc.free = arena_free;
+    alloc.userdata = &arena->zones[category];
+    return alloc;
+}
+
+size_t arena_category_bytes(const ld_arena_t *arena, arena_category_t category)
+{
+    return arena->zones[category].bytes;
+}
+
+size_t arena_total_bytes(const ld_arena_t *arena)
+{
+    return arena->size + arena->heap;
+}
+
+void arena_totals(arena_totals_t *totals)
+{
+    for(int i = 0; i < ARENA_CATEGORY_COUNT; i++) {
+        totals->categories[i] = atomic_load_size(&total_categories[i]);
+    }
+    totals->total = atomic_load_size(&total_bytes);
+    totals->highWater = atomic_load_size(&total_high_water);
+    totals->arenas = atomic_load_size(&total_arenas);
+    totals->arenasHighWater = atomic_load_size(&total_arenas_high_water);
+}
+
+void arena_reset_high_water(void)
+{
+    atomic_store_size(&total_high_water, atomic_load_size(&total_bytes));
+    atomic_store_size(&total_arenas_high_water, atomic_load_size(&total_arenas));
+}
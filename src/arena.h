@@ -0,0 +1,44 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//ARENA
+//one block per pcmstream that its state is carved from, freed with a single call
+//allocations that don't fit go to the parent allocator, frees inside the block
+//are no-ops apart from the most recent allocation which is rewound
+//every allocation is tagged with a category for ld_pcmstream_memory_usage
+#ifndef _ARENA_H_
+#define _ARENA_H_
+#include "alloc.h"
+
+typedef enum {
+    ARENA_OVERHEAD = 0, //pcmstream, userdata and stream objects
+    ARENA_DECODER,      //codec state
+    ARENA_BUFFERS,      //I/O and conversion buffers
+    ARENA_CATEGORY_COUNT
+} arena_category_t;
+
+typedef struct ld_arena ld_arena_t;
+
+//returns NULL when the block can't be allocated
+ld_arena_t *arena_create(const ld_allocator_t *parent, size_t size);
+//frees the block and nothing else, heap fallbacks must already be freed
+void arena_destroy(ld_arena_t *arena);
+//allocator that allocates from the arena, charging category
+ld_allocator_t arena_allocator(ld_arena_t *arena, arena_category_t category);
+//bytes charged to category, and the block size plus heap fallbacks
+size_t arena_category_bytes(const ld_arena_t *arena, arena_category_t category);
+size_t arena_total_bytes(const ld_arena_t *arena);
+
+//sums over all live arenas, safe to call from any thread
+typedef struct {
+    size_t categories[ARENA_CATEGORY_COUNT];
+    size_t total;
+    size_t highWater;
+    size_t arenas;
+    size_t arenasHighWater;
+} arena_totals_t;
+void arena_totals(arena_totals_t *totals);
+void arena_reset_high_water(void);
+
+#endif
@@ -0,0 +1,57 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//ATOMICS
+//relaxed counters shared between threads, e.g. the process-wide memory totals
+#ifndef _ATOMICS_H_
+#define _ATOMICS_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#ifdef _WIN64
+#define ATOMIC_XADD(p, v) ((size_t)_InterlockedExchangeAdd64((volatile __int64*)(p), (__int64)(v)))
+#define ATOMIC_CAS(p, expected, desired) ((size_t)_InterlockedCompareExchange64((volatile __int64*)(p), (__int64)(desired), (__int64)(expected)) == (expected))
+#else
+#define ATOMIC_XADD(p, v) ((size_t)_InterlockedExchangeAdd((volatile long*)(p), (long)(v)))
+#define ATOMIC_CAS(p, expected, desired) ((size_t)_InterlockedCompareExchange((volatile long*)(p), (long)(desired), (long)(expected)) == (expected))
+#endif
+#define ATOMIC_LOAD(p) (*(volatile size_t*)(p))
+#else
+#define ATOMIC_XADD(p, v) __atomic_fetch_add((p), (size_t)(v), __ATOMIC_RELAXED)
+#define ATOMIC_CAS(p, expected, desired) __atomic_compare_exchange_n((p), &(expected), (desired), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#define ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#endif
+
+//adds delta (which may be negative) and returns the new value
+static inline size_t atomic_add_size(volatile size_t *p, ptrdiff_t delta)
+{
+    return ATOMIC_XADD(p, delta) + (size_t)delta;
+}
+
+static inline size_t atomic_load_size(volatile size_t *p)
+{
+    return ATOMIC_LOAD(p);
+}
+
+//raises *p to value if it is lower
+static inline void atomic_max_size(volatile size_t *p, size_t value)
+{
+    size_t current = ATOMIC_LOAD(p);
+    while(current < value) {
+        if(ATOMIC_CAS(p, current, value)) break;
+        current = ATOMIC_LOAD(p);
+    }
+}
+
+static inline void atomic_store_size(volatile size_t *p, size_t value)
+{
+    size_t current = ATOMIC_LOAD(p);
+    while(!ATOMIC_CAS(p, current, value)) {
+        current = ATOMIC_LOAD(p);
+    }
+}
+
+#endif
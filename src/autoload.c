@@ -6,76 +6,255 @@
 #include "formats.h"
 #include "logging.h"
 #include "properties.h"
+#include "stream.h"
+#include "trace.h"
+#include "ogg.h"
+#include "pcmstream.h"
+#include "peekstream.h"
 #include <string.h>
 #include <stdlib.h>
 
-#pragma pack(push, 1)
-typedef struct oggpage {
-    uint32_t capture_pattern;
-    uint8_t version;
-    uint8_t header_type;
-    uint64_t granule;
-    uint32_t bitstream_serial;
-    uint32_t page_sequence;
-    uint32_t checksum;
-    uint8_t segment_count;
-} oggpage_t;
-#pragma pack(pop)
-
-
-ld_pcmstream_t ogg_getstream(ld_stream_t stream, ld_options_t options, const char **error)
+//reads the header and lacing values of the page at the stream position
+static int ogg_readpage(ld_stream_t stream, ogg_page_header_t *page, uint8_t *segments)
 {
-    oggpage_t page;
-    uint8_t segments [256];
-    unsigned char ident[9];
-    if(stream->read(&page, sizeof(oggpage_t), stream) < sizeof(oggpage_t)) {
-        LOG_O_ERROR(options, "Malformed ogg file: unexpected EOF");
-        *error = "Malformed ogg file: unexpected EOF";
-        stream->close(stream);
-        return NULL;
+    uint8_t data[OGG_PAGE_HEADER_SIZE];
+    return stream->read(data, OGG_PAGE_HEADER_SIZE, stream) == OGG_PAGE_HEADER_SIZE &&
+        ogg_parse_header(data, page) &&
+        stream->read(segments, page->segmentCount, stream) == page->segmentCount;
+}
+
+//granule position of the last page belonging to serial, or -1. chained is set
+//when the end of the stream holds pages of a later link
+static int64_t ogg_lastgranule(ld_stream_t stream, uint32_t serial, int *chained)
+{
+    #define OGG_END_SCAN 65536
+    *chained = 0;
+    if(stream->seek(stream, 0, LDSEEK_END)) {
+        return -1;
+    }
+    int32_t length = stream->tell(stream);
+    int32_t start = length > OGG_END_SCAN ? length - OGG_END_SCAN : 0;
+    if(length <= start) {
+        return -1;
     }
-    if(stream->read(segments, page.segment_count, stream) < page.segment_count) {
-        LOG_O_ERROR(options, "Malformed ogg file: unexpected EOF");
-        *error = "Malformed ogg file: unexpected EOF";
-        stream->close(stream);
-        return NULL;
+    //probing takes no options, libc allocator
+    unsigned char *buffer = (unsigned char*)mem_alloc(NULL, length - start);
+    if(!buffer) {
+        return -1;
     }
-    if(stream->read(ident, 9, stream) < 9) {
-        LOG_O_ERROR(options, "Malformed ogg file: unexpected EOF");
-        *error = "Malformed ogg file: unexpected EOF";
-        stream->close(stream);
-        return NULL;
+    stream->seek(stream, start, LDSEEK_SET);
+    int32_t len = (int32_t)stream->read(buffer, length - start, stream);
+    int64_t granule = -1;
+    for(int32_t i = len - OGG_PAGE_HEADER_SIZE; i >= 0; i--) {
+        ogg_page_header_t page;
+        if(buffer[i] != 'O' || !ogg_parse_header(&buffer[i], &page)) {
+            continue;
+        }
+        if(page.serial != serial || ((page.flags & OGG_PAGE_FIRST) && start + i > 0)) {
+            *chained = 1;
+            break;
+        }
+        if(granule == -1 && page.granule != -1) {
+            granule = page.granule;
+        }
     }
-    stream->seek(stream,0,LDSEEK_SET);
-    if(memcmp(ident, "\x1vorbis", 7) == 0) {
-        return vorbis_getstream(stream, options, error);
+    mem_free(NULL, buffer);
+    return granule;
+    #undef OGG_END_SCAN
+}
+
+//frames of all links in a chained file, read from the page headers from the
+//start of the stream. opus links start preskip samples late, or -1
+static int64_t ogg_chainframes(ld_stream_t stream, int opus)
+{
+    ogg_page_header_t page;
+    uint8_t segments[256];
+    int64_t total = 0;
+    int64_t granule = -1;
+    int32_t preskip = 0;
+    int32_t offset = 0;
+    while(!stream->seek(stream, offset, LDSEEK_SET) && ogg_readpage(stream, &page, segments)) {
+        if(page.flags & OGG_PAGE_FIRST) {
+            //the previous link ended on the page before
+            if(granule > preskip) total += granule - preskip;
+            granule = -1;
+            unsigned char head[12];
+            if(opus) {
+                if(stream->read(head, sizeof(head), stream) < sizeof(head) || memcmp(head, "OpusHead", 8))
+                    return -1;
+                preskip = head[10] | (head[11] << 8);
+            }
+        } else if(page.granule != -1) {
+            granule = page.granule;
+        }
+        offset += OGG_PAGE_HEADER_SIZE + page.segmentCount;
+        for(int i = 0; i < page.segmentCount; i++) {
+            offset += segments[i];
+        }
     }
-    if(memcmp(ident, "\x7F""FLAC", 5) == 0) {
-        return flac_getstream(stream, options, error, 1);
+    if(granule > preskip) total += granule - preskip;
+    return total;
+}
+
+int ogg_probe(ld_stream_t stream, ld_probe_info_t *info)
+{
+    ogg_page_header_t page;
+    uint8_t segments [256];
+    unsigned char ident[64];
+    if(!ogg_readpage(stream, &page, segments) || !page.segmentCount) {
+        return 0;
     }
-    if(memcmp(ident, "OpusHead", 8) == 0) {
-        return opus_getstream(stream, options, error);
+    size_t identLength = segments[0] < sizeof(ident) ? segments[0] : sizeof(ident);
+    if(stream->read(ident, identLength, stream) < identLength) {
+        return 0;
     }
-    LOG_O_ERROR(options, "ogg: unexpected codec or stream found");
-    *error = "ogg: unexpected codec or stream found";
-    stream->close(stream);
-    return NULL;
+    info->container = "ogg";
+    //channels and frequency are link 0's, the frames those of every link
+    int chained;
+    int64_t granule = ogg_lastgranule(stream, page.serial, &chained);
+    if(identLength >= 30 && memcmp(ident, "\x1vorbis", 7) == 0) {
+        info->codec = "vorbis";
+        info->channels = ident[11];
+        info->frequency = ident[12] | (ident[13] << 8) | (ident[14] << 16) | ((int32_t)ident[15] << 24);
+        info->totalFrames = chained ? ogg_chainframes(stream, 0) : granule;
+        return 1;
+    }
+    if(identLength >= 51 && memcmp(ident, "\x7F""FLAC", 5) == 0 && memcmp(&ident[9], "fLaC", 4) == 0) {
+        flac_readstreaminfo(&ident[17], info);
+        if(info->totalFrames == -1)
+            info->totalFrames = granule;
+        return 1;
+    }
+    if(identLength >= 19 && memcmp(ident, "OpusHead", 8) == 0) {
+        int preskip = ident[10] | (ident[11] << 8);
+        info->codec = "opus";
+        info->channels = ident[9];
+        info->frequency = 48000;
+        if(chained)
+            info->totalFrames = ogg_chainframes(stream, 1);
+        else
+            info->totalFrames = granule > preskip ? granule - preskip : -1;
+        return 1;
+    }
+    return 0;
 }
 
-static int drmp3_hdr_valid(unsigned char *h)
+int detect_header(ld_stream_t stream, ld_options_t options, ld_header_t *header, const char **error)
 {
-    #define DRMP3_HDR_GET_LAYER(h)            (((h[1]) >> 1) & 3)
-    #define DRMP3_HDR_GET_BITRATE(h)          ((h[2]) >> 4)
-    #define DRMP3_HDR_GET_SAMPLE_RATE(h)      (((h[2]) >> 2) & 3)
-    return h[0] == 0xff &&
-        ((h[1] & 0xF0) == 0xf0 || (h[1] & 0xFE) == 0xe2) &&
-        (DRMP3_HDR_GET_LAYER(h) != 0) &&
-        (DRMP3_HDR_GET_BITRATE(h) != 15) &&
-        (DRMP3_HDR_GET_SAMPLE_RATE(h) != 3);
-    
-    #undef DRMP3_HDR_GET_LAYER
-    #undef DRMP3_HDR_GET_BITRATE
-    #undef DRMP3_HDR_GET_SAMPLE_RATE
+	unsigned char peek[LD_PEEK_SIZE];
+	memset(header, 0, sizeof(ld_header_t));
+	header->mp3Start = header->mp3Length = -1;
+	int32_t peekSize = codec_peek(stream, peek);
+	const codec_entry_t *entry = codec_find(peek, peekSize);
+	if(!entry) {
+		*error = "Unable to detect file type";
+		LOG_O_ERROR(options, "Unable to detect file type");
+		return -1;
+	}
+	header->codec = entry;
+	if(!entry->readheader) {
+		header->kind = LD_HEADER_CODEC;
+		return 1;
+	}
+	return entry->readheader(stream, options, peek, peekSize, header, error);
+}
+
+//hinted headers leave the stream at the data already
+static void open_seek(ld_stream_t stream, const ld_header_t *header, int32_t offset)
+{
+	if(!header->hinted) stream->seek(stream, offset, LDSEEK_SET);
+}
+
+ld_pcmstream_t open_header(ld_stream_t stream, ld_options_t options, const ld_header_t *header, const char **error)
+{
+	//ld_pcmstream_open_cached may hold headers from before ld_codec_set_enabled
+	if(header->codec && !header->codec->enabled) {
+		*error = "Codec is disabled";
+		LOG_O_ERROR_F(options, "Codec %s is disabled", header->codec->codec.name);
+		return NULL;
+	}
+	switch(header->kind) {
+		case LD_HEADER_RIFF_PCM:
+			open_seek(stream, header, header->dataOffset);
+			return riff_getstream(stream, options, error, &header->riff);
+		case LD_HEADER_RIFF_MP3:
+			open_seek(stream, header, header->dataOffset);
+			return mp3_getstream(stream, options, error, header);
+		case LD_HEADER_MP3:
+			open_seek(stream, header, 0);
+			return mp3_getstream(stream, options, error, header);
+		case LD_HEADER_VORBIS:
+			open_seek(stream, header, 0);
+			return vorbis_getstream(stream, options, error);
+		case LD_HEADER_OGG_FLAC:
+		case LD_HEADER_FLAC:
+			open_seek(stream, header, 0);
+			return flac_getstream(stream, options, error, header->kind == LD_HEADER_OGG_FLAC);
+		case LD_HEADER_OPUS:
+			open_seek(stream, header, 0);
+			return opus_getstream(stream, options, error);
+		case LD_HEADER_CODEC: {
+			open_seek(stream, header, 0);
+			const ld_codec_t *codec = &header->codec->codec;
+			ld_pcmstream_t retsound = codec->open(stream, options, error, codec->userdata);
+			if(retsound && !retsound->_internal->properties.slots[LD_PROPERTY_ID_CODEC].isSet)
+				set_property_string(retsound, LD_PROPERTY_ID_CODEC, codec->name);
+			return retsound;
+		}
+		default:
+			*error = "Unable to detect file type";
+			LOG_O_ERROR(options, "Unable to detect file type");
+			return NULL;
+	}
+}
+
+ld_stream_t open_peek(ld_stream_t stream, ld_options_t options, const char **error)
+{
+	ld_stream_t peek = peekstream_source(stream, options);
+	if(!peek) {
+		LOG_O_ERROR(options, "Out of memory");
+		*error = "Out of memory";
+		stream->close(stream);
+	}
+	return peek;
+}
+
+ld_pcmstream_t open_header_traced(ld_stream_t source, ld_options_t options, const ld_header_t *header, const char **error)
+{
+	if(!trace_enabled(options)) return open_header(source, options, header, error);
+	const char *codec = trace_codec(header);
+	trace_source_codec(source, options, codec);
+	ld_pcmstream_t retsound = open_header(source, options, header, error);
+	if(retsound) trace_pcmstream(retsound, codec);
+	return retsound;
+}
+
+//detection and decoder setup on the stream returned by trace_source
+static ld_pcmstream_t open_detect(ld_stream_t stream, ld_stream_t peek, ld_stream_t source, ld_options_t options,
+	ld_span_t *openSpan, const char **error)
+{
+	ld_span_t detectSpan;
+	trace_begin(options, &detectSpan, LDSPAN_DETECT, NULL);
+	ld_header_t header;
+	int result = detect_header(source, options, &header, error);
+	detectSpan.result = result > 0;
+	trace_end(options, &detectSpan);
+	if(result <= 0) {
+		if(!result) source->close(source);
+		else {
+			trace_source_release(source, peek);
+			peekstream_release(peek, stream);
+		}
+		trace_end(options, openSpan);
+		return NULL;
+	}
+	ld_pcmstream_t retsound = open_header_traced(source, options, &header, error);
+	peekstream_opened(peek, stream, retsound);
+	if(!retsound) source->close(source);
+	openSpan->codec = trace_codec(&header);
+	openSpan->result = retsound != NULL;
+	trace_end(options, openSpan);
+	return retsound;
 }
 
 LDEXPORT ld_pcmstream_t ld_pcmstream_open(ld_stream_t stream, ld_options_t options, const char **error)
@@ -84,29 +263,76 @@ LDEXPORT ld_pcmstream_t ld_pcmstream_open(ld_stream_t stream, ld_options_t optio
     const char *errorStack = NULL;
     const char **errorOut = error ? error : &errorStack;
 
-	unsigned char magic[4];
-	/* Read in magic */
-	stream->read(magic,4,stream);
-	stream->seek(stream,0,LDSEEK_SET);
-	/* Detect file type */
-	//Riff
-	if(memcmp(magic, "RIFF", 4) == 0) {
-		return riff_getstream(stream, options, errorOut);
-	}
-	//Ogg
-	if(memcmp(magic, "OggS", 4) == 0) {
-		return ogg_getstream(stream, options, errorOut);
+	ld_init();
+	ld_span_t openSpan;
+	trace_begin(options, &openSpan, LDSPAN_OPEN, NULL);
+	ld_stream_t peek = open_peek(stream, options, errorOut);
+	if(!peek) {
+		trace_end(options, &openSpan);
+		return NULL;
 	}
-	//Flac
-	if(memcmp(magic, "fLaC", 4) == 0) {
-		return flac_getstream(stream, options, errorOut, 0);
+	ld_stream_t source = trace_source(peek, options);
+	return open_detect(stream, peek, source, options, &openSpan, errorOut);
+}
+
+LDEXPORT ld_pcmstream_t ld_pcmstream_open_hinted(ld_stream_t stream, const char *hint, ld_options_t options, const char **error)
+{
+	if(!hint) return ld_pcmstream_open(stream, options, error);
+	const char *errorStack = NULL;
+	const char **errorOut = error ? error : &errorStack;
+	const char *errorIn = *errorOut;
+
+	ld_init();
+	ld_span_t openSpan, detectSpan;
+	trace_begin(options, &openSpan, LDSPAN_OPEN, NULL);
+	ld_stream_t peek = open_peek(stream, options, errorOut);
+	if(!peek) {
+		trace_end(options, &openSpan);
+		return NULL;
 	}
-	//Mp3
-	if(memcmp(magic,"ID3", 3) == 0 || drmp3_hdr_valid(magic)) {
-		return mp3_getstream(stream, options, errorOut, -1,-1,-1,-1);
+	ld_stream_t source = trace_source(peek, options);
+	trace_begin(options, &detectSpan, LDSPAN_DETECT, NULL);
+	ld_header_t header;
+	int result = codec_hint(source, options, hint, &header, errorOut);
+	detectSpan.result = result > 0;
+	trace_end(options, &detectSpan);
+	//a failed decoder leaves the stream open for detection
+	ld_pcmstream_t retsound = result > 0 ? open_header_traced(source, options, &header, errorOut) : NULL;
+	if(retsound) {
+		peekstream_opened(peek, stream, retsound);
+		openSpan.codec = trace_codec(&header);
+		openSpan.result = 1;
+		trace_end(options, &openSpan);
+		return retsound;
 	}
+	if(result >= 0) LOG_O_INFO_F(options, "Opening as %s failed, detecting the format", hint);
+	*errorOut = errorIn;
+	source->seek(source, 0, LDSEEK_SET);
+	return open_detect(stream, peek, source, options, &openSpan, errorOut);
+}
 
-    *errorOut = "Unable to detect file type";
-	LOG_O_ERROR(options, "Unable to detect file type");
-	return NULL;
+LDEXPORT int ld_probe(ld_stream_t stream, ld_probe_info_t *info)
+{
+	ld_init();
+	memset(info, 0, sizeof(ld_probe_info_t));
+	info->totalFrames = -1;
+	info->flTrim = info->flSamples = -1;
+	info->mp3Trim = info->mp3Samples = -1;
+
+	ld_stream_t source = peekstream_source(stream, NULL);
+	if(!source) return 0;
+	unsigned char peek[LD_PEEK_SIZE];
+	int32_t peekSize = codec_peek(source, peek);
+	const codec_entry_t *entry = peekSize >= 4 ? codec_find(peek, peekSize) : NULL;
+	int result = 0;
+	if(entry && entry->probeinfo) {
+		result = entry->probeinfo(source, peek, peekSize, info);
+	} else if(entry) {
+		//registered codecs only report their name
+		info->codec = entry->codec.name;
+		result = 1;
+	}
+	if(source == stream) stream->seek(stream,0,LDSEEK_SET);
+	peekstream_release(source, stream);
+	return result;
 }
@@ -0,0 +1,320 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "lancerdecode.h"
+#include "formats.h"
+#include "logging.h"
+#include "stream.h"
+#include "threads.h"
+#include "ogg.h"
+#include <string.h>
+#include <ctype.h>
+
+#define CODEC_MAX 32
+
+static int riff_detect(ld_stream_t stream, ld_options_t options, const unsigned char *peek, int32_t peekSize,
+	ld_header_t *header, const char **error)
+{
+	if(!riff_readheader(stream, &header->riff, error)) {
+		LOG_O_ERROR_F(options, "%s", *error);
+		return 0;
+	}
+	header->dataOffset = stream->tell(stream);
+	switch(header->riff.audioFormat) {
+		case WAVE_FORMAT_PCM:
+			header->kind = LD_HEADER_RIFF_PCM;
+			header->codec = codec_named("pcm");
+			return 1;
+		case WAVE_FORMAT_MP3: {
+			ld_allocator_t alloc = options_allocator(options);
+			ld_stream_t data = stream_wrap(stream, header->riff.dataSize, 0, &alloc);
+			mp3_readheader(data, &header->mp3Start, &header->mp3Length);
+			data->close(data);
+			header->kind = LD_HEADER_RIFF_MP3;
+			//pcm wins the probe when the fmt chunk is past the peek buffer
+			header->codec = codec_named("mp3");
+			return 1;
+		}
+		default:
+			LOG_O_ERROR_F(options, "Unsupported format in WAVE file: '%x'", header->riff.audioFormat);
+			*error = "Unsupported format in WAVE file";
+			return 0;
+	}
+}
+
+static int mp3_detect(ld_stream_t stream, ld_options_t options, const unsigned char *peek, int32_t peekSize,
+	ld_header_t *header, const char **error)
+{
+	if(riff_peekformat(peek, peekSize) >= 0) {
+		return riff_detect(stream, options, peek, peekSize, header, error);
+	}
+	mp3_readheader(stream, &header->mp3Start, &header->mp3Length);
+	header->kind = LD_HEADER_MP3;
+	return 1;
+}
+
+static int vorbis_detect(ld_stream_t stream, ld_options_t options, const unsigned char *peek, int32_t peekSize,
+	ld_header_t *header, const char **error)
+{
+	size_t length;
+	const unsigned char *packet = ogg_first_packet(peek, peekSize, &length);
+	if(!packet) {
+		LOG_O_ERROR(options, "Malformed ogg file: unexpected EOF");
+		*error = "Malformed ogg file: unexpected EOF";
+		return 0;
+	}
+	if(length < 7 || memcmp(packet, "\x01vorbis", 7)) {
+		LOG_O_ERROR(options, "ogg: unexpected codec or stream found");
+		*error = "ogg: unexpected codec or stream found";
+		return 0;
+	}
+	header->kind = LD_HEADER_VORBIS;
+	return 1;
+}
+
+static int flac_detect(ld_stream_t stream, ld_options_t options, const unsigned char *peek, int32_t peekSize,
+	ld_header_t *header, const char **error)
+{
+	header->kind = memcmp(peek, "OggS", 4) ? LD_HEADER_FLAC : LD_HEADER_OGG_FLAC;
+	return 1;
+}
+
+static int opus_detect(ld_stream_t stream, ld_options_t options, const unsigned char *peek, int32_t peekSize,
+	ld_header_t *header, const char **error)
+{
+	header->kind = LD_HEADER_OPUS;
+	return 1;
+}
+
+//reads the first size bytes of a hinted stream and seeks back to the start
+static int32_t hint_peek(ld_stream_t stream, unsigned char *peek, int32_t size)
+{
+	int32_t peekSize = (int32_t)stream->read(peek, size, stream);
+	stream->seek(stream, 0, LDSEEK_SET);
+	return peekSize;
+}
+
+static int riff_hint(ld_stream_t stream, ld_options_t options, ld_header_t *header, const char **error)
+{
+	if(!riff_detect(stream, options, NULL, 0, header, error)) return 0;
+	//reading the MP3 headers moved past the data
+	if(header->kind == LD_HEADER_RIFF_MP3) stream->seek(stream, header->dataOffset, LDSEEK_SET);
+	return 1;
+}
+
+static int mp3_hint(ld_stream_t stream, ld_options_t options, ld_header_t *header, const char **error)
+{
+	//Freelancer stores most of its MP3s in RIFF files
+	unsigned char magic[4];
+	int32_t magicSize = (int32_t)stream->read(magic, 4, stream);
+	if(magicSize == 4 && !memcmp(magic, "RIFF", 4)) {
+		stream->seek(stream, 0, LDSEEK_SET);
+		return riff_hint(stream, options, header, error);
+	}
+	if(magicSize == 4) mp3_readheader_from(stream, magic, &header->mp3Start, &header->mp3Length);
+	stream->seek(stream, 0, LDSEEK_SET);
+	header->kind = LD_HEADER_MP3;
+	return 1;
+}
+
+static int vorbis_hint(ld_stream_t stream, ld_options_t options, ld_header_t *header, const char **error)
+{
+	//".ogg" files hold any of the Ogg codecs, the first packet tells them apart.
+	//a page header, its segment table and the Ogg FLAC header are enough
+	unsigned char peek[OGG_PAGE_HEADER_SIZE + 255 + 51];
+	size_t length;
+	const unsigned char *packet = ogg_first_packet(peek, hint_peek(stream, peek, sizeof(peek)), &length);
+	if(!packet) {
+		LOG_O_ERROR(options, "Malformed ogg file: unexpected EOF");
+		*error = "Malformed ogg file: unexpected EOF";
+		return 0;
+	}
+	const char *codec = "vorbis";
+	header->kind = LD_HEADER_VORBIS;
+	if(length >= 8 && !memcmp(packet, "OpusHead", 8)) {
+		codec = "opus";
+		header->kind = LD_HEADER_OPUS;
+	} else if(length >= 5 && !memcmp(packet, "\x7F""FLAC", 5)) {
+		codec = "flac";
+		header->kind = LD_HEADER_OGG_FLAC;
+	} else if(length < 7 || memcmp(packet, "\x01vorbis", 7)) {
+		LOG_O_ERROR(options, "ogg: unexpected codec or stream found");
+		*error = "ogg: unexpected codec or stream found";
+		return 0;
+	}
+	header->codec = codec_named(codec);
+	return header->codec->enabled ? 1 : -1;
+}
+
+static int flac_hint(ld_stream_t stream, ld_options_t options, ld_header_t *header, const char **error)
+{
+	unsigned char magic[4];
+	int32_t magicSize = hint_peek(stream, magic, 4);
+	header->kind = magicSize == 4 && !memcmp(magic, "OggS", 4) ? LD_HEADER_OGG_FLAC : LD_HEADER_FLAC;
+	return 1;
+}
+
+static int opus_hint(ld_stream_t stream, ld_options_t options, ld_header_t *header, const char **error)
+{
+	header->kind = LD_HEADER_OPUS;
+	return 1;
+}
+
+static int riff_probeinfo(ld_stream_t stream, const unsigned char *peek, int32_t peekSize, ld_probe_info_t *info)
+{
+	return riff_probe(stream, info);
+}
+
+static int mp3_probeinfo(ld_stream_t stream, const unsigned char *peek, int32_t peekSize, ld_probe_info_t *info)
+{
+	return riff_peekformat(peek, peekSize) >= 0 ? riff_probe(stream, info) : mp3_probe(stream, info);
+}
+
+static int ogg_probeinfo(ld_stream_t stream, const unsigned char *peek, int32_t peekSize, ld_probe_info_t *info)
+{
+	return ogg_probe(stream, info);
+}
+
+static int flac_probeinfo(ld_stream_t stream, const unsigned char *peek, int32_t peekSize, ld_probe_info_t *info)
+{
+	return memcmp(peek, "OggS", 4) ? flac_probe(stream, info) : ogg_probe(stream, info);
+}
+
+//built-in codecs first, then those from ld_codec_register. entries are never
+//removed, so pointers to them stay valid without holding the lock
+static codec_entry_t codecs[CODEC_MAX] = {
+	{ { "pcm", LDCODEC_SEEKABLE | LDCODEC_PARALLEL, &riff_pcm_score, NULL, NULL },
+		&riff_detect, &riff_probeinfo, &riff_hint, 1 },
+	{ { "mp3", LDCODEC_SEEKABLE | LDCODEC_FLOAT | LDCODEC_PARALLEL, &mp3_score, NULL, NULL },
+		&mp3_detect, &mp3_probeinfo, &mp3_hint, 1 },
+	{ { "vorbis", LDCODEC_SEEKABLE | LDCODEC_FLOAT | LDCODEC_PARALLEL, &vorbis_score, NULL, NULL },
+		&vorbis_detect, &ogg_probeinfo, &vorbis_hint, 1 },
+	{ { "flac", LDCODEC_SEEKABLE | LDCODEC_HIRES | LDCODEC_PARALLEL, &flac_score, NULL, NULL },
+		&flac_detect, &flac_probeinfo, &flac_hint, 1 },
+	{ { "opus", LDCODEC_SEEKABLE | LDCODEC_FLOAT | LDCODEC_PARALLEL, &opus_score, NULL, NULL },
+		&opus_detect, &ogg_probeinfo, &opus_hint, 1 },
+};
+//file extensions that differ from the codec name
+static const struct {
+	const char *extension;
+	const char *codec;
+} hintExtensions[] = {
+	{ "wav", "pcm" },
+	{ "wave", "pcm" },
+	{ "ogg", "vorbis" },
+	{ "oga", "vorbis" },
+};
+static int32_t codecCount = 5;
+static ld_mutex_t codecLock = LD_MUTEX_INIT;
+
+//call with codecLock held
+static codec_entry_t *find_named(const char *name)
+{
+	for(int32_t i = 0; i < codecCount; i++) {
+		if(!strcmp(codecs[i].codec.name, name)) return &codecs[i];
+	}
+	return NULL;
+}
+
+const codec_entry_t *codec_find(const unsigned char *peek, int32_t peekSize)
+{
+	const codec_entry_t *best = NULL;
+	int32_t bestScore = 0;
+	mutex_lock(&codecLock);
+	for(int32_t i = 0; i < codecCount; i++) {
+		if(!codecs[i].enabled) continue;
+		int32_t score = codecs[i].codec.probe(peek, peekSize, codecs[i].codec.userdata);
+		if(score > bestScore) {
+			best = &codecs[i];
+			bestScore = score;
+		}
+	}
+	mutex_unlock(&codecLock);
+	return best;
+}
+
+const codec_entry_t *codec_named(const char *name)
+{
+	mutex_lock(&codecLock);
+	const codec_entry_t *entry = find_named(name);
+	mutex_unlock(&codecLock);
+	return entry;
+}
+
+int32_t codec_peek(ld_stream_t stream, unsigned char *peek)
+{
+	int32_t peekSize = (int32_t)stream->read(peek, LD_PEEK_SIZE, stream);
+	stream->seek(stream, 0, LDSEEK_SET);
+	//probes may look at the first bytes without checking the size
+	if(peekSize < 4) memset(peek + peekSize, 0, 4 - peekSize);
+	return peekSize;
+}
+
+int codec_hint(ld_stream_t stream, ld_options_t options, const char *hint, ld_header_t *header, const char **error)
+{
+	char name[16];
+	size_t length = 0;
+	if(*hint == '.') hint++;
+	for(; hint[length]; length++) {
+		if(length + 1 >= sizeof(name)) return -1;
+		name[length] = (char)tolower((unsigned char)hint[length]);
+	}
+	name[length] = '\0';
+	const char *codec = name;
+	for(size_t i = 0; i < sizeof(hintExtensions) / sizeof(hintExtensions[0]); i++) {
+		if(!strcmp(hintExtensions[i].extension, name)) codec = hintExtensions[i].codec;
+	}
+	const codec_entry_t *entry = codec_named(codec);
+	if(!entry || !entry->enabled) return -1;
+	memset(header, 0, sizeof(ld_header_t));
+	header->mp3Start = header->mp3Length = -1;
+	header->codec = entry;
+	header->hinted = 1;
+	if(!entry->readhint) {
+		header->kind = LD_HEADER_CODEC;
+		return 1;
+	}
+	return entry->readhint(stream, options, header, error);
+}
+
+LDEXPORT int ld_codec_register(const ld_codec_t *codec)
+{
+	if(!codec || !codec->name || !codec->probe || !codec->open) {
+		return 0;
+	}
+	int result = 0;
+	mutex_lock(&codecLock);
+	if(codecCount < CODEC_MAX && !find_named(codec->name)) {
+		codec_entry_t *entry = &codecs[codecCount];
+		memset(entry, 0, sizeof(codec_entry_t));
+		entry->codec = *codec;
+		entry->enabled = 1;
+		codecCount++;
+		result = 1;
+	}
+	mutex_unlock(&codecLock);
+	return result;
+}
+
+LDEXPORT int ld_codec_set_enabled(const char *name, int enabled)
+{
+	mutex_lock(&codecLock);
+	codec_entry_t *entry = find_named(name);
+	if(entry) entry->enabled = enabled != 0;
+	mutex_unlock(&codecLock);
+	return entry != NULL;
+}
+
+LDEXPORT int ld_codec_get(int32_t index, ld_codec_t *codec, int *enabled)
+{
+	int result = 0;
+	mutex_lock(&codecLock);
+	if(index >= 0 && index < codecCount) {
+		if(codec) *codec = codecs[index].codec;
+		if(enabled) *enabled = codecs[index].enabled;
+		result = 1;
+	}
+	mutex_unlock(&codecLock);
+	return result;
+}
@@ -0,0 +1,336 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "convert.h"
+#include "cpu.h"
+#include <math.h>
+
+#if defined(CPU_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#elif defined(CPU_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Scalar */
+
+static inline int16_t sample_f32_to_s16(float x)
+{
+    float f = x * 32768.0f;
+    if(f >= 32767.0f) return 32767;
+    if(f <= -32768.0f) return -32768;
+    return (int16_t)lrintf(f);
+}
+
+static void f32_to_s16_scalar(const float *src, int16_t *dst, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+        dst[i] = sample_f32_to_s16(src[i]);
+}
+
+static void s32_to_s16_scalar(const int32_t *src, int16_t *dst, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+        dst[i] = (int16_t)(src[i] >> 16);
+}
+
+static void interleave_f32_to_s16_scalar(float * const *src, size_t offset, int channels, size_t frames, int16_t *dst)
+{
+    for(size_t i = 0; i < frames; i++)
+        for(int c = 0; c < channels; c++)
+            *dst++ = sample_f32_to_s16(src[c][offset + i]);
+}
+
+static void interleave_f32_scalar(float * const *src, size_t offset, int channels, size_t frames, float *dst)
+{
+    for(size_t i = 0; i < frames; i++)
+        for(int c = 0; c < channels; c++)
+            *dst++ = src[c][offset + i];
+}
+
+static const convert_kernels_t kernels_scalar = {
+    "scalar",
+    f32_to_s16_scalar,
+    s32_to_s16_scalar,
+    interleave_f32_to_s16_scalar,
+    interleave_f32_scalar
+};
+
+#ifdef CPU_X86
+
+/* SSE2 */
+
+TARGET_SSE2 static inline __m128i f32x4_to_s32_sse2(__m128 x)
+{
+    x = _mm_mul_ps(x, _mm_set1_ps(32768.0f));
+    x = _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(32767.0f)), _mm_set1_ps(-32768.0f));
+    return _mm_cvtps_epi32(x);
+}
+
+TARGET_SSE2 static void f32_to_s16_sse2(const float *src, int16_t *dst, size_t count)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m128i a = f32x4_to_s32_sse2(_mm_loadu_ps(src + i));
+        __m128i b = f32x4_to_s32_sse2(_mm_loadu_ps(src + i + 4));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(a, b));
+    }
+    f32_to_s16_scalar(src + i, dst + i, count - i);
+}
+
+TARGET_SSE2 static void s32_to_s16_sse2(const int32_t *src, int16_t *dst, size_t count)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(src + i)), 16);
+        __m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(src + i + 4)), 16);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(a, b));
+    }
+    s32_to_s16_scalar(src + i, dst + i, count - i);
+}
+
+TARGET_SSE2 static void interleave_f32_to_s16_sse2(float * const *src, size_t offset, int channels, size_t frames, int16_t *dst)
+{
+    if(channels == 1) {
+        f32_to_s16_sse2(src[0] + offset, dst, frames);
+        return;
+    }
+    if(channels != 2) {
+        interleave_f32_to_s16_scalar(src, offset, channels, frames, dst);
+        return;
+    }
+    const float *left = src[0] + offset;
+    const float *right = src[1] + offset;
+    size_t i = 0;
+    for(; i + 4 <= frames; i += 4) {
+        __m128i l = f32x4_to_s32_sse2(_mm_loadu_ps(left + i));
+        __m128i r = f32x4_to_s32_sse2(_mm_loadu_ps(right + i));
+        __m128i out = _mm_packs_epi32(_mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r));
+        _mm_storeu_si128((__m128i*)(dst + i * 2), out);
+    }
+    interleave_f32_to_s16_scalar(src, offset + i, 2, frames - i, dst + i * 2);
+}
+
+TARGET_SSE2 static void interleave_f32_sse2(float * const *src, size_t offset, int channels, size_t frames, float *dst)
+{
+    if(channels != 2) {
+        interleave_f32_scalar(src, offset, channels, frames, dst);
+        return;
+    }
+    const float *left = src[0] + offset;
+    const float *right = src[1] + offset;
+    size_t i = 0;
+    for(; i + 4 <= frames; i += 4) {
+        __m128 l = _mm_loadu_ps(left + i);
+        __m128 r = _mm_loadu_ps(right + i);
+        _mm_storeu_ps(dst + i * 2, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(dst + i * 2 + 4, _mm_unpackhi_ps(l, r));
+    }
+    interleave_f32_scalar(src, offset + i, 2, frames - i, dst + i * 2);
+}
+
+static const convert_kernels_t kernels_sse2 = {
+    "sse2",
+    f32_to_s16_sse2,
+    s32_to_s16_sse2,
+    interleave_f32_to_s16_sse2,
+    interleave_f32_sse2
+};
+
+/* AVX2 */
+
+TARGET_AVX2 static inline __m256i f32x8_to_s32_avx2(__m256 x)
+{
+    x = _mm256_mul_ps(x, _mm256_set1_ps(32768.0f));
+    x = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(32767.0f)), _mm256_set1_ps(-32768.0f));
+    return _mm256_cvtps_epi32(x);
+}
+
+TARGET_AVX2 static void f32_to_s16_avx2(const float *src, int16_t *dst, size_t count)
+{
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m256i a = f32x8_to_s32_avx2(_mm256_loadu_ps(src + i));
+        __m256i b = f32x8_to_s32_avx2(_mm256_loadu_ps(src + i + 8));
+        //packs works per 128-bit lane, put the quarters back in order
+        __m256i out = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(dst + i), out);
+    }
+    f32_to_s16_sse2(src + i, dst + i, count - i);
+}
+
+TARGET_AVX2 static void s32_to_s16_avx2(const int32_t *src, int16_t *dst, size_t count)
+{
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(src + i)), 16);
+        __m256i b = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(src + i + 8)), 16);
+        __m256i out = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(dst + i), out);
+    }
+    s32_to_s16_sse2(src + i, dst + i, count - i);
+}
+
+TARGET_AVX2 static void interleave_f32_to_s16_avx2(float * const *src, size_t offset, int channels, size_t frames, int16_t *dst)
+{
+    if(channels == 1) {
+        f32_to_s16_avx2(src[0] + offset, dst, frames);
+        return;
+    }
+    if(channels != 2) {
+        interleave_f32_to_s16_scalar(src, offset, channels, frames, dst);
+        return;
+    }
+    const float *left = src[0] + offset;
+    const float *right = src[1] + offset;
+    size_t i = 0;
+    for(; i + 8 <= frames; i += 8) {
+        __m256i l = f32x8_to_s32_avx2(_mm256_loadu_ps(left + i));
+        __m256i r = f32x8_to_s32_avx2(_mm256_loadu_ps(right + i));
+        //unpack and packs are both per lane, so the lanes come out in order
+        __m256i out = _mm256_packs_epi32(_mm256_unpacklo_epi32(l, r), _mm256_unpackhi_epi32(l, r));
+        _mm256_storeu_si256((__m256i*)(dst + i * 2), out);
+    }
+    interleave_f32_to_s16_sse2(src, offset + i, 2, frames - i, dst + i * 2);
+}
+
+TARGET_AVX2 static void interleave_f32_avx2(float * const *src, size_t offset, int channels, size_t frames, float *dst)
+{
+    if(channels != 2) {
+        interleave_f32_scalar(src, offset, channels, frames, dst);
+        return;
+    }
+    const float *left = src[0] + offset;
+    const float *right = src[1] + offset;
+    size_t i = 0;
+    for(; i + 8 <= frames; i += 8) {
+        __m256 l = _mm256_loadu_ps(left + i);
+        __m256 r = _mm256_loadu_ps(right + i);
+        __m256 lo = _mm256_unpacklo_ps(l, r);
+        __m256 hi = _mm256_unpackhi_ps(l, r);
+        _mm256_storeu_ps(dst + i * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(dst + i * 2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    interleave_f32_sse2(src, offset + i, 2, frames - i, dst + i * 2);
+}
+
+static const convert_kernels_t kernels_avx2 = {
+    "avx2",
+    f32_to_s16_avx2,
+    s32_to_s16_avx2,
+    interleave_f32_to_s16_avx2,
+    interleave_f32_avx2
+};
+
+static const convert_kernels_t *select_kernels(void)
+{
+    int features = cpu_features();
+    if(features & CPU_FEATURE_AVX2) return &kernels_avx2;
+    if(features & CPU_FEATURE_SSE2) return &kernels_sse2;
+    return &kernels_scalar;
+}
+
+#elif defined(CPU_NEON)
+
+/* NEON */
+
+static inline int32x4_t f32x4_to_s32_neon(float32x4_t x)
+{
+    //vcvtn rounds to nearest even and saturates, vqmovn saturates again to s16
+    return vcvtnq_s32_f32(vmulq_n_f32(x, 32768.0f));
+}
+
+static void f32_to_s16_neon(const float *src, int16_t *dst, size_t count)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        int16x4_t a = vqmovn_s32(f32x4_to_s32_neon(vld1q_f32(src + i)));
+        int16x4_t b = vqmovn_s32(f32x4_to_s32_neon(vld1q_f32(src + i + 4)));
+        vst1q_s16(dst + i, vcombine_s16(a, b));
+    }
+    f32_to_s16_scalar(src + i, dst + i, count - i);
+}
+
+static void s32_to_s16_neon(const int32_t *src, int16_t *dst, size_t count)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        int16x4_t a = vshrn_n_s32(vld1q_s32(src + i), 16);
+        int16x4_t b = vshrn_n_s32(vld1q_s32(src + i + 4), 16);
+        vst1q_s16(dst + i, vcombine_s16(a, b));
+    }
+    s32_to_s16_scalar(src + i, dst + i, count - i);
+}
+
+static void interleave_f32_to_s16_neon(float * const *src, size_t offset, int channels, size_t frames, int16_t *dst)
+{
+    if(channels == 1) {
+        f32_to_s16_neon(src[0] + offset, dst, frames);
+        return;
+    }
+    if(channels != 2) {
+        interleave_f32_to_s16_scalar(src, offset, channels, frames, dst);
+        return;
+    }
+    const float *left = src[0] + offset;
+    const float *right = src[1] + offset;
+    size_t i = 0;
+    for(; i + 8 <= frames; i += 8) {
+        int16x8x2_t out;
+        out.val[0] = vcombine_s16(vqmovn_s32(f32x4_to_s32_neon(vld1q_f32(left + i))),
+            vqmovn_s32(f32x4_to_s32_neon(vld1q_f32(left + i + 4))));
+        out.val[1] = vcombine_s16(vqmovn_s32(f32x4_to_s32_neon(vld1q_f32(right + i))),
+            vqmovn_s32(f32x4_to_s32_neon(vld1q_f32(right + i + 4))));
+        vst2q_s16(dst + i * 2, out);
+    }
+    interleave_f32_to_s16_scalar(src, offset + i, 2, frames - i, dst + i * 2);
+}
+
+static void interleave_f32_neon(float * const *src, size_t offset, int channels, size_t frames, float *dst)
+{
+    if(channels != 2) {
+        interleave_f32_scalar(src, offset, channels, frames, dst);
+        return;
+    }
+    size_t i = 0;
+    for(; i + 4 <= frames; i += 4) {
+        float32x4x2_t out;
+        out.val[0] = vld1q_f32(src[0] + offset + i);
+        out.val[1] = vld1q_f32(src[1] + offset + i);
+        vst2q_f32(dst + i * 2, out);
+    }
+    interleave_f32_scalar(src, offset + i, 2, frames - i, dst + i * 2);
+}
+
+static const convert_kernels_t kernels_neon = {
+    "neon",
+    f32_to_s16_neon,
+    s32_to_s16_neon,
+    interleave_f32_to_s16_neon,
+    interleave_f32_neon
+};
+
+static const convert_kernels_t *select_kernels(void)
+{
+    return (cpu_features() & CPU_FEATURE_NEON) ? &kernels_neon : &kernels_scalar;
+}
+
+#else
+
+static const convert_kernels_t *select_kernels(void)
+{
+    return &kernels_scalar;
+}
+
+#endif
+
+const convert_kernels_t *convert_kernels = NULL;
+
+const convert_kernels_t *convert_init(void)
+{
+    //every caller selects the same table, so racing here is harmless
+    const convert_kernels_t *selected = select_kernels();
+    convert_kernels = selected;
+    return selected;
+}
@@ -0,0 +1,39 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//CONVERT
+//sample format conversion kernels shared by the decoders
+//the SSE2/AVX2/NEON implementation is picked once at runtime from the CPU features
+#ifndef _CONVERT_H_
+#define _CONVERT_H_
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const char *name;
+    //float [-1, 1] -> s16, rounded to nearest and saturated
+    void (*f32_to_s16)(const float *src, int16_t *dst, size_t count);
+    //left-justified s32 -> s16, keeps the top 16 bits
+    void (*s32_to_s16)(const int32_t *src, int16_t *dst, size_t count);
+    //planar float -> interleaved s16
+    void (*interleave_f32_to_s16)(float * const *src, size_t offset, int channels, size_t frames, int16_t *dst);
+    //planar float -> interleaved float
+    void (*interleave_f32)(float * const *src, size_t offset, int channels, size_t frames, float *dst);
+} convert_kernels_t;
+
+extern const convert_kernels_t *convert_kernels;
+//Selects the kernels for this CPU, safe to call more than once
+const convert_kernels_t *convert_init(void);
+
+static inline const convert_kernels_t *convert_get(void)
+{
+    return convert_kernels ? convert_kernels : convert_init();
+}
+
+#define convert_f32_to_s16(src, dst, count) (convert_get()->f32_to_s16((src), (dst), (count)))
+#define convert_s32_to_s16(src, dst, count) (convert_get()->s32_to_s16((src), (dst), (count)))
+#define convert_interleave_f32_to_s16(src, offset, channels, frames, dst) (convert_get()->interleave_f32_to_s16((src), (offset), (channels), (frames), (dst)))
+#define convert_interleave_f32(src, offset, channels, frames, dst) (convert_get()->interleave_f32((src), (offset), (channels), (frames), (dst)))
+
+#endif
@@ -0,0 +1,73 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "cpu.h"
+#include <stdint.h>
+
+#ifdef CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void cpu_id(int info[4], int leaf)
+{
+#ifdef _MSC_VER
+    __cpuidex(info, leaf, 0);
+#else
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+    __cpuid_count(leaf, 0, a, b, c, d);
+    info[0] = (int)a; info[1] = (int)b; info[2] = (int)c; info[3] = (int)d;
+#endif
+}
+
+static uint64_t cpu_xgetbv(void)
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+int cpu_features(void)
+{
+    int info[4];
+    int features = 0;
+    cpu_id(info, 0);
+    int maxLeaf = info[0];
+    if(maxLeaf < 1) return 0;
+    cpu_id(info, 1);
+    if(info[3] & (1 << 26)) features |= CPU_FEATURE_SSE2;
+    if(info[2] & (1 << 19)) features |= CPU_FEATURE_SSE41;
+    //AVX2 also needs the OS to save the ymm registers
+    int osxsave = (info[2] & (1 << 27)) != 0;
+    int avx = (info[2] & (1 << 28)) != 0;
+    if(maxLeaf >= 7 && osxsave && avx && (cpu_xgetbv() & 0x6) == 0x6) {
+        cpu_id(info, 7);
+        if(info[1] & (1 << 5)) features |= CPU_FEATURE_AVX2;
+    }
+    return features;
+}
+
+#elif defined(CPU_NEON)
+
+int cpu_features(void)
+{
+    //NEON is mandatory on AArch64
+    return CPU_FEATURE_NEON;
+}
+
+#else
+
+int cpu_features(void)
+{
+    return 0;
+}
+
+#endif
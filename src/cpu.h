@@ -0,0 +1,33 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//CPU
+//runtime detection of the instruction sets used by the SIMD kernels
+#ifndef _CPU_H_
+#define _CPU_H_
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_X86
+#ifdef _MSC_VER
+#define TARGET_SSE2
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CPU_NEON
+#endif
+
+#define CPU_FEATURE_SSE2 0x1
+#define CPU_FEATURE_SSE41 0x2
+#define CPU_FEATURE_AVX2 0x4
+#define CPU_FEATURE_NEON 0x8
+
+//Returns a mask of CPU_FEATURE_* flags
+int cpu_features(void);
+
+#endif
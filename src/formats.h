@@ -7,10 +7,131 @@
 #include "lancerdecode.h"
 
 
-ld_pcmstream_t riff_getstream(ld_stream_t stream, ld_options_t options, const char **error);
-ld_pcmstream_t mp3_getstream(ld_stream_t stream, ld_options_t options, const char **error, int decodeChannels, int decodeRate, int trimFrames, int totalFrames);
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_MP3 0x55
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+#define WAVE_FORMAT_IEEE_FLOAT		0x0003 /* IEEE Float */
+#define WAVE_FORMAT_ALAW		0x0006 /* ALAW */
+#define WAVE_FORMAT_MULAW		0x0007 /* MULAW */
+#define WAVE_FORMAT_IMA_ADPCM		0x0011 /* IMA ADPCM */
+
+typedef struct {
+	uint16_t audioFormat;
+	uint16_t numChannels;
+	uint32_t sampleRate;
+	uint16_t bitsPerSample;
+	uint32_t dataSize;
+	int32_t trimFrames;
+	int32_t totalFrames;
+	int32_t loopStart; /* first loop of the smpl chunk, or -1 */
+	int32_t loopLength;
+} riff_info_t;
+
+typedef struct {
+	int channels;
+	int frequency;
+	int samples;
+	int size;
+} mp3_frameinfo_t;
+
+typedef enum {
+	LD_HEADER_NONE = 0,
+	LD_HEADER_RIFF_PCM,
+	LD_HEADER_RIFF_MP3,
+	LD_HEADER_MP3,
+	LD_HEADER_VORBIS,
+	LD_HEADER_OGG_FLAC,
+	LD_HEADER_FLAC,
+	LD_HEADER_OPUS,
+	LD_HEADER_CODEC /* a codec added with ld_codec_register */
+} ld_header_kind_t;
+
+struct codec_entry;
+
+/* Result of format detection and header parsing, enough to initialise
+ * a decoder without reading the headers again */
+typedef struct {
+	ld_header_kind_t kind;
+	const struct codec_entry *codec; /* registry entry of the decoder */
+	int32_t dataOffset; /* RIFF: start of the data chunk */
+	riff_info_t riff;
+	int mp3Start; /* LAME/Xing trim, or -1 */
+	int mp3Length; /* LAME/Xing sample count, or -1 */
+	int hinted; /* from codec_hint, the stream is already at the data */
+} ld_header_t;
+
+/* A codec in the registry. The built-in ones parse their headers into an ld_header_t,
+ * which ld_pcmstream_open_cached keeps, codecs from ld_codec_register only have codec.open */
+typedef struct codec_entry {
+	ld_codec_t codec;
+	/* Called on the codec that won the probe, stream is at the start of the file.
+	 * Returns 1 on success, 0 on a malformed file */
+	int (*readheader)(ld_stream_t stream, ld_options_t options, const unsigned char *peek, int32_t peekSize,
+		ld_header_t *header, const char **error);
+	/* ld_probe, stream is at the start of the file */
+	int (*probeinfo)(ld_stream_t stream, const unsigned char *peek, int32_t peekSize, ld_probe_info_t *info);
+	/* readheader without the peek buffer for ld_pcmstream_open_hinted, leaves stream at the data */
+	int (*readhint)(ld_stream_t stream, ld_options_t options, ld_header_t *header, const char **error);
+	int enabled;
+} codec_entry_t;
+
+/* The enabled codec with the highest score for peek, or NULL */
+const codec_entry_t *codec_find(const unsigned char *peek, int32_t peekSize);
+/* The registered codec called name, or NULL */
+const codec_entry_t *codec_named(const char *name);
+/* Reads the peek buffer at the start of stream and seeks back, returns its size */
+int32_t codec_peek(ld_stream_t stream, unsigned char *peek);
+/* Parses the headers of the enabled codec named by hint, a codec name or file extension.
+ * Returns 1 on success, 0 on a malformed file and -1 when nothing matches the hint */
+int codec_hint(ld_stream_t stream, ld_options_t options, const char *hint, ld_header_t *header, const char **error);
+
+/* Returns 1 on success, 0 on a malformed file and -1 on an unknown format */
+int detect_header(ld_stream_t stream, ld_options_t options, ld_header_t *header, const char **error);
+/* Seeks to the data described by header and initialises its decoder.
+ * The decoders (the *_getstream functions below) take stream on success,
+ * on failure it is left to the caller */
+ld_pcmstream_t open_header(ld_stream_t stream, ld_options_t options, const ld_header_t *header, const char **error);
+/* peekstream_source for the open functions, closes stream and sets error when out of memory */
+ld_stream_t open_peek(ld_stream_t stream, ld_options_t options, const char **error);
+/* open_header on a stream returned by trace_source, adding the decode spans when tracing */
+ld_pcmstream_t open_header_traced(ld_stream_t source, ld_options_t options, const ld_header_t *header, const char **error);
+
+ld_pcmstream_t riff_getstream(ld_stream_t stream, ld_options_t options, const char **error, const riff_info_t *info);
+ld_pcmstream_t mp3_getstream(ld_stream_t stream, ld_options_t options, const char **error, const ld_header_t *header);
 ld_pcmstream_t vorbis_getstream(ld_stream_t stream, ld_options_t options, const char **error);
 ld_pcmstream_t flac_getstream(ld_stream_t stream, ld_options_t options, const char **error, int isOgg);
 ld_pcmstream_t opus_getstream(ld_stream_t stream, ld_options_t options, const char **error);
 
+/* Header parsing shared by the decoders and ld_probe */
+int riff_readheader(ld_stream_t stream, riff_info_t *info, const char **error);
+void mp3_readheader(ld_stream_t stream, int *trimStart, int *totalLength);
+/* mp3_readheader when the first 4 bytes of stream were already read into first */
+void mp3_readheader_from(ld_stream_t stream, const unsigned char *first, int *trimStart, int *totalLength);
+int mp3_parseframe(const unsigned char *header, mp3_frameinfo_t *frame);
+void flac_readstreaminfo(const unsigned char *streaminfo, ld_probe_info_t *info);
+
+/* LD_PROPERTY_CHANNEL_ORDER of the Vorbis channel mapping, shared by Opus. NULL above 8 */
+const char *vorbis_channel_order(int channels);
+
+/* Builds the process-wide tables of each decoder, run once by ld_init */
+void flac_global_init(void);
+void mp3_global_init(void);
+
+/* Probe scores of the peek buffer, see ld_codec_t */
+int32_t riff_pcm_score(const unsigned char *peek, int32_t peekSize, void *userdata);
+int32_t mp3_score(const unsigned char *peek, int32_t peekSize, void *userdata);
+int32_t vorbis_score(const unsigned char *peek, int32_t peekSize, void *userdata);
+int32_t flac_score(const unsigned char *peek, int32_t peekSize, void *userdata);
+int32_t opus_score(const unsigned char *peek, int32_t peekSize, void *userdata);
+/* audioFormat of a RIFF WAVE peek buffer, 0 when the fmt chunk isn't in it, -1 if not RIFF WAVE */
+int riff_peekformat(const unsigned char *peek, int32_t peekSize);
+
+int riff_probe(ld_stream_t stream, ld_probe_info_t *info);
+int mp3_probe(ld_stream_t stream, ld_probe_info_t *info);
+int flac_probe(ld_stream_t stream, ld_probe_info_t *info);
+
+/* Sets LD_PROPERTY_LOOP_START and LD_PROPERTY_LOOP_LENGTH from the loop points of info */
+void riff_setloop(ld_pcmstream_t pcm, const riff_info_t *info);
+int ogg_probe(ld_stream_t stream, ld_probe_info_t *info);
+
 #endif 
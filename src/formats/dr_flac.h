@@ -331,6 +331,15 @@ typedef drflac_bool32 (* drflac_seek_proc)(void* pUserData, int offset, drflac_s
 // Use pMetadata->type to determine which metadata block is being handled and how to read the data.
 typedef void (* drflac_meta_proc)(void* pUserData, drflac_metadata* pMetadata);
 
+// Allocation callbacks for the decoder object and metadata blocks. Any NULL member falls back to DRFLAC_MALLOC()/DRFLAC_FREE().
+typedef struct
+{
+    void* pUserData;
+    void* (* onMalloc)(size_t sz, void* pUserData);
+    void* (* onRealloc)(void* p, size_t sz, void* pUserData);
+    void  (* onFree)(void* p, void* pUserData);
+} drflac_allocation_callbacks;
+
 
 // Structure for internal use. Only used for decoders opened with drflac_open_memory.
 typedef struct
@@ -457,6 +466,10 @@ typedef struct
     // The bits per sample. Will be set to something like 16, 24, etc.
     drflac_uint8 bitsPerSample;
 
+    // lancerdecode: drflac_read_s32 shifts samples up to this many bits. 32 (full scale) by default,
+    // 24 keeps sources up to 24 bits at their native scale. read_s16 and read_f32 expect 32
+    drflac_uint8 outputBitsPerSample;
+
     // The maximum block size, in samples. This number represents the number of samples in each channel (not combined).
     drflac_uint16 maxBlockSize;
 
@@ -483,6 +496,9 @@ typedef struct
     drflac_uint64 firstFramePos;
 
 
+    // The allocation callbacks the decoder was opened with. drflac_close() frees the object through these.
+    drflac_allocation_callbacks allocationCallbacks;
+
     // A hack to avoid a malloc() when opening a decoder with drflac_open_memory().
     drflac__memory_stream memoryStream;
 
@@ -527,6 +543,9 @@ typedef struct
 // See also: drflac_open_file(), drflac_open_memory(), drflac_open_with_metadata(), drflac_close()
 drflac* drflac_open(drflac_read_proc onRead, drflac_seek_proc onSeek, void* pUserData);
 
+// The same as drflac_open(), except the decoder is allocated with the given callbacks. pAllocationCallbacks may be NULL.
+drflac* drflac_open_with_allocation_callbacks(drflac_read_proc onRead, drflac_seek_proc onSeek, void* pUserData, const drflac_allocation_callbacks* pAllocationCallbacks);
+
 // The same as drflac_open(), except attempts to open the stream even when a header block is not present.
 //
 // Because the header is not necessarily available, the caller must explicitly define the container (Native or Ogg). Do
@@ -2646,6 +2665,14 @@ static drflac_bool32 drflac__decode_samples_with_residual(drflac_bs* bs, drflac_
         return DRFLAC_FALSE;    // Unknown or unsupported residual coding method.
     }
 
+    // With the SIMD kernels available the residuals are decoded on their own (order 0) and the prediction is
+    // applied to the whole block afterwards, rather than one sample at a time in between reading Rice codes.
+    drflac_int32* pBlockStart = pDecodedSamples;
+    drflac_uint32 predictionOrder = order;
+    if (flac_simd != NULL && order >= FLAC_SIMD_MIN_ORDER && order <= FLAC_SIMD_MAX_ORDER) {
+        predictionOrder = 0;
+    }
+
     // Ignore the first <order> values.
     pDecodedSamples += order;
 
@@ -2687,7 +2714,7 @@ static drflac_bool32 drflac__decode_samples_with_residual(drflac_bs* bs, drflac_
         }
 
         if (riceParam != 0xFF) {
-            if (!drflac__decode_samples_with_residual__rice(bs, bitsPerSample, samplesInPartition, riceParam, order, shift, coefficients, pDecodedSamples)) {
+            if (!drflac__decode_samples_with_residual__rice(bs, bitsPerSample, samplesInPartition, riceParam, predictionOrder, shift, coefficients, pDecodedSamples)) {
                 return DRFLAC_FALSE;
             }
         } else {
@@ -2696,7 +2723,7 @@ static drflac_bool32 drflac__decode_samples_with_residual(drflac_bs* bs, drflac_
                 return DRFLAC_FALSE;
             }
 
-            if (!drflac__decode_samples_with_residual__unencoded(bs, bitsPerSample, samplesInPartition, unencodedBitsPerSample, order, shift, coefficients, pDecodedSamples)) {
+            if (!drflac__decode_samples_with_residual__unencoded(bs, bitsPerSample, samplesInPartition, unencodedBitsPerSample, predictionOrder, shift, coefficients, pDecodedSamples)) {
                 return DRFLAC_FALSE;
             }
         }
@@ -2715,6 +2742,14 @@ static drflac_bool32 drflac__decode_samples_with_residual(drflac_bs* bs, drflac_
         }
     }
 
+    if (predictionOrder != order) {
+        if (bitsPerSample > 16) {
+            flac_simd->lpc_restore_64(pBlockStart, blockSize, order, shift, coefficients);
+        } else {
+            flac_simd->lpc_restore_32(pBlockStart, blockSize, order, shift, coefficients);
+        }
+    }
+
     return DRFLAC_TRUE;
 }
 
@@ -3726,7 +3761,27 @@ drflac_bool32 drflac__read_streaminfo(drflac_read_proc onRead, void* pUserData,
     return DRFLAC_TRUE;
 }
 
-drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_seek_proc onSeek, drflac_meta_proc onMeta, void* pUserData, void* pUserDataMD, drflac_uint64* pFirstFramePos, drflac_uint64* pSeektablePos, drflac_uint32* pSeektableSize)
+static void* drflac__malloc_from_callbacks(size_t sz, const drflac_allocation_callbacks* pAllocationCallbacks)
+{
+    if (pAllocationCallbacks != NULL && pAllocationCallbacks->onMalloc != NULL) {
+        return pAllocationCallbacks->onMalloc(sz, pAllocationCallbacks->pUserData);
+    }
+    return DRFLAC_MALLOC(sz);
+}
+
+static void drflac__free_from_callbacks(void* p, const drflac_allocation_callbacks* pAllocationCallbacks)
+{
+    if (p == NULL) {
+        return;
+    }
+    if (pAllocationCallbacks != NULL && pAllocationCallbacks->onFree != NULL) {
+        pAllocationCallbacks->onFree(p, pAllocationCallbacks->pUserData);
+    } else {
+        DRFLAC_FREE(p);
+    }
+}
+
+drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_seek_proc onSeek, drflac_meta_proc onMeta, void* pUserData, void* pUserDataMD, drflac_uint64* pFirstFramePos, drflac_uint64* pSeektablePos, drflac_uint32* pSeektableSize, const drflac_allocation_callbacks* pAllocationCallbacks)
 {
     // We want to keep track of the byte position in the stream of the seektable. At the time of calling this function we know that
     // we'll be sitting on byte 42.
@@ -3758,13 +3813,13 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
                 }
 
                 if (onMeta) {
-                    void* pRawData = DRFLAC_MALLOC(blockSize);
+                    void* pRawData = drflac__malloc_from_callbacks(blockSize, pAllocationCallbacks);
                     if (pRawData == NULL) {
                         return DRFLAC_FALSE;
                     }
 
                     if (onRead(pUserData, pRawData, blockSize) != blockSize) {
-                        DRFLAC_FREE(pRawData);
+                        drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                         return DRFLAC_FALSE;
                     }
 
@@ -3775,7 +3830,7 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
                     metadata.data.application.dataSize = blockSize - sizeof(drflac_uint32);
                     onMeta(pUserDataMD, &metadata);
 
-                    DRFLAC_FREE(pRawData);
+                    drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                 }
             } break;
 
@@ -3785,13 +3840,13 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
                 seektableSize = blockSize;
 
                 if (onMeta) {
-                    void* pRawData = DRFLAC_MALLOC(blockSize);
+                    void* pRawData = drflac__malloc_from_callbacks(blockSize, pAllocationCallbacks);
                     if (pRawData == NULL) {
                         return DRFLAC_FALSE;
                     }
 
                     if (onRead(pUserData, pRawData, blockSize) != blockSize) {
-                        DRFLAC_FREE(pRawData);
+                        drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                         return DRFLAC_FALSE;
                     }
 
@@ -3810,7 +3865,7 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
 
                     onMeta(pUserDataMD, &metadata);
 
-                    DRFLAC_FREE(pRawData);
+                    drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                 }
             } break;
 
@@ -3821,13 +3876,13 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
                 }
 
                 if (onMeta) {
-                    void* pRawData = DRFLAC_MALLOC(blockSize);
+                    void* pRawData = drflac__malloc_from_callbacks(blockSize, pAllocationCallbacks);
                     if (pRawData == NULL) {
                         return DRFLAC_FALSE;
                     }
 
                     if (onRead(pUserData, pRawData, blockSize) != blockSize) {
-                        DRFLAC_FREE(pRawData);
+                        drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                         return DRFLAC_FALSE;
                     }
 
@@ -3841,7 +3896,7 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
 
                     // Need space for the rest of the block
                     if ((pRunningDataEnd - pRunningData) - 4 < (drflac_int64)metadata.data.vorbis_comment.vendorLength) { // <-- Note the order of operations to avoid overflow to a valid value
-                        DRFLAC_FREE(pRawData);
+                        drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                         return DRFLAC_FALSE;
                     }
                     metadata.data.vorbis_comment.vendor       = pRunningData;                                            pRunningData += metadata.data.vorbis_comment.vendorLength;
@@ -3849,7 +3904,7 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
 
                     // Need space for 'commentCount' comments after the block, which at minimum is a drflac_uint32 per comment
                     if ((pRunningDataEnd - pRunningData) / sizeof(drflac_uint32) < metadata.data.vorbis_comment.commentCount) { // <-- Note the order of operations to avoid overflow to a valid value
-                        DRFLAC_FREE(pRawData);
+                        drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                         return DRFLAC_FALSE;
                     }
                     metadata.data.vorbis_comment.pComments    = pRunningData;
@@ -3857,12 +3912,12 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
                     // Check that the comments section is valid before passing it to the callback
                     for (drflac_uint32 i = 0; i < metadata.data.vorbis_comment.commentCount; ++i) {
                         if (pRunningDataEnd - pRunningData < 4) {
-                            DRFLAC_FREE(pRawData);
+                            drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                             return DRFLAC_FALSE;
                         }
                         const drflac_uint32 commentLength     = drflac__le2host_32(*(const drflac_uint32*)pRunningData); pRunningData += 4;
                         if (pRunningDataEnd - pRunningData < (drflac_int64)commentLength) { // <-- Note the order of operations to avoid overflow to a valid value
-                            DRFLAC_FREE(pRawData);
+                            drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                             return DRFLAC_FALSE;
                         }
                         pRunningData += commentLength;
@@ -3870,7 +3925,7 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
 
                     onMeta(pUserDataMD, &metadata);
 
-                    DRFLAC_FREE(pRawData);
+                    drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                 }
             } break;
 
@@ -3881,13 +3936,13 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
                 }
 
                 if (onMeta) {
-                    void* pRawData = DRFLAC_MALLOC(blockSize);
+                    void* pRawData = drflac__malloc_from_callbacks(blockSize, pAllocationCallbacks);
                     if (pRawData == NULL) {
                         return DRFLAC_FALSE;
                     }
 
                     if (onRead(pUserData, pRawData, blockSize) != blockSize) {
-                        DRFLAC_FREE(pRawData);
+                        drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                         return DRFLAC_FALSE;
                     }
 
@@ -3906,7 +3961,7 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
                     // Check that the cuesheet tracks are valid before passing it to the callback
                     for (drflac_uint8 i = 0; i < metadata.data.cuesheet.trackCount; ++i) {
                         if (pRunningDataEnd - pRunningData < 36) {
-                            DRFLAC_FREE(pRawData);
+                            drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                             return DRFLAC_FALSE;
                         }
 
@@ -3915,7 +3970,7 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
                         const drflac_uint8 indexCount        = pRunningData[0];                                         pRunningData += 1;
                         const drflac_uint32 indexPointSize = indexCount * sizeof(drflac_cuesheet_track_index);
                         if (pRunningDataEnd - pRunningData < (drflac_int64)indexPointSize) {
-                            DRFLAC_FREE(pRawData);
+                            drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                             return DRFLAC_FALSE;
                         }
 
@@ -3929,7 +3984,7 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
 
                     onMeta(pUserDataMD, &metadata);
 
-                    DRFLAC_FREE(pRawData);
+                    drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                 }
             } break;
 
@@ -3940,13 +3995,13 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
                 }
 
                 if (onMeta) {
-                    void* pRawData = DRFLAC_MALLOC(blockSize);
+                    void* pRawData = drflac__malloc_from_callbacks(blockSize, pAllocationCallbacks);
                     if (pRawData == NULL) {
                         return DRFLAC_FALSE;
                     }
 
                     if (onRead(pUserData, pRawData, blockSize) != blockSize) {
-                        DRFLAC_FREE(pRawData);
+                        drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                         return DRFLAC_FALSE;
                     }
 
@@ -3961,7 +4016,7 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
 
                     // Need space for the rest of the block
                     if ((pRunningDataEnd - pRunningData) - 24 < (drflac_int64)metadata.data.picture.mimeLength) { // <-- Note the order of operations to avoid overflow to a valid value
-                        DRFLAC_FREE(pRawData);
+                        drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                         return DRFLAC_FALSE;
                     }
                     metadata.data.picture.mime              = pRunningData;                                            pRunningData += metadata.data.picture.mimeLength;
@@ -3969,7 +4024,7 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
 
                     // Need space for the rest of the block
                     if ((pRunningDataEnd - pRunningData) - 20 < (drflac_int64)metadata.data.picture.descriptionLength) { // <-- Note the order of operations to avoid overflow to a valid value
-                        DRFLAC_FREE(pRawData);
+                        drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                         return DRFLAC_FALSE;
                     }
                     metadata.data.picture.description       = pRunningData;                                            pRunningData += metadata.data.picture.descriptionLength;
@@ -3982,13 +4037,13 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
 
                     // Need space for the picture after the block
                     if (pRunningDataEnd - pRunningData < (drflac_int64)metadata.data.picture.pictureDataSize) { // <-- Note the order of operations to avoid overflow to a valid value
-                        DRFLAC_FREE(pRawData);
+                        drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                         return DRFLAC_FALSE;
                     }
 
                     onMeta(pUserDataMD, &metadata);
 
-                    DRFLAC_FREE(pRawData);
+                    drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                 }
             } break;
 
@@ -4021,13 +4076,13 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
                 // It's an unknown chunk, but not necessarily invalid. There's a chance more metadata blocks might be defined later on, so we
                 // can at the very least report the chunk to the application and let it look at the raw data.
                 if (onMeta) {
-                    void* pRawData = DRFLAC_MALLOC(blockSize);
+                    void* pRawData = drflac__malloc_from_callbacks(blockSize, pAllocationCallbacks);
                     if (pRawData == NULL) {
                         return DRFLAC_FALSE;
                     }
 
                     if (onRead(pUserData, pRawData, blockSize) != blockSize) {
-                        DRFLAC_FREE(pRawData);
+                        drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                         return DRFLAC_FALSE;
                     }
 
@@ -4035,7 +4090,7 @@ drflac_bool32 drflac__read_and_decode_metadata(drflac_read_proc onRead, drflac_s
                     metadata.rawDataSize = blockSize;
                     onMeta(pUserDataMD, &metadata);
 
-                    DRFLAC_FREE(pRawData);
+                    drflac__free_from_callbacks(pRawData, pAllocationCallbacks);
                 }
             } break;
         }
@@ -4138,77 +4193,11 @@ typedef enum
 } drflac_ogg_crc_mismatch_recovery;
 
 
-static drflac_uint32 drflac__crc32_table[] = {
-    0x00000000L, 0x04C11DB7L, 0x09823B6EL, 0x0D4326D9L,
-    0x130476DCL, 0x17C56B6BL, 0x1A864DB2L, 0x1E475005L,
-    0x2608EDB8L, 0x22C9F00FL, 0x2F8AD6D6L, 0x2B4BCB61L,
-    0x350C9B64L, 0x31CD86D3L, 0x3C8EA00AL, 0x384FBDBDL,
-    0x4C11DB70L, 0x48D0C6C7L, 0x4593E01EL, 0x4152FDA9L,
-    0x5F15ADACL, 0x5BD4B01BL, 0x569796C2L, 0x52568B75L,
-    0x6A1936C8L, 0x6ED82B7FL, 0x639B0DA6L, 0x675A1011L,
-    0x791D4014L, 0x7DDC5DA3L, 0x709F7B7AL, 0x745E66CDL,
-    0x9823B6E0L, 0x9CE2AB57L, 0x91A18D8EL, 0x95609039L,
-    0x8B27C03CL, 0x8FE6DD8BL, 0x82A5FB52L, 0x8664E6E5L,
-    0xBE2B5B58L, 0xBAEA46EFL, 0xB7A96036L, 0xB3687D81L,
-    0xAD2F2D84L, 0xA9EE3033L, 0xA4AD16EAL, 0xA06C0B5DL,
-    0xD4326D90L, 0xD0F37027L, 0xDDB056FEL, 0xD9714B49L,
-    0xC7361B4CL, 0xC3F706FBL, 0xCEB42022L, 0xCA753D95L,
-    0xF23A8028L, 0xF6FB9D9FL, 0xFBB8BB46L, 0xFF79A6F1L,
-    0xE13EF6F4L, 0xE5FFEB43L, 0xE8BCCD9AL, 0xEC7DD02DL,
-    0x34867077L, 0x30476DC0L, 0x3D044B19L, 0x39C556AEL,
-    0x278206ABL, 0x23431B1CL, 0x2E003DC5L, 0x2AC12072L,
-    0x128E9DCFL, 0x164F8078L, 0x1B0CA6A1L, 0x1FCDBB16L,
-    0x018AEB13L, 0x054BF6A4L, 0x0808D07DL, 0x0CC9CDCAL,
-    0x7897AB07L, 0x7C56B6B0L, 0x71159069L, 0x75D48DDEL,
-    0x6B93DDDBL, 0x6F52C06CL, 0x6211E6B5L, 0x66D0FB02L,
-    0x5E9F46BFL, 0x5A5E5B08L, 0x571D7DD1L, 0x53DC6066L,
-    0x4D9B3063L, 0x495A2DD4L, 0x44190B0DL, 0x40D816BAL,
-    0xACA5C697L, 0xA864DB20L, 0xA527FDF9L, 0xA1E6E04EL,
-    0xBFA1B04BL, 0xBB60ADFCL, 0xB6238B25L, 0xB2E29692L,
-    0x8AAD2B2FL, 0x8E6C3698L, 0x832F1041L, 0x87EE0DF6L,
-    0x99A95DF3L, 0x9D684044L, 0x902B669DL, 0x94EA7B2AL,
-    0xE0B41DE7L, 0xE4750050L, 0xE9362689L, 0xEDF73B3EL,
-    0xF3B06B3BL, 0xF771768CL, 0xFA325055L, 0xFEF34DE2L,
-    0xC6BCF05FL, 0xC27DEDE8L, 0xCF3ECB31L, 0xCBFFD686L,
-    0xD5B88683L, 0xD1799B34L, 0xDC3ABDEDL, 0xD8FBA05AL,
-    0x690CE0EEL, 0x6DCDFD59L, 0x608EDB80L, 0x644FC637L,
-    0x7A089632L, 0x7EC98B85L, 0x738AAD5CL, 0x774BB0EBL,
-    0x4F040D56L, 0x4BC510E1L, 0x46863638L, 0x42472B8FL,
-    0x5C007B8AL, 0x58C1663DL, 0x558240E4L, 0x51435D53L,
-    0x251D3B9EL, 0x21DC2629L, 0x2C9F00F0L, 0x285E1D47L,
-    0x36194D42L, 0x32D850F5L, 0x3F9B762CL, 0x3B5A6B9BL,
-    0x0315D626L, 0x07D4CB91L, 0x0A97ED48L, 0x0E56F0FFL,
-    0x1011A0FAL, 0x14D0BD4DL, 0x19939B94L, 0x1D528623L,
-    0xF12F560EL, 0xF5EE4BB9L, 0xF8AD6D60L, 0xFC6C70D7L,
-    0xE22B20D2L, 0xE6EA3D65L, 0xEBA91BBCL, 0xEF68060BL,
-    0xD727BBB6L, 0xD3E6A601L, 0xDEA580D8L, 0xDA649D6FL,
-    0xC423CD6AL, 0xC0E2D0DDL, 0xCDA1F604L, 0xC960EBB3L,
-    0xBD3E8D7EL, 0xB9FF90C9L, 0xB4BCB610L, 0xB07DABA7L,
-    0xAE3AFBA2L, 0xAAFBE615L, 0xA7B8C0CCL, 0xA379DD7BL,
-    0x9B3660C6L, 0x9FF77D71L, 0x92B45BA8L, 0x9675461FL,
-    0x8832161AL, 0x8CF30BADL, 0x81B02D74L, 0x857130C3L,
-    0x5D8A9099L, 0x594B8D2EL, 0x5408ABF7L, 0x50C9B640L,
-    0x4E8EE645L, 0x4A4FFBF2L, 0x470CDD2BL, 0x43CDC09CL,
-    0x7B827D21L, 0x7F436096L, 0x7200464FL, 0x76C15BF8L,
-    0x68860BFDL, 0x6C47164AL, 0x61043093L, 0x65C52D24L,
-    0x119B4BE9L, 0x155A565EL, 0x18197087L, 0x1CD86D30L,
-    0x029F3D35L, 0x065E2082L, 0x0B1D065BL, 0x0FDC1BECL,
-    0x3793A651L, 0x3352BBE6L, 0x3E119D3FL, 0x3AD08088L,
-    0x2497D08DL, 0x2056CD3AL, 0x2D15EBE3L, 0x29D4F654L,
-    0xC5A92679L, 0xC1683BCEL, 0xCC2B1D17L, 0xC8EA00A0L,
-    0xD6AD50A5L, 0xD26C4D12L, 0xDF2F6BCBL, 0xDBEE767CL,
-    0xE3A1CBC1L, 0xE760D676L, 0xEA23F0AFL, 0xEEE2ED18L,
-    0xF0A5BD1DL, 0xF464A0AAL, 0xF9278673L, 0xFDE69BC4L,
-    0x89B8FD09L, 0x8D79E0BEL, 0x803AC667L, 0x84FBDBD0L,
-    0x9ABC8BD5L, 0x9E7D9662L, 0x933EB0BBL, 0x97FFAD0CL,
-    0xAFB010B1L, 0xAB710D06L, 0xA6322BDFL, 0xA2F33668L,
-    0xBCB4666DL, 0xB8757BDAL, 0xB5365D03L, 0xB1F740B4L
-};
-
+// lancerdecode: the page CRC and its tables are shared with the other Ogg codecs, see ogg.h
 static DRFLAC_INLINE drflac_uint32 drflac_crc32_byte(drflac_uint32 crc32, drflac_uint8 data)
 {
 #ifndef DR_FLAC_NO_CRC
-    return (crc32 << 8) ^ drflac__crc32_table[(drflac_uint8)((crc32 >> 24) & 0xFF) ^ data];
+    return ogg_crc32_byte(crc32, data);
 #else
     (void)data;
     return crc32;
@@ -4235,11 +4224,13 @@ static DRFLAC_INLINE drflac_uint32 drflac_crc32_uint64(drflac_uint32 crc32, drfl
 
 static DRFLAC_INLINE drflac_uint32 drflac_crc32_buffer(drflac_uint32 crc32, drflac_uint8* pData, drflac_uint32 dataSize)
 {
-    // This can be optimized.
-    for (drflac_uint32 i = 0; i < dataSize; ++i) {
-        crc32 = drflac_crc32_byte(crc32, pData[i]);
-    }
+#ifndef DR_FLAC_NO_CRC
+    return ogg_crc32(crc32, pData, dataSize);
+#else
+    (void)pData;
+    (void)dataSize;
     return crc32;
+#endif
 }
 
 
@@ -4993,17 +4984,14 @@ void drflac__init_from_info(drflac* pFlac, drflac_init_info* pInit)
     pFlac->sampleRate       = pInit->sampleRate;
     pFlac->channels         = (drflac_uint8)pInit->channels;
     pFlac->bitsPerSample    = (drflac_uint8)pInit->bitsPerSample;
+    pFlac->outputBitsPerSample = 32;
     pFlac->totalSampleCount = pInit->totalSampleCount;
     pFlac->container        = pInit->container;
 }
 
-drflac* drflac_open_with_metadata_private(drflac_read_proc onRead, drflac_seek_proc onSeek, drflac_meta_proc onMeta, drflac_container container, void* pUserData, void* pUserDataMD)
+drflac* drflac_open_with_metadata_private(drflac_read_proc onRead, drflac_seek_proc onSeek, drflac_meta_proc onMeta, drflac_container container, void* pUserData, void* pUserDataMD, const drflac_allocation_callbacks* pAllocationCallbacks)
 {
-#ifndef DRFLAC_NO_CPUID
-    // CPU support first.
-    drflac__init_cpu_caps();
-#endif
-
+    // lancerdecode: CPU support is detected once by ld_init (flac_global_init)
     drflac_init_info init;
     if (!drflac__init_private(&init, onRead, onSeek, onMeta, container, pUserData, pUserDataMD)) {
         return NULL;
@@ -5073,7 +5061,7 @@ drflac* drflac_open_with_metadata_private(drflac_read_proc onRead, drflac_seek_p
         }
 #endif
 
-        if (!drflac__read_and_decode_metadata(onReadOverride, onSeekOverride, onMeta, pUserDataOverride, pUserDataMD, &firstFramePos, &seektablePos, &seektableSize)) {
+        if (!drflac__read_and_decode_metadata(onReadOverride, onSeekOverride, onMeta, pUserDataOverride, pUserDataMD, &firstFramePos, &seektablePos, &seektableSize, pAllocationCallbacks)) {
             return NULL;
         }
 
@@ -5081,8 +5069,16 @@ drflac* drflac_open_with_metadata_private(drflac_read_proc onRead, drflac_seek_p
     }
 
 
-    drflac* pFlac = (drflac*)DRFLAC_MALLOC(allocationSize);
+    drflac* pFlac = (drflac*)drflac__malloc_from_callbacks(allocationSize, pAllocationCallbacks);
+    if (pFlac == NULL) {
+        return NULL;
+    }
     drflac__init_from_info(pFlac, &init);
+    if (pAllocationCallbacks != NULL) {
+        pFlac->allocationCallbacks = *pAllocationCallbacks;
+    } else {
+        drflac_zero_memory(&pFlac->allocationCallbacks, sizeof(pFlac->allocationCallbacks));
+    }
     pFlac->pDecodedSamples = (drflac_int32*)drflac_align((size_t)pFlac->pExtraData, DRFLAC_MAX_SIMD_VECTOR_SIZE);
 
 #ifndef DR_FLAC_NO_OGG
@@ -5132,7 +5128,7 @@ drflac* drflac_open_with_metadata_private(drflac_read_proc onRead, drflac_seek_p
 
                 // We need to seek back to where we were. If this fails it's a critical error.
                 if (!pFlac->bs.onSeek(pFlac->bs.pUserData, (int)pFlac->firstFramePos, drflac_seek_origin_start)) {
-                    DRFLAC_FREE(pFlac);
+                    drflac__free_from_callbacks(pFlac, pAllocationCallbacks);
                     return NULL;
                 }
             } else {
@@ -5157,12 +5153,12 @@ drflac* drflac_open_with_metadata_private(drflac_read_proc onRead, drflac_seek_p
             } else {
                 if (result == DRFLAC_CRC_MISMATCH) {
                     if (!drflac__read_next_frame_header(&pFlac->bs, pFlac->bitsPerSample, &pFlac->currentFrame.header)) {
-                        DRFLAC_FREE(pFlac);
+                        drflac__free_from_callbacks(pFlac, pAllocationCallbacks);
                         return NULL;
                     }
                     continue;
                 } else {
-                    DRFLAC_FREE(pFlac);
+                    drflac__free_from_callbacks(pFlac, pAllocationCallbacks);
                     return NULL;
                 }
             }
@@ -5230,7 +5226,7 @@ drflac* drflac_open_file_with_metadata(const char* filename, drflac_meta_proc on
         return NULL;
     }
 
-    drflac* pFlac = drflac_open_with_metadata_private(drflac__on_read_stdio, drflac__on_seek_stdio, onMeta, drflac_container_unknown, (void*)file, pUserData);
+    drflac* pFlac = drflac_open_with_metadata_private(drflac__on_read_stdio, drflac__on_seek_stdio, onMeta, drflac_container_unknown, (void*)file, pUserData, NULL);
     if (pFlac == NULL) {
         fclose(file);
         return pFlac;
@@ -5321,7 +5317,7 @@ drflac* drflac_open_memory_with_metadata(const void* data, size_t dataSize, drfl
     memoryStream.data = (const unsigned char*)data;
     memoryStream.dataSize = dataSize;
     memoryStream.currentReadPos = 0;
-    drflac* pFlac = drflac_open_with_metadata_private(drflac__on_read_memory, drflac__on_seek_memory, onMeta, drflac_container_unknown, &memoryStream, pUserData);
+    drflac* pFlac = drflac_open_with_metadata_private(drflac__on_read_memory, drflac__on_seek_memory, onMeta, drflac_container_unknown, &memoryStream, pUserData, NULL);
     if (pFlac == NULL) {
         return NULL;
     }
@@ -5348,20 +5344,24 @@ drflac* drflac_open_memory_with_metadata(const void* data, size_t dataSize, drfl
 
 drflac* drflac_open(drflac_read_proc onRead, drflac_seek_proc onSeek, void* pUserData)
 {
-    return drflac_open_with_metadata_private(onRead, onSeek, NULL, drflac_container_unknown, pUserData, pUserData);
+    return drflac_open_with_metadata_private(onRead, onSeek, NULL, drflac_container_unknown, pUserData, pUserData, NULL);
+}
+drflac* drflac_open_with_allocation_callbacks(drflac_read_proc onRead, drflac_seek_proc onSeek, void* pUserData, const drflac_allocation_callbacks* pAllocationCallbacks)
+{
+    return drflac_open_with_metadata_private(onRead, onSeek, NULL, drflac_container_unknown, pUserData, pUserData, pAllocationCallbacks);
 }
 drflac* drflac_open_relaxed(drflac_read_proc onRead, drflac_seek_proc onSeek, drflac_container container, void* pUserData)
 {
-    return drflac_open_with_metadata_private(onRead, onSeek, NULL, container, pUserData, pUserData);
+    return drflac_open_with_metadata_private(onRead, onSeek, NULL, container, pUserData, pUserData, NULL);
 }
 
 drflac* drflac_open_with_metadata(drflac_read_proc onRead, drflac_seek_proc onSeek, drflac_meta_proc onMeta, void* pUserData)
 {
-    return drflac_open_with_metadata_private(onRead, onSeek, onMeta, drflac_container_unknown, pUserData, pUserData);
+    return drflac_open_with_metadata_private(onRead, onSeek, onMeta, drflac_container_unknown, pUserData, pUserData, NULL);
 }
 drflac* drflac_open_with_metadata_relaxed(drflac_read_proc onRead, drflac_seek_proc onSeek, drflac_meta_proc onMeta, drflac_container container, void* pUserData)
 {
-    return drflac_open_with_metadata_private(onRead, onSeek, onMeta, container, pUserData, pUserData);
+    return drflac_open_with_metadata_private(onRead, onSeek, onMeta, container, pUserData, pUserData, NULL);
 }
 
 void drflac_close(drflac* pFlac)
@@ -5389,7 +5389,7 @@ void drflac_close(drflac* pFlac)
 #endif
 #endif
 
-    DRFLAC_FREE(pFlac);
+    drflac__free_from_callbacks(pFlac, &pFlac->allocationCallbacks);
 }
 
 drflac_uint64 drflac__read_s32__misaligned(drflac* pFlac, drflac_uint64 samplesToRead, drflac_int32* bufferOut)
@@ -5461,7 +5461,7 @@ drflac_uint64 drflac__read_s32__misaligned(drflac* pFlac, drflac_uint64 samplesT
         }
 
 
-        decodedSample <<= (32 - pFlac->bitsPerSample);
+        decodedSample <<= (pFlac->outputBitsPerSample - pFlac->bitsPerSample);
 
         if (bufferOut) {
             *bufferOut++ = decodedSample;
@@ -5543,80 +5543,89 @@ drflac_uint64 drflac_read_s32(drflac* pFlac, drflac_uint64 samplesToRead, drflac
             }
 
             drflac_uint64 firstAlignedSampleInFrame = samplesReadFromFrameSoFar / channelCount;
-            unsigned int unusedBitsPerSample = 32 - pFlac->bitsPerSample;
-
-            switch (pFlac->currentFrame.header.channelAssignment)
-            {
-                case DRFLAC_CHANNEL_ASSIGNMENT_LEFT_SIDE:
-                {
-                    const drflac_int32* pDecodedSamples0 = pFlac->currentFrame.subframes[0].pDecodedSamples + firstAlignedSampleInFrame;
-                    const drflac_int32* pDecodedSamples1 = pFlac->currentFrame.subframes[1].pDecodedSamples + firstAlignedSampleInFrame;
-
-                    for (drflac_uint64 i = 0; i < alignedSampleCountPerChannel; ++i) {
-                        int left  = pDecodedSamples0[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[0].wastedBitsPerSample);
-                        int side  = pDecodedSamples1[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[1].wastedBitsPerSample);
-                        int right = left - side;
-
-                        bufferOut[i*2+0] = left;
-                        bufferOut[i*2+1] = right;
-                    }
-                } break;
-
-                case DRFLAC_CHANNEL_ASSIGNMENT_RIGHT_SIDE:
+            unsigned int unusedBitsPerSample = pFlac->outputBitsPerSample - pFlac->bitsPerSample;
+
+            if (flac_simd != NULL && channelCount == 2) {
+                // The SIMD kernels cover all four stereo assignments.
+                flac_simd->decorrelate_s32(pFlac->currentFrame.header.channelAssignment,
+                    pFlac->currentFrame.subframes[0].pDecodedSamples + firstAlignedSampleInFrame,
+                    pFlac->currentFrame.subframes[1].pDecodedSamples + firstAlignedSampleInFrame,
+                    pFlac->currentFrame.subframes[0].wastedBitsPerSample, pFlac->currentFrame.subframes[1].wastedBitsPerSample,
+                    unusedBitsPerSample, (size_t)alignedSampleCountPerChannel, bufferOut);
+            } else {
+                switch (pFlac->currentFrame.header.channelAssignment)
                 {
-                    const drflac_int32* pDecodedSamples0 = pFlac->currentFrame.subframes[0].pDecodedSamples + firstAlignedSampleInFrame;
-                    const drflac_int32* pDecodedSamples1 = pFlac->currentFrame.subframes[1].pDecodedSamples + firstAlignedSampleInFrame;
+                    case DRFLAC_CHANNEL_ASSIGNMENT_LEFT_SIDE:
+                    {
+                        const drflac_int32* pDecodedSamples0 = pFlac->currentFrame.subframes[0].pDecodedSamples + firstAlignedSampleInFrame;
+                        const drflac_int32* pDecodedSamples1 = pFlac->currentFrame.subframes[1].pDecodedSamples + firstAlignedSampleInFrame;
 
-                    for (drflac_uint64 i = 0; i < alignedSampleCountPerChannel; ++i) {
-                        int side  = pDecodedSamples0[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[0].wastedBitsPerSample);
-                        int right = pDecodedSamples1[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[1].wastedBitsPerSample);
-                        int left  = right + side;
+                        for (drflac_uint64 i = 0; i < alignedSampleCountPerChannel; ++i) {
+                            int left  = pDecodedSamples0[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[0].wastedBitsPerSample);
+                            int side  = pDecodedSamples1[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[1].wastedBitsPerSample);
+                            int right = left - side;
 
-                        bufferOut[i*2+0] = left;
-                        bufferOut[i*2+1] = right;
-                    }
-                } break;
+                            bufferOut[i*2+0] = left;
+                            bufferOut[i*2+1] = right;
+                        }
+                    } break;
 
-                case DRFLAC_CHANNEL_ASSIGNMENT_MID_SIDE:
-                {
-                    const drflac_int32* pDecodedSamples0 = pFlac->currentFrame.subframes[0].pDecodedSamples + firstAlignedSampleInFrame;
-                    const drflac_int32* pDecodedSamples1 = pFlac->currentFrame.subframes[1].pDecodedSamples + firstAlignedSampleInFrame;
+                    case DRFLAC_CHANNEL_ASSIGNMENT_RIGHT_SIDE:
+                    {
+                        const drflac_int32* pDecodedSamples0 = pFlac->currentFrame.subframes[0].pDecodedSamples + firstAlignedSampleInFrame;
+                        const drflac_int32* pDecodedSamples1 = pFlac->currentFrame.subframes[1].pDecodedSamples + firstAlignedSampleInFrame;
 
-                    for (drflac_uint64 i = 0; i < alignedSampleCountPerChannel; ++i) {
-                        int mid  = pDecodedSamples0[i] << pFlac->currentFrame.subframes[0].wastedBitsPerSample;
-                        int side = pDecodedSamples1[i] << pFlac->currentFrame.subframes[1].wastedBitsPerSample;
-                        
-                        mid = (((drflac_uint32)mid) << 1) | (side & 0x01);
+                        for (drflac_uint64 i = 0; i < alignedSampleCountPerChannel; ++i) {
+                            int side  = pDecodedSamples0[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[0].wastedBitsPerSample);
+                            int right = pDecodedSamples1[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[1].wastedBitsPerSample);
+                            int left  = right + side;
 
-                        bufferOut[i*2+0] = ((mid + side) >> 1) << (unusedBitsPerSample);
-                        bufferOut[i*2+1] = ((mid - side) >> 1) << (unusedBitsPerSample);
-                    }
-                } break;
+                            bufferOut[i*2+0] = left;
+                            bufferOut[i*2+1] = right;
+                        }
+                    } break;
 
-                case DRFLAC_CHANNEL_ASSIGNMENT_INDEPENDENT:
-                default:
-                {
-                    if (pFlac->currentFrame.header.channelAssignment == 1) // 1 = Stereo
+                    case DRFLAC_CHANNEL_ASSIGNMENT_MID_SIDE:
                     {
-                        // Stereo optimized inner loop unroll.
                         const drflac_int32* pDecodedSamples0 = pFlac->currentFrame.subframes[0].pDecodedSamples + firstAlignedSampleInFrame;
                         const drflac_int32* pDecodedSamples1 = pFlac->currentFrame.subframes[1].pDecodedSamples + firstAlignedSampleInFrame;
 
                         for (drflac_uint64 i = 0; i < alignedSampleCountPerChannel; ++i) {
-                            bufferOut[i*2+0] = pDecodedSamples0[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[0].wastedBitsPerSample);
-                            bufferOut[i*2+1] = pDecodedSamples1[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[1].wastedBitsPerSample);
+                            int mid  = pDecodedSamples0[i] << pFlac->currentFrame.subframes[0].wastedBitsPerSample;
+                            int side = pDecodedSamples1[i] << pFlac->currentFrame.subframes[1].wastedBitsPerSample;
+                        
+                            mid = (((drflac_uint32)mid) << 1) | (side & 0x01);
+
+                            bufferOut[i*2+0] = ((mid + side) >> 1) << (unusedBitsPerSample);
+                            bufferOut[i*2+1] = ((mid - side) >> 1) << (unusedBitsPerSample);
                         }
-                    }
-                    else
+                    } break;
+
+                    case DRFLAC_CHANNEL_ASSIGNMENT_INDEPENDENT:
+                    default:
                     {
-                        // Generic interleaving.
-                        for (drflac_uint64 i = 0; i < alignedSampleCountPerChannel; ++i) {
-                            for (unsigned int j = 0; j < channelCount; ++j) {
-                                bufferOut[(i*channelCount)+j] = (pFlac->currentFrame.subframes[j].pDecodedSamples[firstAlignedSampleInFrame + i]) << (unusedBitsPerSample + pFlac->currentFrame.subframes[j].wastedBitsPerSample);
+                        if (pFlac->currentFrame.header.channelAssignment == 1) // 1 = Stereo
+                        {
+                            // Stereo optimized inner loop unroll.
+                            const drflac_int32* pDecodedSamples0 = pFlac->currentFrame.subframes[0].pDecodedSamples + firstAlignedSampleInFrame;
+                            const drflac_int32* pDecodedSamples1 = pFlac->currentFrame.subframes[1].pDecodedSamples + firstAlignedSampleInFrame;
+
+                            for (drflac_uint64 i = 0; i < alignedSampleCountPerChannel; ++i) {
+                                bufferOut[i*2+0] = pDecodedSamples0[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[0].wastedBitsPerSample);
+                                bufferOut[i*2+1] = pDecodedSamples1[i] << (unusedBitsPerSample + pFlac->currentFrame.subframes[1].wastedBitsPerSample);
                             }
                         }
-                    }
-                } break;
+                        else
+                        {
+                            // Generic interleaving.
+                            for (drflac_uint64 i = 0; i < alignedSampleCountPerChannel; ++i) {
+                                for (unsigned int j = 0; j < channelCount; ++j) {
+                                    bufferOut[(i*channelCount)+j] = (pFlac->currentFrame.subframes[j].pDecodedSamples[firstAlignedSampleInFrame + i]) << (unusedBitsPerSample + pFlac->currentFrame.subframes[j].wastedBitsPerSample);
+                                }
+                            }
+                        }
+                    } break;
+                }
             }
 
             drflac_uint64 alignedSamplesRead = alignedSampleCountPerChannel * channelCount;
@@ -5655,16 +5664,52 @@ drflac_uint64 drflac_read_s16(drflac* pFlac, drflac_uint64 samplesToRead, drflac
     drflac_uint64 totalSamplesRead = 0;
 
     while (samplesToRead > 0) {
+        drflac_uint64 samplesToReadAsS32 = (samplesToRead > 4096) ? 4096 : samplesToRead;
+
+        // Whole stereo frames skip the s32 pass and are decorrelated straight to s16.
+        if (flac_simd != NULL && pFlac != NULL) {
+            if (pFlac->currentFrame.samplesRemaining == 0) {
+                if (!drflac__read_and_decode_next_frame(pFlac)) {
+                    break;  // Reached the end.
+                }
+            }
+
+            unsigned int channelCount = drflac__get_channel_count_from_channel_assignment(pFlac->currentFrame.header.channelAssignment);
+            if (channelCount == 2) {
+                drflac_uint64 framesToRead = samplesToRead / 2;
+                if (framesToRead > pFlac->currentFrame.samplesRemaining / 2) {
+                    framesToRead = pFlac->currentFrame.samplesRemaining / 2;
+                }
+
+                if ((pFlac->currentFrame.samplesRemaining & 1) == 0 && framesToRead > 0) {
+                    drflac_uint64 firstFrame = pFlac->currentFrame.header.blockSize - (pFlac->currentFrame.samplesRemaining / 2);
+                    flac_simd->decorrelate_s16(pFlac->currentFrame.header.channelAssignment,
+                        pFlac->currentFrame.subframes[0].pDecodedSamples + firstFrame,
+                        pFlac->currentFrame.subframes[1].pDecodedSamples + firstFrame,
+                        pFlac->currentFrame.subframes[0].wastedBitsPerSample, pFlac->currentFrame.subframes[1].wastedBitsPerSample,
+                        32 - pFlac->bitsPerSample, (size_t)framesToRead, pBufferOut);
+
+                    pFlac->currentFrame.samplesRemaining -= (unsigned int)(framesToRead * 2);
+                    pFlac->currentSample += framesToRead * 2;
+                    totalSamplesRead += framesToRead * 2;
+                    samplesToRead    -= framesToRead * 2;
+                    pBufferOut       += framesToRead * 2;
+                    continue;
+                }
+
+                // Half a frame (or a lone sample) goes through the s32 path to get back in step.
+                samplesToReadAsS32 = 1;
+            }
+        }
+
         drflac_int32 samples32[4096];
-        drflac_uint64 samplesJustRead = drflac_read_s32(pFlac, (samplesToRead > 4096) ? 4096 : samplesToRead, samples32);
+        drflac_uint64 samplesJustRead = drflac_read_s32(pFlac, samplesToReadAsS32, samples32);
         if (samplesJustRead == 0) {
             break;  // Reached the end.
         }
 
         // s32 -> s16
-        for (drflac_uint64 i = 0; i < samplesJustRead; ++i) {
-            pBufferOut[i] = (drflac_int16)(samples32[i] >> 16);
-        }
+        convert_s32_to_s16(samples32, pBufferOut, (size_t)samplesJustRead);
 
         totalSamplesRead += samplesJustRead;
         samplesToRead    -= samplesJustRead;
@@ -6,6 +6,11 @@
 #include "../formats.h"
 #include "../logging.h"
 #include "../properties.h"
+#include "../convert.h"
+#include "../stream.h"
+#include "../ogg.h"
+#include "flac_simd.h"
+#include <string.h>
 
 #define DR_FLAC_IMPLEMENTATION
 #define DR_FLAC_NO_STDIO
@@ -30,15 +35,28 @@ unsigned int seek_stream_drflac(void *pUserData, int offset, drflac_seek_origin
 typedef struct {
 	drflac *pFlac;
 	ld_stream_t baseStream;
+	int64_t position; //frame the next read returns
+	int sampleSize; //2 for s16 output, 4 for s24 and s32
 	ld_pcmstream_t pcm;
+	ld_allocator_t alloc;
 } flac_userdata_t;
 
+//userdata, output stream and a decoder for stereo with up to 4608 sample blocks,
+//bigger decoders go to the options allocator
+#define FLAC_ARENA_SIZE (PCMSTREAM_ARENA_SIZE + STREAM_ARENA_SIZE + sizeof(flac_userdata_t) + \
+	sizeof(drflac) + 2 * 4608 * sizeof(drflac_int32) + 2 * DRFLAC_MAX_SIMD_VECTOR_SIZE)
+
 size_t flac_read(void* ptr, size_t size, ld_stream_t stream)
 {
 	flac_userdata_t *userdata = (flac_userdata_t*)stream->userData;
-	size_t sampleCount = size / 2;
-	size_t samplesRead = (size_t)drflac_read_s16(userdata->pFlac, (size_t)sampleCount, (drflac_int16*)ptr);
-	return samplesRead * 2;
+	drflac_uint64 samples;
+	if(userdata->sampleSize == 4) {
+		samples = drflac_read_s32(userdata->pFlac, size / 4, (drflac_int32*)ptr);
+	} else {
+		samples = drflac_read_s16(userdata->pFlac, size / 2, (drflac_int16*)ptr);
+	}
+	userdata->position += samples / userdata->pFlac->channels;
+	return (size_t)samples * userdata->sampleSize;
 }
 
 int flac_seek(ld_stream_t stream, int32_t offset, int origin)
@@ -48,52 +66,144 @@ int flac_seek(ld_stream_t stream, int32_t offset, int origin)
 		LOG_S_ERROR(userdata->pcm, "flac seek only supports reset");
 		return 0;
 	}
+	userdata->position = 0;
 	return drflac_seek_to_sample(userdata->pFlac, 0);
 }
 
+static int flac_seekframe(ld_pcmstream_t pcm, int64_t frame)
+{
+	flac_userdata_t *userdata = (flac_userdata_t*)pcm->_internal->seeker.data;
+	//drflac counts interleaved samples
+	if(!drflac_seek_to_sample(userdata->pFlac, (drflac_uint64)frame * userdata->pFlac->channels)) {
+		return -1;
+	}
+	userdata->position = frame;
+	return 0;
+}
+
+static int64_t flac_tellframe(ld_pcmstream_t pcm)
+{
+	flac_userdata_t *userdata = (flac_userdata_t*)pcm->_internal->seeker.data;
+	return userdata->position;
+}
+
 void flac_close(ld_stream_t stream)
 {
 	flac_userdata_t *userdata = (flac_userdata_t*)stream->userData;
+	ld_allocator_t alloc = userdata->alloc;
 	drflac_close(userdata->pFlac);
 	userdata->baseStream->close(userdata->baseStream);
-	free(userdata);
-	free(stream);
+	mem_free(&alloc, userdata);
+	mem_free(&alloc, stream);
+}
+
+void flac_global_init(void)
+{
+#ifndef DRFLAC_NO_CPUID
+	drflac__init_cpu_caps();
+#endif
+}
+
+int32_t flac_score(const unsigned char *peek, int32_t peekSize, void *userdata)
+{
+	size_t length;
+	if(peekSize >= 4 && !memcmp(peek, "fLaC", 4)) return LD_SCORE_MAX;
+	const unsigned char *packet = ogg_first_packet(peek, peekSize, &length);
+	return packet && length >= 5 && !memcmp(packet, "\x7F""FLAC", 5) ? LD_SCORE_MAX : 0;
 }
 
 ld_pcmstream_t flac_getstream(ld_stream_t stream, ld_options_t options, const char **error, int isOgg)
 {
-	drflac *pFlac = drflac_open(read_stream_drflac, seek_stream_drflac, (void*)stream);
+	if(!flac_simd) flac_simd_init();
+	ld_allocator_t alloc = options_allocator(options);
+	ld_arena_t *arena = arena_create(&alloc, FLAC_ARENA_SIZE + (isOgg ? sizeof(drflac_oggbs) : 0));
+	if(!arena) {
+		LOG_O_ERROR(options, "Flac: out of memory");
+		*error = "Out of memory";
+		return NULL;
+	}
+	alloc = arena_allocator(arena, ARENA_OVERHEAD);
+	ld_allocator_t decoder = arena_allocator(arena, ARENA_DECODER);
+	drflac_allocation_callbacks callbacks;
+	callbacks.pUserData = decoder.userdata;
+	callbacks.onMalloc = decoder.malloc;
+	callbacks.onRealloc = decoder.realloc;
+	callbacks.onFree = decoder.free;
+	drflac *pFlac = drflac_open_with_allocation_callbacks(read_stream_drflac, seek_stream_drflac, (void*)stream, &callbacks);
 	if(!pFlac) {
+		arena_destroy(arena);
 		LOG_O_ERROR(options, "Flac decode failed");
 		*error = "Flac decode failed";
-		stream->close(stream);
 		return NULL;
 	}
 
-	flac_userdata_t *userdata = (flac_userdata_t*)malloc(sizeof(flac_userdata_t));
+	flac_userdata_t *userdata = (flac_userdata_t*)mem_alloc(&alloc, sizeof(flac_userdata_t));
 	userdata->pFlac = pFlac;
 	userdata->baseStream = stream;
+	userdata->position = 0;
+	userdata->alloc = alloc;
+	//s24 can't hold deeper sources without narrowing, they get s32
+	LDFORMAT sampleType = options_sample_type(options);
+	if(sampleType == LDFORMAT_S24 && pFlac->bitsPerSample > 24) {
+		sampleType = LDFORMAT_S32;
+	}
+	if(sampleType == LDFORMAT_S24) {
+		pFlac->outputBitsPerSample = 24;
+	}
+	userdata->sampleSize = (sampleType == LDFORMAT_S24 || sampleType == LDFORMAT_S32) ? 4 : 2;
 
 
-	ld_stream_t data = ld_stream_new();
+	ld_stream_t data = stream_new(&alloc);
 	data->read = &flac_read;
 	data->seek = &flac_seek;
 	data->close = &flac_close;
 	data->userData = userdata;
 
-	ld_pcmstream_t retsound = pcmstream_init(options);
+	ld_pcmstream_t retsound = pcmstream_init(options, arena);
 	userdata->pcm = retsound;
 	retsound->frequency = pFlac->sampleRate;
 	retsound->stream = data;
 	retsound->dataSize = -1;
-	retsound->blockSize = 8192;
-    set_property_string(retsound, LD_PROPERTY_CONTAINER, isOgg ? "ogg" : "flac");
-    set_property_string(retsound, LD_PROPERTY_CODEC, "flac");
-	if(pFlac->channels == 2) {
-		retsound->format = LDFORMAT_STEREO16;
-	} else {
-		retsound->format = LDFORMAT_MONO16;
+	retsound->blockSize = 8192 * (userdata->sampleSize / 2);
+	retsound->_internal->seeker.seek = &flac_seekframe;
+	retsound->_internal->seeker.tell = &flac_tellframe;
+	retsound->_internal->seeker.data = userdata;
+    set_property_string(retsound, LD_PROPERTY_ID_CONTAINER, isOgg ? "ogg" : "flac");
+    set_property_string(retsound, LD_PROPERTY_ID_CODEC, "flac");
+	set_property_int(retsound, LD_PROPERTY_ID_BITS_PER_SAMPLE, pFlac->bitsPerSample);
+	pcmstream_set_format(retsound, pFlac->channels, 0);
+	if(userdata->sampleSize == 4) {
+		retsound->format = sampleType;
 	}
 	return retsound;
 }
 
+void flac_readstreaminfo(const unsigned char *streaminfo, ld_probe_info_t *info)
+{
+	uint64_t packed = 0;
+	for(int i = 10; i < 18; i++) {
+		packed = (packed << 8) | streaminfo[i];
+	}
+	info->codec = "flac";
+	info->frequency = (int32_t)(packed >> 44);
+	info->channels = (int32_t)((packed >> 41) & 0x7) + 1;
+	info->bitsPerSample = (int32_t)((packed >> 36) & 0x1F) + 1;
+	uint64_t totalFrames = packed & 0xFFFFFFFFFULL;
+	info->totalFrames = totalFrames ? (int64_t)totalFrames : -1;
+}
+
+int flac_probe(ld_stream_t stream, ld_probe_info_t *info)
+{
+	//fLaC + METADATA_BLOCK_HEADER, STREAMINFO must be the first block
+	unsigned char header[8];
+	unsigned char streaminfo[34];
+	if(stream->read(header, 8, stream) < 8 ||
+	   memcmp(header, "fLaC", 4) ||
+	   (header[4] & 0x7F) != 0 ||
+	   stream->read(streaminfo, 34, stream) < 34) {
+		return 0;
+	}
+	info->container = "flac";
+	flac_readstreaminfo(streaminfo, info);
+	return 1;
+}
@@ -0,0 +1,338 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "flac_simd.h"
+#include "../cpu.h"
+#include <string.h>
+
+#if defined(CPU_X86)
+#include <smmintrin.h>
+#include <immintrin.h>
+#endif
+
+/*
+ * LPC restoration runs in blocks of B samples. For the block starting at i,
+ * the part of each prediction that only uses samples before i is
+ *   P[t] = sum over d of samples[i-1-d] * coefficients[d+t]   (t < B)
+ * which has no dependency inside the block and is done with vectors: one
+ * broadcast sample times a sliding window of the coefficients per d. The
+ * few terms that use samples from the block itself are then resolved in
+ * order by resolve_32/resolve_64. Sums wrap (32-bit) or are exact (64-bit)
+ * so the result does not depend on the order of the additions.
+ */
+
+//coefficients padded with zeros so the windows and the resolve loop can read past the order
+#define COEF_PAD (FLAC_SIMD_MAX_ORDER + 4)
+
+static inline void restore_32_scalar(int32_t *s, uint32_t start, uint32_t count, uint32_t order, int32_t shift, const int32_t *c)
+{
+    for(uint32_t i = start; i < count; i++) {
+        uint32_t sum = 0;
+        for(uint32_t j = 0; j < order; j++)
+            sum += (uint32_t)c[j] * (uint32_t)s[i - 1 - j];
+        s[i] = (int32_t)((uint32_t)s[i] + (uint32_t)((int32_t)sum >> shift));
+    }
+}
+
+static inline void restore_64_scalar(int32_t *s, uint32_t start, uint32_t count, uint32_t order, int32_t shift, const int32_t *c)
+{
+    for(uint32_t i = start; i < count; i++) {
+        int64_t sum = 0;
+        for(uint32_t j = 0; j < order; j++)
+            sum += (int64_t)c[j] * s[i - 1 - j];
+        s[i] = (int32_t)((uint32_t)s[i] + (uint32_t)(int32_t)(sum >> shift));
+    }
+}
+
+static inline void resolve_32(int32_t *s, const uint32_t *p, int block, int32_t shift, const int32_t *cp)
+{
+    for(int t = 0; t < block; t++) {
+        uint32_t sum = p[t];
+        for(int j = 0; j < t; j++)
+            sum += (uint32_t)cp[j] * (uint32_t)s[t - 1 - j];
+        s[t] = (int32_t)((uint32_t)s[t] + (uint32_t)((int32_t)sum >> shift));
+    }
+}
+
+static inline void resolve_64(int32_t *s, const int64_t *p, int block, int32_t shift, const int32_t *cp)
+{
+    for(int t = 0; t < block; t++) {
+        int64_t sum = p[t];
+        for(int j = 0; j < t; j++)
+            sum += (int64_t)cp[j] * s[t - 1 - j];
+        s[t] = (int32_t)((uint32_t)s[t] + (uint32_t)(int32_t)(sum >> shift));
+    }
+}
+
+static inline void decorrelate_scalar(int assignment, int32_t a, int32_t b, int wasted0, int wasted1, int unused, int32_t *l, int32_t *r)
+{
+    uint32_t left, right;
+    switch(assignment) {
+        case FLAC_STEREO_LEFT_SIDE:
+            left = (uint32_t)a << (unused + wasted0);
+            right = left - ((uint32_t)b << (unused + wasted1));
+            break;
+        case FLAC_STEREO_RIGHT_SIDE:
+            right = (uint32_t)b << (unused + wasted1);
+            left = right + ((uint32_t)a << (unused + wasted0));
+            break;
+        case FLAC_STEREO_MID_SIDE: {
+            int32_t side = (int32_t)((uint32_t)b << wasted1);
+            uint32_t mid = ((uint32_t)a << wasted0 << 1) | (side & 0x01);
+            left = (uint32_t)((int32_t)(mid + (uint32_t)side) >> 1) << unused;
+            right = (uint32_t)((int32_t)(mid - (uint32_t)side) >> 1) << unused;
+            break;
+        }
+        default:
+            left = (uint32_t)a << (unused + wasted0);
+            right = (uint32_t)b << (unused + wasted1);
+            break;
+    }
+    *l = (int32_t)left;
+    *r = (int32_t)right;
+}
+
+#ifdef CPU_X86
+
+/* SSE4.1 */
+
+TARGET_SSE41 static void lpc_restore_32_sse41(int32_t *s, uint32_t count, uint32_t order, int32_t shift, const int32_t *c)
+{
+    int32_t cp[COEF_PAD] = {0};
+    __m128i cv[FLAC_SIMD_MAX_ORDER];
+    memcpy(cp, c, order * sizeof(int32_t));
+    for(uint32_t d = 0; d < order; d++)
+        cv[d] = _mm_loadu_si128((const __m128i*)(cp + d));
+    uint32_t i = order;
+    for(; i + 4 <= count; i += 4) {
+        uint32_t p[4];
+        __m128i sum = _mm_setzero_si128();
+        for(uint32_t d = 0; d < order; d++)
+            sum = _mm_add_epi32(sum, _mm_mullo_epi32(_mm_set1_epi32(s[i - 1 - d]), cv[d]));
+        _mm_storeu_si128((__m128i*)p, sum);
+        resolve_32(s + i, p, 4, shift, cp);
+    }
+    restore_32_scalar(s, i, count, order, shift, c);
+}
+
+TARGET_SSE41 static void lpc_restore_64_sse41(int32_t *s, uint32_t count, uint32_t order, int32_t shift, const int32_t *c)
+{
+    int32_t cp[COEF_PAD] = {0};
+    __m128i cv01[FLAC_SIMD_MAX_ORDER], cv23[FLAC_SIMD_MAX_ORDER];
+    memcpy(cp, c, order * sizeof(int32_t));
+    //_mm_mul_epi32 multiplies the low dword of each qword
+    for(uint32_t d = 0; d < order; d++) {
+        cv01[d] = _mm_set_epi64x(cp[d + 1], cp[d]);
+        cv23[d] = _mm_set_epi64x(cp[d + 3], cp[d + 2]);
+    }
+    uint32_t i = order;
+    for(; i + 4 <= count; i += 4) {
+        int64_t p[4];
+        __m128i sum01 = _mm_setzero_si128();
+        __m128i sum23 = _mm_setzero_si128();
+        for(uint32_t d = 0; d < order; d++) {
+            __m128i x = _mm_set1_epi32(s[i - 1 - d]);
+            sum01 = _mm_add_epi64(sum01, _mm_mul_epi32(x, cv01[d]));
+            sum23 = _mm_add_epi64(sum23, _mm_mul_epi32(x, cv23[d]));
+        }
+        _mm_storeu_si128((__m128i*)p, sum01);
+        _mm_storeu_si128((__m128i*)(p + 2), sum23);
+        resolve_64(s + i, p, 4, shift, cp);
+    }
+    restore_64_scalar(s, i, count, order, shift, c);
+}
+
+TARGET_SSE41 static inline void decorrelate4_sse41(int assignment, __m128i a, __m128i b, __m128i w0, __m128i w1, __m128i u, __m128i uw0, __m128i uw1, __m128i *l, __m128i *r)
+{
+    switch(assignment) {
+        case FLAC_STEREO_LEFT_SIDE:
+            *l = _mm_sll_epi32(a, uw0);
+            *r = _mm_sub_epi32(*l, _mm_sll_epi32(b, uw1));
+            break;
+        case FLAC_STEREO_RIGHT_SIDE:
+            *r = _mm_sll_epi32(b, uw1);
+            *l = _mm_add_epi32(*r, _mm_sll_epi32(a, uw0));
+            break;
+        case FLAC_STEREO_MID_SIDE: {
+            __m128i side = _mm_sll_epi32(b, w1);
+            __m128i mid = _mm_or_si128(_mm_slli_epi32(_mm_sll_epi32(a, w0), 1), _mm_and_si128(side, _mm_set1_epi32(1)));
+            *l = _mm_sll_epi32(_mm_srai_epi32(_mm_add_epi32(mid, side), 1), u);
+            *r = _mm_sll_epi32(_mm_srai_epi32(_mm_sub_epi32(mid, side), 1), u);
+            break;
+        }
+        default:
+            *l = _mm_sll_epi32(a, uw0);
+            *r = _mm_sll_epi32(b, uw1);
+            break;
+    }
+}
+
+TARGET_SSE41 static void decorrelate_s32_sse41(int assignment, const int32_t *ch0, const int32_t *ch1, int wasted0, int wasted1, int unused, size_t frames, int32_t *out)
+{
+    __m128i w0 = _mm_cvtsi32_si128(wasted0), w1 = _mm_cvtsi32_si128(wasted1), u = _mm_cvtsi32_si128(unused);
+    __m128i uw0 = _mm_cvtsi32_si128(unused + wasted0), uw1 = _mm_cvtsi32_si128(unused + wasted1);
+    size_t i = 0;
+    for(; i + 4 <= frames; i += 4) {
+        __m128i l, r;
+        decorrelate4_sse41(assignment, _mm_loadu_si128((const __m128i*)(ch0 + i)), _mm_loadu_si128((const __m128i*)(ch1 + i)),
+            w0, w1, u, uw0, uw1, &l, &r);
+        _mm_storeu_si128((__m128i*)(out + i * 2), _mm_unpacklo_epi32(l, r));
+        _mm_storeu_si128((__m128i*)(out + i * 2 + 4), _mm_unpackhi_epi32(l, r));
+    }
+    for(; i < frames; i++)
+        decorrelate_scalar(assignment, ch0[i], ch1[i], wasted0, wasted1, unused, out + i * 2, out + i * 2 + 1);
+}
+
+TARGET_SSE41 static void decorrelate_s16_sse41(int assignment, const int32_t *ch0, const int32_t *ch1, int wasted0, int wasted1, int unused, size_t frames, int16_t *out)
+{
+    __m128i w0 = _mm_cvtsi32_si128(wasted0), w1 = _mm_cvtsi32_si128(wasted1), u = _mm_cvtsi32_si128(unused);
+    __m128i uw0 = _mm_cvtsi32_si128(unused + wasted0), uw1 = _mm_cvtsi32_si128(unused + wasted1);
+    size_t i = 0;
+    for(; i + 4 <= frames; i += 4) {
+        __m128i l, r;
+        decorrelate4_sse41(assignment, _mm_loadu_si128((const __m128i*)(ch0 + i)), _mm_loadu_si128((const __m128i*)(ch1 + i)),
+            w0, w1, u, uw0, uw1, &l, &r);
+        //top 16 bits always fit, so the saturating pack is exact
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi32(l, r), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi32(l, r), 16);
+        _mm_storeu_si128((__m128i*)(out + i * 2), _mm_packs_epi32(lo, hi));
+    }
+    for(; i < frames; i++) {
+        int32_t l, r;
+        decorrelate_scalar(assignment, ch0[i], ch1[i], wasted0, wasted1, unused, &l, &r);
+        out[i * 2] = (int16_t)(l >> 16);
+        out[i * 2 + 1] = (int16_t)(r >> 16);
+    }
+}
+
+static const flac_simd_t simd_sse41 = {
+    "sse4.1",
+    lpc_restore_32_sse41,
+    lpc_restore_64_sse41,
+    decorrelate_s32_sse41,
+    decorrelate_s16_sse41
+};
+
+/* AVX2 */
+
+TARGET_AVX2 static void lpc_restore_64_avx2(int32_t *s, uint32_t count, uint32_t order, int32_t shift, const int32_t *c)
+{
+    int32_t cp[COEF_PAD] = {0};
+    __m256i cv[FLAC_SIMD_MAX_ORDER];
+    memcpy(cp, c, order * sizeof(int32_t));
+    for(uint32_t d = 0; d < order; d++)
+        cv[d] = _mm256_set_epi64x(cp[d + 3], cp[d + 2], cp[d + 1], cp[d]);
+    uint32_t i = order;
+    for(; i + 4 <= count; i += 4) {
+        int64_t p[4];
+        __m256i sum = _mm256_setzero_si256();
+        for(uint32_t d = 0; d < order; d++)
+            sum = _mm256_add_epi64(sum, _mm256_mul_epi32(_mm256_set1_epi32(s[i - 1 - d]), cv[d]));
+        _mm256_storeu_si256((__m256i*)p, sum);
+        resolve_64(s + i, p, 4, shift, cp);
+    }
+    restore_64_scalar(s, i, count, order, shift, c);
+}
+
+TARGET_AVX2 static inline void decorrelate8_avx2(int assignment, __m256i a, __m256i b, __m128i w0, __m128i w1, __m128i u, __m128i uw0, __m128i uw1, __m256i *l, __m256i *r)
+{
+    switch(assignment) {
+        case FLAC_STEREO_LEFT_SIDE:
+            *l = _mm256_sll_epi32(a, uw0);
+            *r = _mm256_sub_epi32(*l, _mm256_sll_epi32(b, uw1));
+            break;
+        case FLAC_STEREO_RIGHT_SIDE:
+            *r = _mm256_sll_epi32(b, uw1);
+            *l = _mm256_add_epi32(*r, _mm256_sll_epi32(a, uw0));
+            break;
+        case FLAC_STEREO_MID_SIDE: {
+            __m256i side = _mm256_sll_epi32(b, w1);
+            __m256i mid = _mm256_or_si256(_mm256_slli_epi32(_mm256_sll_epi32(a, w0), 1), _mm256_and_si256(side, _mm256_set1_epi32(1)));
+            *l = _mm256_sll_epi32(_mm256_srai_epi32(_mm256_add_epi32(mid, side), 1), u);
+            *r = _mm256_sll_epi32(_mm256_srai_epi32(_mm256_sub_epi32(mid, side), 1), u);
+            break;
+        }
+        default:
+            *l = _mm256_sll_epi32(a, uw0);
+            *r = _mm256_sll_epi32(b, uw1);
+            break;
+    }
+}
+
+TARGET_AVX2 static void decorrelate_s32_avx2(int assignment, const int32_t *ch0, const int32_t *ch1, int wasted0, int wasted1, int unused, size_t frames, int32_t *out)
+{
+    __m128i w0 = _mm_cvtsi32_si128(wasted0), w1 = _mm_cvtsi32_si128(wasted1), u = _mm_cvtsi32_si128(unused);
+    __m128i uw0 = _mm_cvtsi32_si128(unused + wasted0), uw1 = _mm_cvtsi32_si128(unused + wasted1);
+    size_t i = 0;
+    for(; i + 8 <= frames; i += 8) {
+        __m256i l, r;
+        decorrelate8_avx2(assignment, _mm256_loadu_si256((const __m256i*)(ch0 + i)), _mm256_loadu_si256((const __m256i*)(ch1 + i)),
+            w0, w1, u, uw0, uw1, &l, &r);
+        //unpack works per 128-bit lane, so swap the middle quarters back
+        __m256i lo = _mm256_unpacklo_epi32(l, r);
+        __m256i hi = _mm256_unpackhi_epi32(l, r);
+        _mm256_storeu_si256((__m256i*)(out + i * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(out + i * 2 + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    for(; i < frames; i++)
+        decorrelate_scalar(assignment, ch0[i], ch1[i], wasted0, wasted1, unused, out + i * 2, out + i * 2 + 1);
+}
+
+TARGET_AVX2 static void decorrelate_s16_avx2(int assignment, const int32_t *ch0, const int32_t *ch1, int wasted0, int wasted1, int unused, size_t frames, int16_t *out)
+{
+    __m128i w0 = _mm_cvtsi32_si128(wasted0), w1 = _mm_cvtsi32_si128(wasted1), u = _mm_cvtsi32_si128(unused);
+    __m128i uw0 = _mm_cvtsi32_si128(unused + wasted0), uw1 = _mm_cvtsi32_si128(unused + wasted1);
+    size_t i = 0;
+    for(; i + 8 <= frames; i += 8) {
+        __m256i l, r;
+        decorrelate8_avx2(assignment, _mm256_loadu_si256((const __m256i*)(ch0 + i)), _mm256_loadu_si256((const __m256i*)(ch1 + i)),
+            w0, w1, u, uw0, uw1, &l, &r);
+        //the per-lane unpack and pack cancel out, leaving the frames in order
+        __m256i lo = _mm256_srai_epi32(_mm256_unpacklo_epi32(l, r), 16);
+        __m256i hi = _mm256_srai_epi32(_mm256_unpackhi_epi32(l, r), 16);
+        _mm256_storeu_si256((__m256i*)(out + i * 2), _mm256_packs_epi32(lo, hi));
+    }
+    for(; i < frames; i++) {
+        int32_t l, r;
+        decorrelate_scalar(assignment, ch0[i], ch1[i], wasted0, wasted1, unused, &l, &r);
+        out[i * 2] = (int16_t)(l >> 16);
+        out[i * 2 + 1] = (int16_t)(r >> 16);
+    }
+}
+
+static const flac_simd_t simd_avx2 = {
+    "avx2",
+    //blocks of 8 leave too long a serial tail in resolve_32, 4 wide is faster
+    lpc_restore_32_sse41,
+    lpc_restore_64_avx2,
+    decorrelate_s32_avx2,
+    decorrelate_s16_avx2
+};
+
+static const flac_simd_t *select_simd(void)
+{
+    int features = cpu_features();
+    if(features & CPU_FEATURE_AVX2) return &simd_avx2;
+    if(features & CPU_FEATURE_SSE41) return &simd_sse41;
+    return NULL;
+}
+
+#else
+
+static const flac_simd_t *select_simd(void)
+{
+    return NULL;
+}
+
+#endif
+
+const flac_simd_t *flac_simd = NULL;
+
+const flac_simd_t *flac_simd_init(void)
+{
+    //every caller selects the same table, so racing here is harmless
+    const flac_simd_t *selected = select_simd();
+    flac_simd = selected;
+    return selected;
+}
@@ -0,0 +1,42 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//FLAC SIMD
+//vector LPC restoration and stereo decorrelation for dr_flac, picked at runtime from the CPU features
+//integer only, so the output is identical to the scalar decoder
+#ifndef _FLAC_SIMD_H_
+#define _FLAC_SIMD_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLAC_SIMD_MAX_ORDER 32
+//below this the per-sample scalar prediction is faster than restoring a block
+#define FLAC_SIMD_MIN_ORDER 9
+
+//channel assignment codes from the FLAC frame header
+#define FLAC_STEREO_INDEPENDENT 1
+#define FLAC_STEREO_LEFT_SIDE 8
+#define FLAC_STEREO_RIGHT_SIDE 9
+#define FLAC_STEREO_MID_SIDE 10
+
+typedef struct {
+    const char *name;
+    //samples[0, order) hold the warm-up samples and samples[order, count) the residuals,
+    //which are replaced by samples[i] += (sum of coefficients[j] * samples[i-1-j]) >> shift
+    //restore_32 sums in 32 bits (<= 16 bits per sample), restore_64 in 64 bits
+    void (*lpc_restore_32)(int32_t *samples, uint32_t count, uint32_t order, int32_t shift, const int32_t *coefficients);
+    void (*lpc_restore_64)(int32_t *samples, uint32_t count, uint32_t order, int32_t shift, const int32_t *coefficients);
+    //undoes the stereo assignment and interleaves left-justified samples,
+    //wasted0/wasted1 are the per-subframe wasted bits and unused is 32 - bitsPerSample
+    void (*decorrelate_s32)(int assignment, const int32_t *ch0, const int32_t *ch1, int wasted0, int wasted1, int unused, size_t frames, int32_t *out);
+    //as above, keeping the top 16 bits of each sample
+    void (*decorrelate_s16)(int assignment, const int32_t *ch0, const int32_t *ch1, int wasted0, int wasted1, int unused, size_t frames, int16_t *out);
+} flac_simd_t;
+
+//NULL when there is nothing faster than the scalar code
+extern const flac_simd_t *flac_simd;
+//Selects the kernels for this CPU, safe to call more than once
+const flac_simd_t *flac_simd_init(void);
+
+#endif
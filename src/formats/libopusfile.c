@@ -11,6 +11,7 @@
 #define dynlib_t void*
 #define OPEN_LIBRARY dlopen("libopusfile.so.0", RTLD_NOW);
 #endif
+#include "../threads.h"
 
 typedef OggOpusFile* (*P_op_open_callbacks)(void*,const OpusFileCallbacks*,const unsigned char*,size_t,int*);
 static P_op_open_callbacks _op_open_callbacks;
@@ -124,6 +125,20 @@ int op_read_stereo(OggOpusFile *_of, int16_t *_pcm, int _buf_size)
     return _op_read_stereo(_of, _pcm, _buf_size);
 }
 
+typedef int (*P_op_read_float)(OggOpusFile*,float*,int,int*);
+static P_op_read_float _op_read_float;
+int op_read_float(OggOpusFile *_of, float *_pcm, int _buf_size, int *_li)
+{
+    return _op_read_float(_of, _pcm, _buf_size, _li);
+}
+
+typedef int (*P_op_read_float_stereo)(OggOpusFile*,float*,int);
+static P_op_read_float_stereo _op_read_float_stereo;
+int op_read_float_stereo(OggOpusFile *_of, float *_pcm, int _buf_size)
+{
+    return _op_read_float_stereo(_of, _pcm, _buf_size);
+}
+
 typedef int (*P_op_raw_seek)(OggOpusFile*,opus_int64);
 static P_op_raw_seek _op_raw_seek;
 
@@ -132,6 +147,14 @@ int op_raw_seek (OggOpusFile *_of, opus_int64 _byte_offset)
     return _op_raw_seek(_of, _byte_offset);
 }
 
+typedef int (*P_op_pcm_seek)(OggOpusFile*,ogg_int64_t);
+static P_op_pcm_seek _op_pcm_seek;
+
+int op_pcm_seek(OggOpusFile *_of, ogg_int64_t _pcm_offset)
+{
+    return _op_pcm_seek(_of, _pcm_offset);
+}
+
 typedef void (*P_op_free)(OggOpusFile*);
 static P_op_free _op_free;
 void op_free(OggOpusFile *_of)
@@ -139,20 +162,14 @@ void op_free(OggOpusFile *_of)
     _op_free(_of);
 }
 
-static int of_opened = 0;
+static ld_once_t of_once = LD_ONCE_INIT;
 static int of_open_result = 0;
 
-int libopusfile_Open(void)
+static void libopusfile_Load(void)
 {
-    /* Only attempt to load libopusfile once */
-    if(of_opened) {
-        return of_open_result;
-    }
-    of_opened = 1;
     dynlib_t library = OPEN_LIBRARY;
     if(!library) {
-        of_open_result = 0;
-        return 0;
+        return;
     }
     /* load symbols */
     _op_open_callbacks = (P_op_open_callbacks)dlsym(library, "op_open_callbacks");
@@ -170,7 +187,22 @@ int libopusfile_Open(void)
     _op_bitrate_instant = (P_op_bitrate_instant)dlsym(library, "op_bitrate_instant");
     _op_read = (P_op_read)dlsym(library, "op_read");
     _op_read_stereo = (P_op_read_stereo)dlsym(library, "op_read_stereo");
+    _op_read_float = (P_op_read_float)dlsym(library, "op_read_float");
+    _op_read_float_stereo = (P_op_read_float_stereo)dlsym(library, "op_read_float_stereo");
     _op_free = (P_op_free)dlsym(library, "op_free");
     _op_raw_seek = (P_op_raw_seek)dlsym(library, "op_raw_seek");
-    return 1;
+    _op_pcm_seek = (P_op_pcm_seek)dlsym(library, "op_pcm_seek");
+    /* Only publish success once every symbol is resolved */
+    of_open_result = _op_open_callbacks && _op_fdopen && _op_open_file &&
+        _op_pcm_tell && _op_raw_tell && _op_pcm_total && _op_raw_total &&
+        _op_head && _op_seekable && _op_channel_count && _op_current_link &&
+        _op_link_count && _op_bitrate_instant && _op_read && _op_read_stereo &&
+        _op_read_float && _op_read_float_stereo && _op_free && _op_raw_seek && _op_pcm_seek;
+}
+
+int libopusfile_Open(void)
+{
+    /* Only attempt to load libopusfile once, other threads wait for it */
+    once_call(&of_once, libopusfile_Load);
+    return of_open_result;
 }
@@ -94,7 +94,13 @@ int op_read(OggOpusFile *_of, int16_t *pcm, int _buf_size, int *_li);
 
 int op_read_stereo(OggOpusFile *_of, int16_t *_pcm, int _buf_size);
 
+int op_read_float(OggOpusFile *_of, float *_pcm, int _buf_size, int *_li);
+
+int op_read_float_stereo(OggOpusFile *_of, float *_pcm, int _buf_size);
+
 int op_raw_seek (OggOpusFile *_of, opus_int64 _byte_offset);
 
+int op_pcm_seek(OggOpusFile *_of, ogg_int64_t _pcm_offset);
+
 void op_free(OggOpusFile *_of);
 #endif
@@ -5,9 +5,12 @@
 #include <lancerdecode.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "../formats.h"
 #include "../logging.h"
 #include "../properties.h"
+#include "../convert.h"
+#include "../stream.h"
 
 #define DR_MP3_IMPLEMENTATION
 #define DR_MP3_NO_STDIO
@@ -24,6 +27,12 @@ typedef struct {
 	int currentFrames;
 	int totalFrames;
 	int trimFrames;
+	int isFloat; //drmp3 decodes to float, only s16 output is converted
+	drmp3_seek_point seekPoints[2]; //trim start then loop start, bound to dec
+	int hasTrimPoint;
+	int hasLoopPoint;
+	ld_allocator_t alloc;
+	ld_allocator_t bufferAlloc;
 } mp3_userdata_t;
 
 
@@ -44,30 +53,40 @@ drmp3_bool32 seek_stream_drmp3(void *pUserData, int offset, drmp3_seek_origin or
 	else
 		return DRMP3_TRUE;
 }
+//userdata, the RIFF wrapper and output streams, drmp3's input buffer and the float buffer
+#define MP3_ARENA_SIZE (PCMSTREAM_ARENA_SIZE + 2 * STREAM_ARENA_SIZE + sizeof(mp3_userdata_t) + \
+	DRMP3_DATA_CHUNK_SIZE + MP3_BUFFER_SIZE * 2)
+
 size_t mp3_read(void* ptr, size_t size, ld_stream_t stream)
 {
 	mp3_userdata_t *userdata = (mp3_userdata_t*)stream->userData;
 	int sz_bytes = (int)(size);
-	if((sz_bytes % 2) != 0) {
-		LOG_S_ERROR(userdata->pcm, "mp3_read: buffer size must be a multiple of sizeof(short)");
+	int sampleSize = userdata->isFloat ? sizeof(float) : sizeof(short);
+	if((sz_bytes % sampleSize) != 0) {
+		LOG_S_ERROR(userdata->pcm, "mp3_read: buffer size must be a multiple of the sample size");
 		return 0;
 	}
 
-	int requestedFrames = sz_bytes / (2 * userdata->dec.channels);
+	int requestedFrames = sz_bytes / (sampleSize * userdata->dec.channels);
 	if(userdata->totalFrames != -1 && ((requestedFrames + userdata->currentFrames) > userdata->totalFrames)) {
 		requestedFrames = userdata->totalFrames - userdata->currentFrames;
 		if(requestedFrames <= 0) {
 			return (size_t)0;
 		}
 	}
+	if(userdata->isFloat) {
+		drmp3_uint64 fcount = drmp3_read_pcm_frames_f32(&userdata->dec, (drmp3_uint64)requestedFrames, (float*)ptr);
+		userdata->currentFrames += (int)fcount;
+		return (size_t)(fcount * userdata->dec.channels * sizeof(float));
+	}
 	int floatsz = requestedFrames * userdata->dec.channels * sizeof(float);
-	if(userdata->floatBufferSize != floatsz) {
-		if(userdata->floatBuffer) free(userdata->floatBuffer);
-		userdata->floatBuffer = malloc(floatsz);
+	if(userdata->floatBufferSize < floatsz) {
+		mem_free(&userdata->bufferAlloc, userdata->floatBuffer);
+		userdata->floatBuffer = mem_alloc(&userdata->bufferAlloc, floatsz);
 		userdata->floatBufferSize = floatsz;
 	}
 	drmp3_uint64 fcount = drmp3_read_pcm_frames_f32(&userdata->dec, (drmp3_uint64)requestedFrames, (float*)userdata->floatBuffer);
-	drmp3dec_f32_to_s16((float*)userdata->floatBuffer, (drmp3_int16*)ptr, (int)(fcount * userdata->dec.channels));
+	convert_f32_to_s16((float*)userdata->floatBuffer, (drmp3_int16*)ptr, (size_t)(fcount * userdata->dec.channels));
 	userdata->currentFrames += (int)fcount;
 	return (size_t)(fcount * userdata->dec.channels * 2);
 }
@@ -83,13 +102,105 @@ int mp3_seek(ld_stream_t stream, int32_t offset, LDSEEK origin)
 	return 0;	
 }
 
+static int mp3_seekframe(ld_pcmstream_t pcm, int64_t frame)
+{
+	mp3_userdata_t *userdata = (mp3_userdata_t*)pcm->_internal->seeker.data;
+	int64_t target = frame + userdata->trimFrames;
+	if(userdata->totalFrames != -1 && target > userdata->totalFrames) {
+		return -1;
+	}
+	if(!drmp3_seek_to_pcm_frame(&userdata->dec, (drmp3_uint64)target)) {
+		return -1;
+	}
+	userdata->currentFrames = (int)target;
+	return 0;
+}
+
+static int64_t mp3_tellframe(ld_pcmstream_t pcm)
+{
+	mp3_userdata_t *userdata = (mp3_userdata_t*)pcm->_internal->seeker.data;
+	return userdata->currentFrames - userdata->trimFrames;
+}
+
+//Without a seek table drmp3 seeks backwards by decoding from the start of the
+//file. Walk the frame headers once to find the frame holding target, so later
+//seeks to it only decode the bit reservoir pre-roll. Returns 0 when target is
+//within the pre-roll and is reached just as quickly from the start
+static int mp3_findpoint(mp3_userdata_t *userdata, drmp3_uint64 target, drmp3_seek_point *point)
+{
+	drmp3 *dec = &userdata->dec;
+	drmp3__seeking_mp3_frame_info info[DRMP3_SEEK_LEADING_MP3_FRAMES + 1];
+	drmp3_uint64 running = 0;
+	float fractional = 0;
+	int count = 0;
+	if(!drmp3_seek_to_start_of_stream(dec)) {
+		return 0;
+	}
+	for(;;) {
+		int slot = count;
+		if(count > DRMP3_SEEK_LEADING_MP3_FRAMES) {
+			memmove(&info[0], &info[1], sizeof(info[0]) * DRMP3_SEEK_LEADING_MP3_FRAMES);
+			slot = DRMP3_SEEK_LEADING_MP3_FRAMES;
+		}
+		info[slot].bytePos = dec->streamCursor - dec->dataSize;
+		info[slot].pcmFrameIndex = running;
+		//no pcm output, only the headers are parsed and the reservoir saved
+		drmp3_uint32 frames = drmp3_decode_next_frame_ex(dec, NULL);
+		if(!frames) {
+			return 0;
+		}
+		drmp3__accumulate_running_pcm_frame_count(dec, frames, &running, &fractional);
+		count++;
+		if(count > DRMP3_SEEK_LEADING_MP3_FRAMES && target < running) {
+			if(target < info[DRMP3_SEEK_LEADING_MP3_FRAMES - 1].pcmFrameIndex) {
+				return 0;
+			}
+			point->seekPosInBytes = info[0].bytePos;
+			point->pcmFrameIndex = target;
+			point->mp3FramesToDiscard = DRMP3_SEEK_LEADING_MP3_FRAMES;
+			point->pcmFramesToDiscard = (drmp3_uint16)(target - info[DRMP3_SEEK_LEADING_MP3_FRAMES - 1].pcmFrameIndex);
+			return 1;
+		}
+	}
+}
+
+//drmp3 wants the table sorted, the loop start is never before the trim
+static void mp3_bindpoints(mp3_userdata_t *userdata)
+{
+	int count = userdata->hasTrimPoint + userdata->hasLoopPoint;
+	drmp3_seek_point *first = &userdata->seekPoints[userdata->hasTrimPoint ? 0 : 1];
+	drmp3_bind_seek_table(&userdata->dec, count, count ? first : NULL);
+}
+
+//Positions the decoder at the trimmed start, binding it as a seek point so
+//rewinds don't decode everything before it again
+static void mp3_seektrim(mp3_userdata_t *userdata)
+{
+	drmp3_uint64 target = (drmp3_uint64)userdata->trimFrames;
+	userdata->hasTrimPoint = target > 0 && mp3_findpoint(userdata, target, &userdata->seekPoints[0]);
+	mp3_bindpoints(userdata);
+	drmp3_seek_to_pcm_frame(&userdata->dec, target);
+	userdata->currentFrames = userdata->trimFrames;
+}
+
+static void mp3_markframe(ld_pcmstream_t pcm, int64_t frame)
+{
+	mp3_userdata_t *userdata = (mp3_userdata_t*)pcm->_internal->seeker.data;
+	drmp3_uint64 target = (drmp3_uint64)(frame + userdata->trimFrames);
+	userdata->hasLoopPoint = mp3_findpoint(userdata, target, &userdata->seekPoints[1]);
+	mp3_bindpoints(userdata);
+	drmp3_seek_to_pcm_frame(&userdata->dec, (drmp3_uint64)userdata->currentFrames);
+}
+
 void mp3_close(ld_stream_t stream)
 {
 	mp3_userdata_t *userdata = (mp3_userdata_t*)stream->userData;
+	ld_allocator_t alloc = userdata->alloc;
+	drmp3_uninit(&userdata->dec);
 	userdata->baseStream->close(userdata->baseStream);
-	if(userdata->floatBuffer) free(userdata->floatBuffer);
-	free(userdata);
-	free(stream);
+	mem_free(&alloc, userdata->floatBuffer);
+	mem_free(&alloc, userdata);
+	mem_free(&alloc, stream);
 }
 
 static int xing_offsets[] = {
@@ -118,12 +229,19 @@ static int read_bigendian(ld_stream_t stream, uint32_t* value)
         (uint32_t)np[3];
 	return 1;
 }
-static void mp3_readheader(ld_stream_t stream, int *trimStart, int *totalLength)
+void mp3_readheader(ld_stream_t stream, int *trimStart, int *totalLength)
 {
 	unsigned char header[4];
 	if(stream->read(header, 4, stream) < 4) {
 		return; //read failed
 	}
+	mp3_readheader_from(stream, header, trimStart, totalLength);
+}
+
+void mp3_readheader_from(ld_stream_t stream, const unsigned char *first, int *trimStart, int *totalLength)
+{
+	unsigned char header[4];
+	memcpy(header, first, 4);
 	// check mpeg header
 	if((((header[0] & 0xFF) << 8)  | ((header[1] & 0xE0))) != 0xFFE0)  {
 		return;
@@ -184,71 +302,227 @@ static void mp3_readheader(ld_stream_t stream, int *trimStart, int *totalLength)
 	*totalLength = (int)((numFrames * samplesPerFrame) - pad - delay);
 }
 
-ld_pcmstream_t mp3_getstream(ld_stream_t stream, ld_options_t options, const char **error, int decodeChannels, int decodeRate, int trimFrames, int totalFrames)
+static const int mp3_bitrates[2][3][15] = {
+	{ //mpeg 1
+		{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+		{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+		{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 }
+	},
+	{ //mpeg 2 + 2.5
+		{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+		{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+		{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+	}
+};
+
+static const int mp3_samplerates[3] = { 44100, 48000, 32000 };
+
+//Parses a 4 byte frame header, returns 0 if not a valid (non free-format) header
+int mp3_parseframe(const unsigned char *h, mp3_frameinfo_t *frame)
+{
+	if(h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) return 0;
+	int version = (h[1] >> 3) & 0x3; //0 = 2.5, 2 = 2, 3 = 1
+	int layer = 4 - ((h[1] >> 1) & 0x3); //1, 2, 3 (4 = reserved)
+	int bitrateIndex = h[2] >> 4;
+	int rateIndex = (h[2] >> 2) & 0x3;
+	int padding = (h[2] >> 1) & 0x1;
+	if(version == 1 || layer == 4 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3)
+		return 0;
+	int lsf = version != 3;
+	int bitrate = mp3_bitrates[lsf][layer - 1][bitrateIndex] * 1000;
+	int rate = mp3_samplerates[rateIndex] >> lsf;
+	if(version == 0) rate >>= 1;
+	frame->channels = ((h[3] >> 6) & 0x3) == 0x3 ? 1 : 2;
+	frame->frequency = rate;
+	if(layer == 1) {
+		frame->samples = 384;
+		frame->size = (12 * bitrate / rate + padding) * 4;
+	} else if (layer == 2 || !lsf) {
+		frame->samples = 1152;
+		frame->size = 144 * bitrate / rate + padding;
+	} else {
+		frame->samples = 576;
+		frame->size = 72 * bitrate / rate + padding;
+	}
+	return 1;
+}
+
+//Skips an ID3v2 tag if present, leaving the stream at the first frame
+static int mp3_skipid3(ld_stream_t stream)
+{
+	unsigned char id3[10];
+	if(stream->read(id3, 10, stream) < 10) {
+		return 0;
+	}
+	if(memcmp(id3, "ID3", 3)) {
+		return !stream->seek(stream, -10, LDSEEK_CUR);
+	}
+	int32_t size = ((id3[6] & 0x7F) << 21) |
+		((id3[7] & 0x7F) << 14) |
+		((id3[8] & 0x7F) << 7) |
+		(id3[9] & 0x7F);
+	if(id3[5] & 0x10) size += 10; //footer
+	return !stream->seek(stream, size, LDSEEK_CUR);
+}
+
+int mp3_probe(ld_stream_t stream, ld_probe_info_t *info)
 {
-	mp3_userdata_t *userdata = (mp3_userdata_t*)malloc(sizeof(mp3_userdata_t));
-    memset((void*)userdata, 0, sizeof(mp3_userdata_t));
 	int mp3Start = -1;
 	int mp3Length = -1;
 	mp3_readheader(stream, &mp3Start, &mp3Length);
 	stream->seek(stream, 0, LDSEEK_SET);
-	if(!drmp3_init(&userdata->dec,read_stream_drmp3,seek_stream_drmp3,(void*)stream, NULL)) {
+	if(!mp3_skipid3(stream)) {
+		return 0;
+	}
+	unsigned char header[4];
+	mp3_frameinfo_t frame;
+	if(stream->read(header, 4, stream) < 4 || !mp3_parseframe(header, &frame)) {
+		return 0;
+	}
+	if(!info->container) info->container = "mp3";
+	info->codec = "mp3";
+	info->channels = frame.channels;
+	info->frequency = frame.frequency;
+	if(mp3Start != -1 && mp3Length != -1) {
+		info->mp3Trim = mp3Start;
+		info->mp3Samples = mp3Length;
+	}
+	if(info->flTrim != -1) {
+		info->totalFrames = info->flSamples;
+	} else if (!strcmp(info->container, "mp3") && mp3Start != -1 && mp3Length != -1) {
+		info->totalFrames = mp3Length;
+	} else {
+		//No length information, walk the frame headers
+		int64_t totalFrames = 0;
+		do {
+			totalFrames += frame.samples;
+			if(stream->seek(stream, frame.size - 4, LDSEEK_CUR))
+				break;
+		} while (stream->read(header, 4, stream) == 4 && mp3_parseframe(header, &frame));
+		info->totalFrames = totalFrames;
+	}
+	return 1;
+}
+
+int32_t mp3_score(const unsigned char *peek, int32_t peekSize, void *userdata)
+{
+	int format = riff_peekformat(peek, peekSize);
+	if(format >= 0) {
+		//WAVE files with the fmt chunk out of the peek buffer are left to pcm
+		return format == WAVE_FORMAT_MP3 ? LD_SCORE_MAX : 0;
+	}
+	if(peekSize >= 3 && !memcmp(peek, "ID3", 3)) {
+		return LD_SCORE_MAX;
+	}
+	//a frame sync is only two bytes, let any stronger match win
+	if(peekSize >= 4 && drmp3_hdr_valid(peek)) {
+		return LD_SCORE_MAX / 2;
+	}
+	return 0;
+}
+
+void mp3_global_init(void)
+{
+	//dr_mp3 caches the SSE2 check in a static on first use
+#if DRMP3_HAVE_SIMD
+	drmp3_have_simd();
+#endif
+}
+
+ld_pcmstream_t mp3_getstream(ld_stream_t stream, ld_options_t options, const char **error, const ld_header_t *header)
+{
+	int decodeChannels = -1;
+	int decodeRate = -1;
+	int trimFrames = -1;
+	int totalFrames = -1;
+	if(header->kind == LD_HEADER_RIFF_MP3) {
+		decodeChannels = header->riff.numChannels;
+		decodeRate = header->riff.sampleRate;
+		trimFrames = header->riff.trimFrames;
+		totalFrames = header->riff.totalFrames;
+	}
+	int mp3Start = header->mp3Start;
+	int mp3Length = header->mp3Length;
+	ld_allocator_t alloc = options_allocator(options);
+	ld_arena_t *arena = arena_create(&alloc, MP3_ARENA_SIZE);
+	if(!arena) {
+		LOG_O_ERROR(options, "mp3: out of memory");
+		*error = "Out of memory";
+		return NULL;
+	}
+	alloc = arena_allocator(arena, ARENA_OVERHEAD);
+	if(header->kind == LD_HEADER_RIFF_MP3) {
+		stream = stream_wrap(stream, header->riff.dataSize, 1, &alloc);
+	}
+	ld_allocator_t decoder = arena_allocator(arena, ARENA_DECODER);
+	drmp3_allocation_callbacks callbacks;
+	callbacks.pUserData = decoder.userdata;
+	callbacks.onMalloc = decoder.malloc;
+	callbacks.onRealloc = decoder.realloc;
+	callbacks.onFree = decoder.free;
+	//mostly the drmp3 object
+	mp3_userdata_t *userdata = (mp3_userdata_t*)mem_alloc(&decoder, sizeof(mp3_userdata_t));
+    memset((void*)userdata, 0, sizeof(mp3_userdata_t));
+	userdata->alloc = alloc;
+	userdata->bufferAlloc = arena_allocator(arena, ARENA_BUFFERS);
+	if(!drmp3_init(&userdata->dec,read_stream_drmp3,seek_stream_drmp3,(void*)stream, &callbacks)) {
 		LOG_O_ERROR(options, "drmp3_init failed!");
 		*error = "drmp3_init failed";
-		free(userdata);
+		arena_destroy(arena);
 		return NULL;
 	}
 	userdata->baseStream = stream;
 	userdata->floatBuffer = NULL;
 	userdata->floatBufferSize = -1;
 	userdata->trimFrames = (trimFrames == -1 ? 0 : trimFrames);
+	userdata->isFloat = options_float(options);
 	userdata->totalFrames = totalFrames;
 
-	ld_stream_t decodeStream = ld_stream_new();
+	ld_stream_t decodeStream = stream_new(&alloc);
 	decodeStream->userData = (void*)userdata;
 	decodeStream->read = mp3_read;
 	decodeStream->seek = mp3_seek;
 	decodeStream->close = mp3_close;
 	if(trimFrames != -1) {
-		drmp3_seek_to_pcm_frame(&userdata->dec, (drmp3_uint64)(trimFrames));
-		userdata->currentFrames = trimFrames;
+		mp3_seektrim(userdata);
 		userdata->totalFrames += trimFrames;
 	} else if(
 		decodeChannels == -1 
 		&& mp3Start != -1 
 		&& mp3Length != -1) 
 	{
-		drmp3_seek_to_pcm_frame(&userdata->dec, (drmp3_uint64)(mp3Start));
 		userdata->trimFrames = mp3Start;
-		userdata->currentFrames = mp3Start;
+		mp3_seektrim(userdata);
 		userdata->totalFrames = mp3Length + mp3Start;
 	}
-	ld_pcmstream_t retsound = pcmstream_init(options);
+	ld_pcmstream_t retsound = pcmstream_init(options, arena);
 	userdata->pcm = retsound;
 	retsound->dataSize = -1;
-	if(userdata->dec.channels == 2) {
-		retsound->format = LDFORMAT_STEREO16;
-		//RIFF fact chunk needs channels
-	} else {
-		retsound->format = LDFORMAT_MONO16;
-	}
+	pcmstream_set_format(retsound, userdata->dec.channels, userdata->isFloat);
 	retsound->frequency = (int32_t)userdata->dec.sampleRate;
 	retsound->stream = decodeStream;
-	retsound->blockSize = MP3_BUFFER_SIZE;
-    set_property_string(retsound, LD_PROPERTY_CONTAINER, decodeChannels == -1 ? "mp3" : "wav");
-    set_property_string(retsound, LD_PROPERTY_CODEC, "mp3");
+	retsound->blockSize = MP3_BUFFER_SIZE * (userdata->isFloat ? 2 : 1);
+	retsound->_internal->seeker.seek = &mp3_seekframe;
+	retsound->_internal->seeker.tell = &mp3_tellframe;
+	retsound->_internal->seeker.mark = &mp3_markframe;
+	retsound->_internal->seeker.data = userdata;
+    set_property_string(retsound, LD_PROPERTY_ID_CONTAINER, decodeChannels == -1 ? "mp3" : "wav");
+    set_property_string(retsound, LD_PROPERTY_ID_CODEC, "mp3");
 	if(trimFrames != -1 && totalFrames != -1) {
 		if(userdata->dec.sampleRate != decodeRate ||
 		   userdata->dec.channels != decodeChannels) {
 			LOG_O_ERROR(options, "wav container for mp3 stream has incorrect fmt chunk");
 		} else {
-			set_property_int(retsound, LD_PROPERTY_FL_TRIM, trimFrames);
-			set_property_int(retsound, LD_PROPERTY_FL_SAMPLES, totalFrames);
+			set_property_int(retsound, LD_PROPERTY_ID_FL_TRIM, trimFrames);
+			set_property_int(retsound, LD_PROPERTY_ID_FL_SAMPLES, totalFrames);
 		}
 	}
+	if(header->kind == LD_HEADER_RIFF_MP3) {
+		riff_setloop(retsound, &header->riff);
+	}
 	if(mp3Start != -1 && mp3Length != -1) {
-		set_property_int(retsound, LD_PROPERTY_MP3_TRIM, mp3Start);
-		set_property_int(retsound, LD_PROPERTY_MP3_SAMPLES, mp3Length);
+		set_property_int(retsound, LD_PROPERTY_ID_MP3_TRIM, mp3Start);
+		set_property_int(retsound, LD_PROPERTY_ID_MP3_SAMPLES, mp3Length);
 	}
 	return retsound;
 }
@@ -1,9 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "../formats.h"
 #include "libopusfile.h"
 #include "../logging.h"
 #include "../properties.h"
+#include "../stream.h"
+#include "../ogg.h"
 
 #define OPUS_BUFFER_SIZE 32768
 
@@ -28,13 +31,6 @@ static int64_t libopus_stream_tell(void *_stream)
     return (int64_t)ld->tell(ld);
 }
 
-static int libopus_stream_close(void *_stream)
-{
-    ld_stream_t ld = (ld_stream_t)_stream;
-    ld->close(ld);
-    return 0;
-}
-
 const char *libopus_strerror(int err)
 {
 	switch(err) {
@@ -63,29 +59,93 @@ const char *libopus_strerror(int err)
 
 typedef struct opus_userdata {
     OggOpusFile *opus;
+    ld_stream_t source;
     int channels;
+    int stereo; //downmixed by libopusfile
+    int isFloat;
+    int link; //link of a chained file the last read came from
     int eof;
     ld_pcmstream_t pcm;
+    ld_allocator_t alloc;
 } opus_userdata_t;
 
+static void opus_setformat(opus_userdata_t *userdata)
+{
+    ld_pcmstream_t pcm = userdata->pcm;
+    if(!userdata->stereo) {
+        userdata->channels = op_channel_count(userdata->opus, userdata->link);
+    }
+    pcmstream_set_format(pcm, userdata->channels, userdata->isFloat);
+    //libopusfile returns up to 8 channels in the Vorbis order
+    const char *order = userdata->channels > 2 ? vorbis_channel_order(userdata->channels) : NULL;
+    if(order) {
+        set_property_string(pcm, LD_PROPERTY_ID_CHANNEL_ORDER, order);
+    } else {
+        clear_property(pcm, LD_PROPERTY_ID_CHANNEL_ORDER);
+    }
+}
+
+//link the next read returns frames from. op_current_link only moves on once
+//a read decoded from the next link, find the boundary from the link lengths
+static int opus_nextlink(opus_userdata_t *userdata)
+{
+    OggOpusFile *opus = userdata->opus;
+    int link = op_current_link(opus);
+    if(link < 0 || !op_seekable(opus) || link + 1 >= op_link_count(opus)) {
+        return link;
+    }
+    ogg_int64_t end = 0;
+    for(int i = 0; i <= link; i++) {
+        end += op_pcm_total(opus, i);
+    }
+    return op_pcm_tell(opus) >= end ? link + 1 : link;
+}
+
+static int opus_nextformat(ld_pcmstream_t pcm, int keep)
+{
+    opus_userdata_t *userdata = (opus_userdata_t*)pcm->_internal->seeker.data;
+    int link = opus_nextlink(userdata);
+    if(link < 0 || link == userdata->link) return 0;
+    if(keep && !userdata->stereo && op_channel_count(userdata->opus, link) != userdata->channels) {
+        return 1;
+    }
+    userdata->link = link;
+    opus_setformat(userdata);
+    pcmstream_link_changed(pcm, link);
+    return 0;
+}
+
 size_t opus_read(void* ptr, size_t size, ld_stream_t stream)
 {
     opus_userdata_t *userdata = (opus_userdata_t*)stream->userData;
     if(userdata->eof) return 0;
     size_t sz_bytes = size;
-	if((sz_bytes % 2) != 0) {
-		LOG_S_ERROR(userdata->pcm, "opus_read: buffer size must be a multiple of sizeof(short)");
+    int sampleSize = userdata->isFloat ? sizeof(float) : sizeof(short);
+	if((sz_bytes % sampleSize) != 0) {
+		LOG_S_ERROR(userdata->pcm, "opus_read: buffer size must be a multiple of the sample size");
 		return 0;
 	}
+    int samples = (int)(sz_bytes / sampleSize);
     while(!userdata->eof) {
         int framesRead = 0;
-        if(userdata->channels == 2) {
-            framesRead = op_read_stereo(userdata->opus, ptr, sz_bytes / 2);
+        if(userdata->isFloat) {
+            framesRead = userdata->stereo
+                ? op_read_float_stereo(userdata->opus, ptr, samples)
+                : op_read_float(userdata->opus, ptr, samples, NULL);
         } else {
-            framesRead = op_read(userdata->opus, ptr, sz_bytes / 2, NULL);
+            framesRead = userdata->stereo
+                ? op_read_stereo(userdata->opus, ptr, samples)
+                : op_read(userdata->opus, ptr, samples, NULL);
         }
         if(framesRead > 0) {
-            return framesRead * userdata->channels * 2;
+            //libopusfile never returns samples of two links from one call
+            int link = op_current_link(userdata->opus);
+            if(link != userdata->link) {
+                userdata->link = link;
+                opus_setformat(userdata);
+                pcmstream_link_changed(userdata->pcm, link);
+            }
+            return framesRead * userdata->channels * sampleSize;
         } else if (framesRead == OP_HOLE) {
             continue;
         } else {
@@ -95,6 +155,8 @@ size_t opus_read(void* ptr, size_t size, ld_stream_t stream)
     }
 }
 
+#define OPUS_ARENA_SIZE (PCMSTREAM_ARENA_SIZE + STREAM_ARENA_SIZE + sizeof(opus_userdata_t))
+
 int opus_seek(ld_stream_t stream, int32_t offset, LDSEEK origin)
 {
     opus_userdata_t *userdata = (opus_userdata_t*)stream->userData;
@@ -106,12 +168,37 @@ int opus_seek(ld_stream_t stream, int32_t offset, LDSEEK origin)
     return op_raw_seek(userdata->opus, 0);
 }
 
+static int opus_seekframe(ld_pcmstream_t pcm, int64_t frame)
+{
+    opus_userdata_t *userdata = (opus_userdata_t*)pcm->_internal->seeker.data;
+    if(op_pcm_seek(userdata->opus, frame)) {
+        return -1;
+    }
+    userdata->eof = 0;
+    return 0;
+}
+
+static int64_t opus_tellframe(ld_pcmstream_t pcm)
+{
+    opus_userdata_t *userdata = (opus_userdata_t*)pcm->_internal->seeker.data;
+    return op_pcm_tell(userdata->opus);
+}
+
 void opus_close(ld_stream_t stream)
 {
 	opus_userdata_t *userdata = (opus_userdata_t*)stream->userData;
+	ld_allocator_t alloc = userdata->alloc;
 	op_free(userdata->opus);
-	free(userdata);
-	free(stream);
+	userdata->source->close(userdata->source);
+	mem_free(&alloc, userdata);
+	mem_free(&alloc, stream);
+}
+
+int32_t opus_score(const unsigned char *peek, int32_t peekSize, void *userdata)
+{
+    size_t length;
+    const unsigned char *packet = ogg_first_packet(peek, peekSize, &length);
+    return packet && length >= 8 && !memcmp(packet, "OpusHead", 8) ? LD_SCORE_MAX : 0;
 }
 
 ld_pcmstream_t opus_getstream(ld_stream_t stream, ld_options_t options, const char **error)
@@ -125,15 +212,21 @@ ld_pcmstream_t opus_getstream(ld_stream_t stream, ld_options_t options, const ch
         .read = libopus_stream_read,
         .seek = libopus_stream_seek,
         .tell = libopus_stream_tell,
-        .close = libopus_stream_close
+        //opus_close closes the stream, a failed open leaves it to the caller
+        .close = NULL
     };
 
+    //libopusfile opens sources without a seek callback unseekable,
+    //forward-only streams fail the seek to the end
+    int32_t start = stream->tell(stream);
+    if(stream->seek(stream, 0, LDSEEK_END)) cb.seek = NULL;
+    else stream->seek(stream, start, LDSEEK_SET);
+
     int open_error;
     OggOpusFile *opus = op_open_callbacks(stream, &cb, NULL, 0, &open_error);
     if(!opus) {
         LOG_O_ERROR_F(options, "opus failed to open: %s", libopus_strerror(open_error));
         *error = "opus open failed";
-        stream->close(stream);
         return NULL;
     }
 
@@ -144,29 +237,54 @@ ld_pcmstream_t opus_getstream(ld_stream_t stream, ld_options_t options, const ch
         *error = "op_channel_count failed";
         return NULL;
     }
-    if(channels > 2 || op_link_count(opus) != 1) {
-        channels = 2;
+    //links of a chained file keep their own channel counts, unless one of
+    //them has to be downmixed. libopusfile then downmixes all of them to stereo.
+    //unseekable sources report a single link
+    int linkChannels = 0;
+    for(int i = 0; i < op_link_count(opus); i++) {
+        int c = op_channel_count(opus, i);
+        if(c > linkChannels) linkChannels = c;
     }
+    int stereo = linkChannels > 2 && linkChannels > options_max_channels(options);
 
-    opus_userdata_t *userdata = (opus_userdata_t*)malloc(sizeof(opus_userdata_t));
-	userdata->channels = channels;
+    //libopusfile is loaded at runtime and allocates its own state with libc
+    ld_allocator_t alloc = options_allocator(options);
+    ld_arena_t *arena = arena_create(&alloc, OPUS_ARENA_SIZE);
+    if(!arena) {
+        op_free(opus);
+        LOG_O_ERROR(options, "opus: out of memory");
+        *error = "Out of memory";
+        return NULL;
+    }
+    alloc = arena_allocator(arena, ARENA_OVERHEAD);
+    opus_userdata_t *userdata = (opus_userdata_t*)mem_alloc(&alloc, sizeof(opus_userdata_t));
+	userdata->channels = stereo ? 2 : channels;
+	userdata->stereo = stereo;
+	userdata->isFloat = options_float(options);
+	userdata->link = op_current_link(opus);
 	userdata->eof = 0;
     userdata->opus = opus;
-	ld_stream_t data = ld_stream_new();
+    userdata->source = stream;
+    userdata->alloc = alloc;
+	ld_stream_t data = stream_new(&alloc);
 	data->read = &opus_read;
 	data->seek = &opus_seek;
 	data->close = &opus_close;
 	data->userData = userdata;
 
-    ld_pcmstream_t retsound = pcmstream_init(options);
+    ld_pcmstream_t retsound = pcmstream_init(options, arena);
     userdata->pcm = retsound;
 	retsound->frequency = 48000;
     retsound->dataSize = -1;
-    retsound->blockSize = OPUS_BUFFER_SIZE;
+    retsound->blockSize = OPUS_BUFFER_SIZE * (userdata->isFloat ? 2 : 1);
     retsound->stream = data;
-    retsound->format = channels == 2 ? LDFORMAT_STEREO16 : LDFORMAT_MONO16;
-    set_property_string(retsound, LD_PROPERTY_CONTAINER, "ogg");
-    set_property_string(retsound, LD_PROPERTY_CODEC, "opus");
+    retsound->_internal->seeker.seek = &opus_seekframe;
+    retsound->_internal->seeker.tell = &opus_tellframe;
+    retsound->_internal->seeker.nextformat = &opus_nextformat;
+    retsound->_internal->seeker.data = userdata;
+    set_property_string(retsound, LD_PROPERTY_ID_CONTAINER, "ogg");
+    set_property_string(retsound, LD_PROPERTY_ID_CODEC, "opus");
+    opus_setformat(userdata);
     return retsound;
 }
 
@@ -6,6 +6,7 @@
 #include "../formats.h"
 #include "../logging.h"
 #include "../properties.h"
+#include "../stream.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,39 +33,46 @@ typedef struct {
   uint32_t subChunk2Size;
 } wave_data_t;
 
-#define WAVE_FORMAT_PCM 1
-#define WAVE_FORMAT_MP3 0x55
-#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
-#define WAVE_FORMAT_IEEE_FLOAT		0x0003 /* IEEE Float */
-#define WAVE_FORMAT_ALAW		0x0006 /* ALAW */
-#define WAVE_FORMAT_MULAW		0x0007 /* MULAW */
-#define WAVE_FORMAT_IMA_ADPCM		0x0011 /* IMA ADPCM */
+//sampler chunk, followed by numSampleLoops loops
+typedef struct {
+	uint32_t manufacturer;
+	uint32_t product;
+	uint32_t samplePeriod;
+	uint32_t midiUnityNote;
+	uint32_t midiPitchFraction;
+	uint32_t smpteFormat;
+	uint32_t smpteOffset;
+	uint32_t numSampleLoops;
+	uint32_t samplerData;
+} wave_smpl_t;
+
+typedef struct {
+	uint32_t cuePointID;
+	uint32_t type;
+	uint32_t start;
+	uint32_t end; //inclusive
+	uint32_t fraction;
+	uint32_t playCount;
+} wave_smpl_loop_t;
 
-ld_pcmstream_t riff_getstream(ld_stream_t stream, ld_options_t options, const char **error)
+
+int riff_readheader(ld_stream_t stream, riff_info_t *info, const char **error)
 {
 	wave_format_t wave_format;
 	riff_header_t riff_header;
 	wave_data_t wave_data;
-	ld_pcmstream_t retsound;
-
-	stream->read(&riff_header, sizeof(riff_header_t), stream);
 
-	if(memcmp(riff_header.chunkID, "RIFF", 4) != 0 ||
+	if(stream->read(&riff_header, sizeof(riff_header_t), stream) < sizeof(riff_header_t) ||
+		memcmp(riff_header.chunkID, "RIFF", 4) != 0 ||
 		memcmp(riff_header.format, "WAVE", 4) != 0) {
-		LOG_O_ERROR(options, "Invalid RIFF or WAVE header");
 		*error = "Invalid RIFF or WAVE header";
-		stream->close(stream);
 		return 0;
 	} 
 
 	stream->read (&wave_format, sizeof(wave_format_t), stream);
 
 	if(memcmp(wave_format.subChunkID, "fmt ", 4) != 0) {
-		char actual[5] = { wave_format.subChunkID[0],
-		wave_format.subChunkID[1], wave_format.subChunkID[2], wave_format.subChunkID[3], '\0' };
-		LOG_O_ERROR_F(options, "Invalid Wave Format :'%s'", actual);
 		*error = "Invalid Wave Format";
-		stream->close(stream);
 		return 0;
 	}
 
@@ -74,11 +82,11 @@ ld_pcmstream_t riff_getstream(ld_stream_t stream, ld_options_t options, const ch
 	int has_data = 0;
 	int32_t total_frames = -1;
 	int32_t trim_frames = -1;
+	int32_t loop_start = -1;
+	int32_t loop_length = -1;
 	while(!has_data) {
 		if(!stream->read(&wave_data, sizeof(wave_data_t), stream))
 		{
-			stream->close(stream);
-			LOG_O_ERROR(options, "Unable to find WAVE data");
 			*error = "Unable to find WAVE data";
 			return 0;
 		}
@@ -94,6 +102,18 @@ ld_pcmstream_t riff_getstream(ld_stream_t stream, ld_options_t options, const ch
 			stream->read(&trim_frames, sizeof(int32_t), stream); 
 			if(wave_data.subChunk2Size - sizeof(int32_t) > 0)
 				stream->seek(stream,wave_data.subChunk2Size - sizeof(int32_t), LDSEEK_CUR);
+		} else if (memcmp(wave_data.subChunkID, "smpl", 4) == 0 &&
+			wave_data.subChunk2Size >= sizeof(wave_smpl_t) + sizeof(wave_smpl_loop_t)) {
+			//loop points, only the first loop is used
+			wave_smpl_t smpl;
+			wave_smpl_loop_t loop;
+			stream->read(&smpl, sizeof(wave_smpl_t), stream);
+			stream->read(&loop, sizeof(wave_smpl_loop_t), stream);
+			if(smpl.numSampleLoops > 0 && loop.end >= loop.start && loop.end < INT32_MAX) {
+				loop_start = (int32_t)loop.start;
+				loop_length = (int32_t)(loop.end - loop.start + 1);
+			}
+			stream->seek(stream, wave_data.subChunk2Size - sizeof(wave_smpl_t) - sizeof(wave_smpl_loop_t), LDSEEK_CUR);
 		} else {
 			//skip chunk
 			stream->seek(stream, wave_data.subChunk2Size, LDSEEK_CUR);
@@ -105,42 +125,136 @@ ld_pcmstream_t riff_getstream(ld_stream_t stream, ld_options_t options, const ch
         //this fact chunk is incorrect, throw away the data
         total_frames = -1;
     }*/
-	switch (wave_format.audioFormat) {
-		case WAVE_FORMAT_PCM:
-			break; //Default decoder
-		case WAVE_FORMAT_MP3:
-			return mp3_getstream(ld_stream_wrap(stream, wave_data.subChunk2Size, 1), options, error, wave_format.numChannels, wave_format.sampleRate, trim_frames, total_frames);
-		default:
-			LOG_O_ERROR_F(options, "Unsupported format in WAVE file: '%x'", wave_format.audioFormat);
-			*error = "Unsupported format in WAVE file";
-			stream->close(stream);
-			return 0;
+	info->audioFormat = wave_format.audioFormat;
+	info->numChannels = wave_format.numChannels;
+	info->sampleRate = wave_format.sampleRate;
+	info->bitsPerSample = wave_format.bitsPerSample;
+	info->dataSize = wave_data.subChunk2Size;
+	info->trimFrames = trim_frames;
+	info->totalFrames = total_frames;
+	info->loopStart = loop_start;
+	info->loopLength = loop_length;
+	return 1;
+}
+
+void riff_setloop(ld_pcmstream_t pcm, const riff_info_t *info)
+{
+	if(info->loopStart != -1) {
+		set_property_int(pcm, LD_PROPERTY_ID_LOOP_START, info->loopStart);
+		set_property_int(pcm, LD_PROPERTY_ID_LOOP_LENGTH, info->loopLength);
+	}
+}
+
+static int riff_seekframe(ld_pcmstream_t pcm, int64_t frame)
+{
+	ld_stream_t data = (ld_stream_t)pcm->_internal->seeker.data;
+	int64_t offset = frame * pcmstream_frame_size(pcm);
+	if(offset > pcm->dataSize) return -1;
+	return data->seek(data, (int32_t)offset, LDSEEK_SET);
+}
+
+static int64_t riff_tellframe(ld_pcmstream_t pcm)
+{
+	ld_stream_t data = (ld_stream_t)pcm->_internal->seeker.data;
+	return data->tell(data) / pcmstream_frame_size(pcm);
+}
+
+ld_pcmstream_t riff_getstream(ld_stream_t stream, ld_options_t options, const char **error, const riff_info_t *info)
+{
+	ld_pcmstream_t retsound;
+	ld_allocator_t alloc = options_allocator(options);
+	ld_arena_t *arena = arena_create(&alloc, PCMSTREAM_ARENA_SIZE + STREAM_ARENA_SIZE);
+	if(!arena) {
+		LOG_O_ERROR(options, "riff: out of memory");
+		*error = "Out of memory";
+		return NULL;
 	}
 
-	retsound = pcmstream_init(options);
+	retsound = pcmstream_init(options, arena);
+	alloc = arena_allocator(arena, ARENA_OVERHEAD);
 
-	if(wave_format.numChannels == 1) {
-		if (wave_format.bitsPerSample == 8) {
+	if(info->numChannels == 1) {
+		if (info->bitsPerSample == 8) {
 			retsound->format = LDFORMAT_MONO8;
-		} else if (wave_format.bitsPerSample == 16) {
+		} else if (info->bitsPerSample == 16) {
 			retsound->format = LDFORMAT_MONO16;
 		}
-	} else if (wave_format.numChannels == 2) {
-		if (wave_format.bitsPerSample == 8) {
+	} else if (info->numChannels == 2) {
+		if (info->bitsPerSample == 8) {
 			retsound->format = LDFORMAT_STEREO8;
-		} else if (wave_format.bitsPerSample == 16) {
+		} else if (info->bitsPerSample == 16) {
 			retsound->format = LDFORMAT_STEREO16;
 		}
+	} else if (info->bitsPerSample == 16) {
+		retsound->format = LDFORMAT_S16;
 	}
+	retsound->channels = info->numChannels;
 
 	
 
-	retsound->frequency = wave_format.sampleRate;
-	retsound->stream = ld_stream_wrap(stream, wave_data.subChunk2Size, 1);
-	retsound->dataSize = wave_data.subChunk2Size;
+	retsound->frequency = info->sampleRate;
+	retsound->stream = stream_wrap(stream, info->dataSize, 1, &alloc);
+	retsound->dataSize = info->dataSize;
 	retsound->blockSize = 32768;
-	init_properties(retsound);
-    set_property_string(retsound, LD_PROPERTY_CONTAINER, "wav");
-    set_property_string(retsound, LD_PROPERTY_CODEC, "pcm");
+	retsound->_internal->seeker.seek = &riff_seekframe;
+	retsound->_internal->seeker.tell = &riff_tellframe;
+	retsound->_internal->seeker.data = retsound->stream;
+    set_property_string(retsound, LD_PROPERTY_ID_CONTAINER, "wav");
+    set_property_string(retsound, LD_PROPERTY_ID_CODEC, "pcm");
+	set_property_int(retsound, LD_PROPERTY_ID_BITS_PER_SAMPLE, info->bitsPerSample);
+	riff_setloop(retsound, info);
 	return retsound;
 }
+
+int riff_peekformat(const unsigned char *peek, int32_t peekSize)
+{
+	if(peekSize < 12 || memcmp(peek, "RIFF", 4) || memcmp(&peek[8], "WAVE", 4)) {
+		return -1;
+	}
+	//riff_readheader only accepts fmt as the first chunk
+	if(peekSize < 22 || memcmp(&peek[12], "fmt ", 4)) {
+		return 0;
+	}
+	return peek[20] | (peek[21] << 8);
+}
+
+int32_t riff_pcm_score(const unsigned char *peek, int32_t peekSize, void *userdata)
+{
+	int format = riff_peekformat(peek, peekSize);
+	if(format == WAVE_FORMAT_PCM) return LD_SCORE_MAX;
+	//other RIFF files fall through to riff_readheader, which reports them
+	if(format == 0) return 2;
+	return format > 0 ? 1 : 0;
+}
+
+int riff_probe(ld_stream_t stream, ld_probe_info_t *info)
+{
+	riff_info_t riff;
+	const char *error;
+	if(!riff_readheader(stream, &riff, &error)) {
+		return 0;
+	}
+	info->container = "wav";
+	info->channels = riff.numChannels;
+	info->frequency = riff.sampleRate;
+	switch (riff.audioFormat) {
+		case WAVE_FORMAT_PCM:
+			info->codec = "pcm";
+			info->bitsPerSample = riff.bitsPerSample;
+			if(riff.numChannels > 0 && riff.bitsPerSample >= 8)
+				info->totalFrames = riff.dataSize / (riff.numChannels * (riff.bitsPerSample / 8));
+			return 1;
+		case WAVE_FORMAT_MP3: {
+			if(riff.trimFrames != -1 && riff.totalFrames != -1) {
+				info->flTrim = riff.trimFrames;
+				info->flSamples = riff.totalFrames;
+			}
+			ld_stream_t data = ld_stream_wrap(stream, riff.dataSize, 0);
+			int result = mp3_probe(data, info);
+			data->close(data);
+			return result;
+		}
+		default:
+			return 0;
+	}
+}
@@ -82,6 +82,10 @@
 #ifndef STB_VORBIS_NO_STDIO
 #include <stdio.h>
 #endif
+#include "../alloc.h"
+#include "../hashmap.h"
+#include "../threads.h"
+#include "../ogg.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -115,11 +119,22 @@ extern "C" {
 // If you pass in a non-NULL buffer of the type below, allocation
 // will occur from it as described above. Otherwise just pass NULL
 // to use malloc()/alloca()
+//
+// lancerdecode: with alloc_buffer NULL, setup memory comes from
+// `allocator` instead (libc when its functions are NULL). When
+// `share_setup` is set the tables built from the setup header
+// (codebooks, floors, residues, mappings) are allocated from
+// `shared_allocator` and shared by reference count with every other
+// decoder opened on a byte-identical setup packet, the same channel
+// count and the same shared allocator.
 
 typedef struct
 {
    char *alloc_buffer;
    int   alloc_buffer_length_in_bytes;
+   ld_allocator_t allocator;
+   ld_allocator_t shared_allocator;
+   int share_setup;
 } stb_vorbis_alloc;
 
 
@@ -308,10 +323,30 @@ extern int stb_vorbis_seek(stb_vorbis *f, unsigned int sample_number);
 extern int stb_vorbis_seek_start(stb_vorbis *f);
 // this function is equivalent to stb_vorbis_seek(f,0)
 
+// lancerdecode: chained files
+extern unsigned int stb_vorbis_next_link_offset(stb_vorbis *f);
+// once get_samples returns 0 because decoding reached the first page of the
+// next logical stream, the file offset of that page. 0 otherwise
+extern int stb_vorbis_start_link(stb_vorbis *f, unsigned int offset, int *error);
+// restarts f on the link whose first page is at file offset 'offset'. its
+// headers are parsed, the allocators, shared setup and decode buffers of the
+// same shape are kept. on failure returns 0, sets *error and f stays at the
+// end of the link it was on
+extern int stb_vorbis_fill_frame(stb_vorbis *f);
+// decodes the next frame if none is buffered, returns 0 where get_samples
+// would, so the end of a link is found before reading from it
+
 extern unsigned int stb_vorbis_stream_length_in_samples(stb_vorbis *f);
 extern float        stb_vorbis_stream_length_in_seconds(stb_vorbis *f);
 // these functions return the total length of the vorbis stream
 
+// lancerdecode: zero-copy output
+extern int stb_vorbis_lend_frame_float(stb_vorbis *f, float ***output, int max_samples);
+// points *output at the channel buffers of the decoded samples that get_samples
+// has not returned yet, decoding the next frame when there are none, and
+// consumes up to max_samples of them. returns that count, 0 at the end of the
+// stream. the samples are overwritten by the next decode like get_frame_float
+
 extern int stb_vorbis_get_frame_float(stb_vorbis *f, int *channels, float ***output);
 // decode the next frame and return the number of samples. the number of
 // channels returned are stored in *channels (which can be NULL--it is always
@@ -765,6 +800,33 @@ typedef struct
    uint16 transformtype;
 } Mode;
 
+// lancerdecode: immutable tables built from one setup header, see
+// setup_cache_find/setup_cache_insert
+typedef struct stb_vorbis_setup
+{
+   struct stb_vorbis_setup *next;
+   int refs;
+   uint64_t hash;
+   uint8 *packet;
+   int packet_len;
+   int channels;
+   ld_allocator_t allocator;
+
+   int codebook_count;
+   Codebook *codebooks;
+   int floor_count;
+   uint16 floor_types[64];
+   Floor *floor_config;
+   int residue_count;
+   uint16 residue_types[64];
+   Residue *residue_config;
+   int mapping_count;
+   Mapping *mapping;
+   int mode_count;
+   Mode mode_config[64];
+   int longest_floorlist;
+} stb_vorbis_setup;
+
 typedef struct
 {
    uint32  goal_crc;    // expected crc if match
@@ -843,6 +905,15 @@ struct stb_vorbis
    int mode_count;
    Mode mode_config[64];  // varies
 
+   // shared copy of the tables above, NULL when they are owned here.
+   // setup_sharing is set while they are being parsed into the shared
+   // allocator, keyed on setup_packet
+   stb_vorbis_setup *shared_setup;
+   int setup_sharing;
+   uint8 *setup_packet;
+   int setup_packet_len;
+   uint64_t setup_hash;
+
    uint32 total_samples;
 
   // decode buffer
@@ -868,6 +939,11 @@ struct stb_vorbis
    float *window[2];
    uint16 *bit_reverse[2];
 
+  // lancerdecode: chained files, see stb_vorbis_start_link
+   uint32 next_link_offset; // file offset of the next link's first page, 0 until reached
+   int longest_floorlist;
+   stb_vorbis *link_prev; // link whose buffers may be taken over while starting this one
+
   // current page/packet/segment streaming info
    uint32 serial; // stream serial number for verification
    int last_page;
@@ -945,6 +1021,8 @@ static void *make_block_array(void *mem, int count, int size)
    return p;
 }
 
+#define setup_allocator(f) ((f)->setup_sharing ? &(f)->alloc.shared_allocator : &(f)->alloc.allocator)
+
 static void *setup_malloc(vorb *f, int sz)
 {
    sz = (sz+7) & ~7; // round up to nearest 8 for alignment of future allocs.
@@ -955,13 +1033,13 @@ static void *setup_malloc(vorb *f, int sz)
       f->setup_offset += sz;
       return p;
    }
-   return sz ? malloc(sz) : NULL;
+   return sz ? mem_alloc(setup_allocator(f), sz) : NULL;
 }
 
 static void setup_free(vorb *f, void *p)
 {
    if (f->alloc.alloc_buffer) return; // do nothing; setup mem is a stack
-   free(p);
+   mem_free(setup_allocator(f), p);
 }
 
 static void *setup_temp_malloc(vorb *f, int sz)
@@ -972,7 +1050,7 @@ static void *setup_temp_malloc(vorb *f, int sz)
       f->temp_offset -= sz;
       return (char *) f->alloc.alloc_buffer + f->temp_offset;
    }
-   return malloc(sz);
+   return mem_alloc(setup_allocator(f), sz);
 }
 
 static void setup_temp_free(vorb *f, void *p, int sz)
@@ -981,26 +1059,13 @@ static void setup_temp_free(vorb *f, void *p, int sz)
       f->temp_offset += (sz+7)&~7;
       return;
    }
-   free(p);
-}
-
-#define CRC32_POLY    0x04c11db7   // from spec
-
-static uint32 crc_table[256];
-static void crc32_init(void)
-{
-   int i,j;
-   uint32 s;
-   for(i=0; i < 256; i++) {
-      for (s=(uint32) i << 24, j=0; j < 8; ++j)
-         s = (s << 1) ^ (s >= (1U<<31) ? CRC32_POLY : 0);
-      crc_table[i] = s;
-   }
+   mem_free(setup_allocator(f), p);
 }
 
+// lancerdecode: the page CRC is shared with the other Ogg codecs, see ogg.h
 static __forceinline uint32 crc32_update(uint32 crc, uint8 byte)
 {
-   return (crc << 8) ^ crc_table[byte ^ (crc >> 24)];
+   return ogg_crc32_byte(crc, byte);
 }
 
 
@@ -1398,6 +1463,7 @@ static int set_file_offset(stb_vorbis *f, unsigned int loc)
    if (f->push_mode) return 0;
    #endif
    f->eof = 0;
+   f->next_link_offset = 0;
    if (USE_MEMORY(f)) {
       if (f->stream_start + loc >= f->stream_end || f->stream_start + loc < f->stream_start) {
          f->stream = f->stream_end;
@@ -1449,6 +1515,13 @@ static int start_page_no_capturepattern(vorb *f)
    if (0 != get8(f)) return error(f, VORBIS_invalid_stream_structure_version);
    // header flag
    f->page_flag = get8(f);
+   // lancerdecode: a first page anywhere but the start of the stream begins
+   // the next link of a chained file, stop decoding like at the end of file
+   if ((f->page_flag & PAGEFLAG_first_page) && !IS_PUSH_MODE(f) && stb_vorbis_get_file_offset(f) != 6) {
+      f->next_link_offset = f->f_start + stb_vorbis_get_file_offset(f) - 6;
+      f->eof = TRUE;
+      return FALSE;
+   }
    // absolute granule position
    loc0 = get32(f);
    loc1 = get32(f);
@@ -2410,6 +2483,11 @@ static void imdct_step3_iter0_loop(int n, float *e, int i_off, int k_off, float
    int i;
 
    assert((n & 3) == 0);
+   // blocks of 8 only overlap when |k_off| < 8, which the vector code can't handle
+   if (vorbis_simd && k_off <= -8) {
+      vorbis_simd->imdct_butterfly_r(ee0, ee2, A, 8, n >> 2);
+      return;
+   }
    for (i=(n>>2); i > 0; --i) {
       float k00_20, k01_21;
       k00_20  = ee0[ 0] - ee2[ 0];
@@ -2456,6 +2534,11 @@ static void imdct_step3_inner_r_loop(int lim, float *e, int d0, int k_off, float
    float *e0 = e + d0;
    float *e2 = e0 + k_off;
 
+   if (vorbis_simd && k_off <= -8) {
+      vorbis_simd->imdct_butterfly_r(e0, e2, A, k1, lim >> 2);
+      return;
+   }
+
    for (i=lim >> 2; i > 0; --i) {
       k00_20 = e0[-0] - e2[-0];
       k01_21 = e0[-1] - e2[-1];
@@ -2515,6 +2598,11 @@ static void imdct_step3_inner_s_loop(int n, float *e, int i_off, int k_off, floa
    float *ee0 = e  +i_off;
    float *ee2 = ee0+k_off;
 
+   if (vorbis_simd && k_off <= -8) {
+      vorbis_simd->imdct_butterfly_s(ee0, ee2, A, a_off, k0, n);
+      return;
+   }
+
    for (i=n; i > 0; --i) {
       k00     = ee0[ 0] - ee2[ 0];
       k11     = ee0[-1] - ee2[-1];
@@ -3329,6 +3417,10 @@ static int vorbis_decode_packet_rest(vorb *f, int *len, Mode *m, int left_start,
       int n2 = n >> 1;
       float *m = f->channel_buffers[map->chan[i].magnitude];
       float *a = f->channel_buffers[map->chan[i].angle    ];
+      if (vorbis_simd) {
+         vorbis_simd->inverse_coupling(m, a, n2);
+         continue;
+      }
       for (j=0; j < n2; ++j) {
          float a2,m2;
          if (m[j] > 0)
@@ -3468,6 +3560,10 @@ static int vorbis_finish_frame(stb_vorbis *f, int len, int left, int right)
       float *w = get_window(f, n);
       if (w == NULL) return 0;
       for (i=0; i < f->channels; ++i) {
+         if (vorbis_simd) {
+            vorbis_simd->overlap_add(f->channel_buffers[i]+left, f->previous_window[i], w, n);
+            continue;
+         }
          for (j=0; j < n; ++j)
             f->channel_buffers[i][left+j] =
                f->channel_buffers[i][left+j]*w[    j] +
@@ -3575,6 +3671,230 @@ static int is_whole_packet_present(stb_vorbis *f)
 }
 #endif // !STB_VORBIS_NO_PUSHDATA_API
 
+// lancerdecode: setup cache
+//
+// The setup header is identical for every file written by the same
+// encoder configuration, so the tables built from it are kept in a
+// process-wide list and shared by reference count. Entries are keyed on
+// the setup packet bytes, the channel count (the mappings depend on it)
+// and the shared allocator, which also frees the entry once the last
+// decoder using it closes.
+
+static ld_mutex_t setup_cache_lock = LD_MUTEX_INIT;
+static stb_vorbis_setup *setup_cache = NULL;
+
+static void setup_tables_free(ld_allocator_t *a, int codebook_count, Codebook *codebooks,
+   Floor *floor_config, int residue_count, Residue *residue_config, int mapping_count, Mapping *mapping)
+{
+   int i,j;
+   if (residue_config) {
+      for (i=0; i < residue_count; ++i) {
+         Residue *r = residue_config+i;
+         if (r->classdata) {
+            for (j=0; j < codebooks[r->classbook].entries; ++j)
+               mem_free(a, r->classdata[j]);
+            mem_free(a, r->classdata);
+         }
+         mem_free(a, r->residue_books);
+      }
+   }
+
+   if (codebooks) {
+      for (i=0; i < codebook_count; ++i) {
+         Codebook *c = codebooks + i;
+         mem_free(a, c->codeword_lengths);
+         mem_free(a, c->multiplicands);
+         mem_free(a, c->codewords);
+         mem_free(a, c->sorted_codewords);
+         // c->sorted_values[-1] is the first entry in the array
+         mem_free(a, c->sorted_values ? c->sorted_values-1 : NULL);
+      }
+      mem_free(a, codebooks);
+   }
+   mem_free(a, floor_config);
+   mem_free(a, residue_config);
+   if (mapping) {
+      for (i=0; i < mapping_count; ++i)
+         mem_free(a, mapping[i].chan);
+      mem_free(a, mapping);
+   }
+}
+
+static int same_allocator(const ld_allocator_t *a, const ld_allocator_t *b)
+{
+   return a->malloc == b->malloc && a->realloc == b->realloc &&
+          a->free == b->free && a->userdata == b->userdata;
+}
+
+static void setup_adopt(vorb *f, stb_vorbis_setup *s)
+{
+   f->shared_setup = s;
+   f->codebook_count = s->codebook_count;
+   f->codebooks = s->codebooks;
+   f->floor_count = s->floor_count;
+   memcpy(f->floor_types, s->floor_types, sizeof(f->floor_types));
+   f->floor_config = s->floor_config;
+   f->residue_count = s->residue_count;
+   memcpy(f->residue_types, s->residue_types, sizeof(f->residue_types));
+   f->residue_config = s->residue_config;
+   f->mapping_count = s->mapping_count;
+   f->mapping = s->mapping;
+   f->mode_count = s->mode_count;
+   memcpy(f->mode_config, s->mode_config, sizeof(f->mode_config));
+}
+
+// Reads the whole setup packet, which must have just been started. On a
+// cache hit the decoder takes the shared tables and the packet is left
+// consumed. On a miss the read position is rewound to the start of the
+// packet and the packet bytes are kept in f->setup_packet for
+// setup_cache_insert (NULL if they could not be read, in which case
+// nothing is cached).
+static int setup_cache_find(vorb *f)
+{
+   vorb saved = *f;
+   unsigned int offset = stb_vorbis_get_file_offset(f);
+   ld_allocator_t *a = &f->alloc.shared_allocator;
+   stb_vorbis_setup *s;
+   uint8 *data = NULL;
+   uint64_t hash;
+   int len = 0, cap = 0, x;
+
+   while ((x = get8_packet(f)) != EOP) {
+      if (len == cap) {
+         uint8 *grown = (uint8 *) mem_realloc(a, data, cap ? cap*2 : 4096);
+         if (grown == NULL) break;
+         data = grown;
+         cap = cap ? cap*2 : 4096;
+      }
+      data[len++] = (uint8) x;
+   }
+   if (x != EOP || f->eof || len == 0) {
+      mem_free(a, data);
+      *f = saved;
+      set_file_offset(f, offset);
+      return FALSE;
+   }
+   hash = hashmap_sip(data, len, 0x766f72626973ULL, 0x7365747570ULL);
+
+   mutex_lock(&setup_cache_lock);
+   for (s = setup_cache; s; s = s->next) {
+      if (s->hash == hash && s->packet_len == len && s->channels == f->channels &&
+          same_allocator(&s->allocator, a) && !memcmp(s->packet, data, len)) {
+         ++s->refs;
+         break;
+      }
+   }
+   mutex_unlock(&setup_cache_lock);
+
+   if (s) {
+      mem_free(a, data);
+      setup_adopt(f, s);
+      return TRUE;
+   }
+   *f = saved;
+   set_file_offset(f, offset);
+   f->setup_packet = data;
+   f->setup_packet_len = len;
+   f->setup_hash = hash;
+   return FALSE;
+}
+
+// Moves the tables just parsed and f->setup_packet into a new cache
+// entry shared by f
+static int setup_cache_insert(vorb *f, int longest_floorlist)
+{
+   ld_allocator_t *a = &f->alloc.shared_allocator;
+   stb_vorbis_setup *s = (stb_vorbis_setup *) mem_alloc(a, sizeof(*s));
+   if (s == NULL) return FALSE;
+   memset(s, 0, sizeof(*s));
+   s->refs = 1;
+   s->hash = f->setup_hash;
+   s->packet = f->setup_packet;
+   s->packet_len = f->setup_packet_len;
+   s->channels = f->channels;
+   s->allocator = *a;
+   s->codebook_count = f->codebook_count;
+   s->codebooks = f->codebooks;
+   s->floor_count = f->floor_count;
+   memcpy(s->floor_types, f->floor_types, sizeof(s->floor_types));
+   s->floor_config = f->floor_config;
+   s->residue_count = f->residue_count;
+   memcpy(s->residue_types, f->residue_types, sizeof(s->residue_types));
+   s->residue_config = f->residue_config;
+   s->mapping_count = f->mapping_count;
+   s->mapping = f->mapping;
+   s->mode_count = f->mode_count;
+   memcpy(s->mode_config, f->mode_config, sizeof(s->mode_config));
+   s->longest_floorlist = longest_floorlist;
+
+   mutex_lock(&setup_cache_lock);
+   s->next = setup_cache;
+   setup_cache = s;
+   mutex_unlock(&setup_cache_lock);
+
+   f->shared_setup = s;
+   f->setup_packet = NULL;
+   f->setup_sharing = FALSE;
+   return TRUE;
+}
+
+static void setup_cache_release(stb_vorbis_setup *s)
+{
+   stb_vorbis_setup **link;
+   ld_allocator_t a;
+   mutex_lock(&setup_cache_lock);
+   if (--s->refs > 0) {
+      mutex_unlock(&setup_cache_lock);
+      return;
+   }
+   for (link = &setup_cache; *link; link = &(*link)->next) {
+      if (*link == s) {
+         *link = s->next;
+         break;
+      }
+   }
+   mutex_unlock(&setup_cache_lock);
+
+   a = s->allocator;
+   setup_tables_free(&a, s->codebook_count, s->codebooks, s->floor_config,
+      s->residue_count, s->residue_config, s->mapping_count, s->mapping);
+   mem_free(&a, s->packet);
+   mem_free(&a, s);
+}
+
+// lancerdecode: the buffers and blocksize tables only depend on these, so
+// the next link of a chained file can take them over from the previous one
+static int link_buffers_match(vorb *f, vorb *prev)
+{
+   return prev && !f->alloc.alloc_buffer && prev->channels == f->channels &&
+          prev->blocksize_0 == f->blocksize_0 && prev->blocksize_1 == f->blocksize_1 &&
+          prev->longest_floorlist == f->longest_floorlist;
+}
+
+static void link_take_buffers(vorb *f, vorb *prev)
+{
+   int i;
+   for (i=0; i < f->channels; ++i) {
+      f->channel_buffers[i] = prev->channel_buffers[i];
+      f->previous_window[i] = prev->previous_window[i];
+      f->finalY[i]          = prev->finalY[i];
+      prev->channel_buffers[i] = prev->previous_window[i] = NULL;
+      prev->finalY[i] = NULL;
+      memset(f->channel_buffers[i], 0, sizeof(float) * f->blocksize_1);
+      #ifdef STB_VORBIS_NO_DEFER_FLOOR
+      f->floor_buffers[i] = prev->floor_buffers[i];
+      prev->floor_buffers[i] = NULL;
+      #endif
+   }
+   for (i=0; i < 2; ++i) {
+      f->A[i] = prev->A[i]; f->B[i] = prev->B[i]; f->C[i] = prev->C[i];
+      f->window[i] = prev->window[i];
+      f->bit_reverse[i] = prev->bit_reverse[i];
+      prev->A[i] = prev->B[i] = prev->C[i] = prev->window[i] = NULL;
+      prev->bit_reverse[i] = NULL;
+   }
+}
+
 static int start_decoder(vorb *f)
 {
    uint8 header[6], x,y;
@@ -3702,7 +4022,13 @@ static int start_decoder(vorb *f)
    }
    #endif
 
-   crc32_init(); // always init it, to avoid multithread race conditions
+   if (f->alloc.share_setup && !f->alloc.alloc_buffer && !IS_PUSH_MODE(f)) {
+      if (setup_cache_find(f)) {
+         longest_floorlist = f->shared_setup->longest_floorlist;
+         goto setup_done;
+      }
+      f->setup_sharing = f->setup_packet != NULL;
+   }
 
    if (get8_packet(f) != VORBIS_packet_setup)       return error(f, VORBIS_invalid_setup);
    for (i=0; i < 6; ++i) header[i] = get8_packet(f);
@@ -4124,22 +4450,31 @@ static int start_decoder(vorb *f)
 
    flush_packet(f);
 
+   if (f->setup_sharing && !setup_cache_insert(f, longest_floorlist))
+      return error(f, VORBIS_outofmem);
+
+setup_done:
    f->previous_length = 0;
+   f->longest_floorlist = longest_floorlist;
 
-   for (i=0; i < f->channels; ++i) {
-      f->channel_buffers[i] = (float *) setup_malloc(f, sizeof(float) * f->blocksize_1);
-      f->previous_window[i] = (float *) setup_malloc(f, sizeof(float) * f->blocksize_1/2);
-      f->finalY[i]          = (int16 *) setup_malloc(f, sizeof(int16) * longest_floorlist);
-      if (f->channel_buffers[i] == NULL || f->previous_window[i] == NULL || f->finalY[i] == NULL) return error(f, VORBIS_outofmem);
-      memset(f->channel_buffers[i], 0, sizeof(float) * f->blocksize_1);
-      #ifdef STB_VORBIS_NO_DEFER_FLOOR
-      f->floor_buffers[i]   = (float *) setup_malloc(f, sizeof(float) * f->blocksize_1/2);
-      if (f->floor_buffers[i] == NULL) return error(f, VORBIS_outofmem);
-      #endif
-   }
+   if (link_buffers_match(f, f->link_prev)) {
+      link_take_buffers(f, f->link_prev);
+   } else {
+      for (i=0; i < f->channels; ++i) {
+         f->channel_buffers[i] = (float *) setup_malloc(f, sizeof(float) * f->blocksize_1);
+         f->previous_window[i] = (float *) setup_malloc(f, sizeof(float) * f->blocksize_1/2);
+         f->finalY[i]          = (int16 *) setup_malloc(f, sizeof(int16) * longest_floorlist);
+         if (f->channel_buffers[i] == NULL || f->previous_window[i] == NULL || f->finalY[i] == NULL) return error(f, VORBIS_outofmem);
+         memset(f->channel_buffers[i], 0, sizeof(float) * f->blocksize_1);
+         #ifdef STB_VORBIS_NO_DEFER_FLOOR
+         f->floor_buffers[i]   = (float *) setup_malloc(f, sizeof(float) * f->blocksize_1/2);
+         if (f->floor_buffers[i] == NULL) return error(f, VORBIS_outofmem);
+         #endif
+      }
 
-   if (!init_blocksize(f, 0, f->blocksize_0)) return FALSE;
-   if (!init_blocksize(f, 1, f->blocksize_1)) return FALSE;
+      if (!init_blocksize(f, 0, f->blocksize_0)) return FALSE;
+      if (!init_blocksize(f, 1, f->blocksize_1)) return FALSE;
+   }
    f->blocksize[0] = f->blocksize_0;
    f->blocksize[1] = f->blocksize_1;
 
@@ -4205,7 +4540,23 @@ static int start_decoder(vorb *f)
 
 static void vorbis_deinit(stb_vorbis *p)
 {
-   int i,j;
+   int i;
+
+   if (p->shared_setup) {
+      setup_cache_release(p->shared_setup);
+   } else if (!p->alloc.alloc_buffer) {
+      // a failed shared parse leaves its tables in the shared allocator
+      setup_tables_free(setup_allocator(p), p->codebook_count, p->codebooks, p->floor_config,
+         p->residue_count, p->residue_config, p->mapping_count, p->mapping);
+   }
+   mem_free(&p->alloc.shared_allocator, p->setup_packet);
+   p->shared_setup = NULL;
+   p->setup_sharing = FALSE;
+   p->setup_packet = NULL;
+   p->codebooks = NULL;
+   p->floor_config = NULL;
+   p->residue_config = NULL;
+   p->mapping = NULL;
 
    setup_free(p, p->vendor);
    for (i=0; i < p->comment_list_length; ++i) {
@@ -4213,38 +4564,6 @@ static void vorbis_deinit(stb_vorbis *p)
    }
    setup_free(p, p->comment_list);
 
-   if (p->residue_config) {
-      for (i=0; i < p->residue_count; ++i) {
-         Residue *r = p->residue_config+i;
-         if (r->classdata) {
-            for (j=0; j < p->codebooks[r->classbook].entries; ++j)
-               setup_free(p, r->classdata[j]);
-            setup_free(p, r->classdata);
-         }
-         setup_free(p, r->residue_books);
-      }
-   }
-
-   if (p->codebooks) {
-      CHECK(p);
-      for (i=0; i < p->codebook_count; ++i) {
-         Codebook *c = p->codebooks + i;
-         setup_free(p, c->codeword_lengths);
-         setup_free(p, c->multiplicands);
-         setup_free(p, c->codewords);
-         setup_free(p, c->sorted_codewords);
-         // c->sorted_values[-1] is the first entry in the array
-         setup_free(p, c->sorted_values ? c->sorted_values-1 : NULL);
-      }
-      setup_free(p, p->codebooks);
-   }
-   setup_free(p, p->floor_config);
-   setup_free(p, p->residue_config);
-   if (p->mapping) {
-      for (i=0; i < p->mapping_count; ++i)
-         setup_free(p, p->mapping[i].chan);
-      setup_free(p, p->mapping);
-   }
    CHECK(p);
    for (i=0; i < p->channels && i < STB_VORBIS_MAX_CHANNELS; ++i) {
       setup_free(p, p->channel_buffers[i]);
@@ -4574,29 +4893,27 @@ static uint32 vorbis_find_page(stb_vorbis *f, uint32 *end, uint32 *last)
                break;
          if (f->eof) return 0;
          if (i == 4) {
-            uint8 header[27];
-            uint32 i, crc, goal, len;
+            // lancerdecode: the page is read in blocks for the sliced ogg_crc32
+            uint8 header[27+255], body[4096];
+            uint32 i, crc, goal, len, n;
             for (i=0; i < 4; ++i)
                header[i] = ogg_page_header[i];
-            for (; i < 27; ++i)
-               header[i] = get8(f);
-            if (f->eof) return 0;
+            if (!getn(f, header+4, 23)) return 0;
             if (header[4] != 0) goto invalid;
             goal = header[22] + (header[23] << 8) + (header[24]<<16) + ((uint32)header[25]<<24);
             for (i=22; i < 26; ++i)
                header[i] = 0;
-            crc = 0;
-            for (i=0; i < 27; ++i)
-               crc = crc32_update(crc, header[i]);
+            if (!getn(f, header+27, header[26])) return 0;
+            crc = ogg_crc32(0, header, 27 + header[26]);
             len = 0;
-            for (i=0; i < header[26]; ++i) {
-               int s = get8(f);
-               crc = crc32_update(crc, s);
-               len += s;
+            for (i=0; i < header[26]; ++i)
+               len += header[27+i];
+            while (len) {
+               n = len < sizeof(body) ? len : sizeof(body);
+               if (!getn(f, body, n)) goto invalid;
+               crc = ogg_crc32(crc, body, n);
+               len -= n;
             }
-            if (len && f->eof) return 0;
-            for (i=0; i < len; ++i)
-               crc = crc32_update(crc, get8(f));
             // finished parsing probable page
             if (crc == goal) {
                // we could now check that it's either got the last
@@ -4941,10 +5258,44 @@ int stb_vorbis_seek_start(stb_vorbis *f)
    return vorbis_pump_first_frame(f);
 }
 
+// lancerdecode: serial number of the page at loc, 0 if it can't be read
+static uint32 page_serial(stb_vorbis *f, unsigned int loc)
+{
+   uint8 header[18];
+   set_file_offset(f, loc);
+   if (!getn(f, header, 18) || memcmp(header, ogg_page_header, 4)) return 0;
+   return header[14] + (header[15] << 8) + (header[16] << 16) + ((uint32)header[17] << 24);
+}
+
+// lancerdecode: the pages at the end of a chained file belong to a later
+// link, walk the page headers of this one up to its last page instead
+static int link_last_page(stb_vorbis *f, uint32 serial, unsigned int *last_page_loc, unsigned int *end)
+{
+   uint8 header[27], lacing[255];
+   unsigned int loc = f->first_audio_page_offset;
+   int i, found = FALSE;
+   for (;;) {
+      uint32 len = 0;
+      set_file_offset(f, loc);
+      if (!getn(f, header, 27) || memcmp(header, ogg_page_header, 4)) break;
+      if (header[14] + (header[15] << 8) + (header[16] << 16) + ((uint32)header[17] << 24) != serial) break;
+      if (!getn(f, lacing, header[26])) break;
+      for (i=0; i < header[26]; ++i)
+         len += lacing[i];
+      *last_page_loc = loc;
+      loc += 27 + header[26] + len;
+      *end = loc;
+      found = TRUE;
+      if (header[5] & PAGEFLAG_last_page) break;
+   }
+   return found;
+}
+
 unsigned int stb_vorbis_stream_length_in_samples(stb_vorbis *f)
 {
    unsigned int restore_offset, previous_safe;
    unsigned int end, last_page_loc;
+   uint32 serial;
 
    if (IS_PUSH_MODE(f)) return error(f, VORBIS_invalid_api_mixing);
    if (!f->total_samples) {
@@ -4990,6 +5341,15 @@ unsigned int stb_vorbis_stream_length_in_samples(stb_vorbis *f)
          last_page_loc = stb_vorbis_get_file_offset(f);
       }
 
+      // lancerdecode: chained files, the last page must be this link's
+      serial = page_serial(f, f->first_audio_page_offset);
+      if (page_serial(f, last_page_loc) != serial &&
+          !link_last_page(f, serial, &last_page_loc, &end)) {
+         f->error = VORBIS_cant_find_last_page;
+         f->total_samples = 0xffffffff;
+         goto done;
+      }
+
       set_file_offset(f, last_page_loc);
 
       // parse the header
@@ -5045,6 +5405,29 @@ int stb_vorbis_get_frame_float(stb_vorbis *f, int *channels, float ***output)
    return len;
 }
 
+// lancerdecode: chained files
+int stb_vorbis_fill_frame(stb_vorbis *f)
+{
+   return f->channel_buffer_start < f->channel_buffer_end ||
+      stb_vorbis_get_frame_float(f, NULL, NULL);
+}
+
+// lancerdecode: zero-copy output
+int stb_vorbis_lend_frame_float(stb_vorbis *f, float ***output, int max_samples)
+{
+   int i, n;
+   if (f->channel_buffer_start >= f->channel_buffer_end &&
+       !stb_vorbis_get_frame_float(f, NULL, NULL))
+      return 0;
+   n = f->channel_buffer_end - f->channel_buffer_start;
+   if (n > max_samples) n = max_samples;
+   for (i=0; i < f->channels; ++i)
+      f->outputs[i] = f->channel_buffers[i] + f->channel_buffer_start;
+   f->channel_buffer_start += n;
+   *output = f->outputs;
+   return n;
+}
+
 #ifndef STB_VORBIS_NO_STDIO
 
 stb_vorbis * stb_vorbis_open_file_section(ld_stream_t file, int close_on_free, int *error, const stb_vorbis_alloc *alloc, unsigned int length)
@@ -5068,13 +5451,54 @@ stb_vorbis * stb_vorbis_open_file_section(ld_stream_t file, int close_on_free, i
    return NULL;
 }
 
+unsigned int stb_vorbis_next_link_offset(stb_vorbis *f)
+{
+   return f->next_link_offset;
+}
+
+int stb_vorbis_start_link(stb_vorbis *f, unsigned int offset, int *error)
+{
+   stb_vorbis p;
+   uint32 end = f->f_start + f->stream_len;
+   if (IS_PUSH_MODE(f) || offset >= end) {
+      if (error) *error = VORBIS_seek_invalid;
+      return 0;
+   }
+   vorbis_init(&p, &f->alloc);
+   p.f = f->f;
+   p.f_start = offset;
+   p.stream_len = end - offset;
+   p.link_prev = f;
+   if (f->f->seek(f->f, offset, LDSEEK_SET) || !start_decoder(&p)) {
+      // buffers are only taken over once nothing else can fail
+      if (error) *error = p.error;
+      vorbis_deinit(&p);
+      f->next_link_offset = 0;
+      return 0;
+   }
+   // f's setup is released after p took its reference, so a link with the
+   // same setup header reuses the cached tables
+   p.close_on_free = f->close_on_free;
+   f->close_on_free = FALSE;
+   vorbis_deinit(f);
+   p.link_prev = NULL;
+   *f = p;
+   vorbis_pump_first_frame(f);
+   return 1;
+}
+
 stb_vorbis * stb_vorbis_open_file(ld_stream_t file, int close_on_free, int *error, const stb_vorbis_alloc *alloc)
 {
    unsigned int len, start;
    start = (unsigned int) file->tell(file);
-   file->seek(file, 0, SEEK_END);
-   len = (unsigned int) (file->tell(file) - start);
-   file->seek(file, start, SEEK_SET);
+   // lancerdecode: forward-only streams can't seek to the end, decode them
+   // until the data runs out
+   if (file->seek(file, 0, LDSEEK_END)) {
+      len = 0x7fffffff - start;
+   } else {
+      len = (unsigned int) (file->tell(file) - start);
+      file->seek(file, start, LDSEEK_SET);
+   }
    return stb_vorbis_open_file_section(file, close_on_free, error, alloc, len);
 }
 
@@ -5162,15 +5586,7 @@ static int8 channel_position[7][6] =
 
 static void copy_samples(short *dest, float *src, int len)
 {
-   int i;
-   check_endianness();
-   for (i=0; i < len; ++i) {
-      FASTDEF(temp);
-      int v = FAST_SCALED_FLOAT_TO_INT(temp, src[i],15);
-      if ((unsigned int) (v + 32768) > 65535)
-         v = v < 0 ? -32768 : 32767;
-      dest[i] = v;
-   }
+   convert_f32_to_s16(src, dest, len);
 }
 
 static void compute_samples(int mask, short *output, int num_c, float **data, int d_offset, int len)
@@ -5188,13 +5604,7 @@ static void compute_samples(int mask, short *output, int num_c, float **data, in
                buffer[i] += data[j][d_offset+o+i];
          }
       }
-      for (i=0; i < n; ++i) {
-         FASTDEF(temp);
-         int v = FAST_SCALED_FLOAT_TO_INT(temp,buffer[i],15);
-         if ((unsigned int) (v + 32768) > 65535)
-            v = v < 0 ? -32768 : 32767;
-         output[o+i] = v;
-      }
+      convert_f32_to_s16(buffer, output+o, n);
    }
    #undef STB_BUFFER_SIZE
 }
@@ -5228,13 +5638,7 @@ static void compute_stereo_samples(short *output, int num_c, float **data, int d
             }
          }
       }
-      for (i=0; i < (n<<1); ++i) {
-         FASTDEF(temp);
-         int v = FAST_SCALED_FLOAT_TO_INT(temp,buffer[i],15);
-         if ((unsigned int) (v + 32768) > 65535)
-            v = v < 0 ? -32768 : 32767;
-         output[o2+i] = v;
-      }
+      convert_f32_to_s16(buffer, output+o2, n<<1);
    }
    #undef STB_BUFFER_SIZE
 }
@@ -5273,8 +5677,10 @@ static void convert_channels_short_interleaved(int buf_c, short *buffer, int dat
       assert(buf_c == 2);
       for (i=0; i < buf_c; ++i)
          compute_stereo_samples(buffer, data_c, data, d_offset, len);
+   } else if (buf_c <= data_c) {
+      convert_interleave_f32_to_s16(data, d_offset, buf_c, len, buffer);
    } else {
-      int limit = buf_c < data_c ? buf_c : data_c;
+      int limit = data_c;
       int j;
       for (j=0; j < len; ++j) {
          for (i=0; i < limit; ++i) {
@@ -5432,11 +5838,17 @@ int stb_vorbis_get_samples_float_interleaved(stb_vorbis *f, int channels, float
       int i,j;
       int k = f->channel_buffer_end - f->channel_buffer_start;
       if (n+k >= len) k = len - n;
-      for (j=0; j < k; ++j) {
-         for (i=0; i < z; ++i)
-            *buffer++ = f->channel_buffers[i][f->channel_buffer_start+j];
-         for (   ; i < channels; ++i)
-            *buffer++ = 0;
+      // lancerdecode: the shared SIMD interleave when no channels are padded
+      if (z == channels) {
+         convert_interleave_f32(f->channel_buffers, f->channel_buffer_start, channels, k, buffer);
+         buffer += k * channels;
+      } else {
+         for (j=0; j < k; ++j) {
+            for (i=0; i < z; ++i)
+               *buffer++ = f->channel_buffers[i][f->channel_buffer_start+j];
+            for (   ; i < channels; ++i)
+               *buffer++ = 0;
+         }
       }
       n += k;
       f->channel_buffer_start += k;
@@ -6,7 +6,11 @@
 #include "../formats.h"
 #include "../logging.h"
 #include "../sbuffer.h"
+#include "../stream.h"
 #include "../properties.h"
+#include "../convert.h"
+#include "../ogg.h"
+#include "vorbis_simd.h"
 
 #define STB_VORBIS_NO_PUSHDATA_API
 #include "stb_vorbis.c"
@@ -63,23 +67,172 @@ const char *stb_vorbis_strerror(int err)
 typedef struct {
 	stb_vorbis *vorbis;
     ld_stream_t sbuffer;
-	int channels;
+	int channels; //output channels, stb_vorbis downmixes to 2
+	int isFloat;
+	int64_t position; //frame the next read returns
+	//chained files: links are decoded one after another by the same stb_vorbis
+	unsigned int firstLink; //file offset of link 0
+	int link;
+	int formatLink; //link the pcmstream's format describes, applied by the next read
+	int64_t linkFrame; //position of the current link's first frame
+	int64_t firstLinkFrames; //frames in link 0, -1 until it has been decoded
+	unsigned int linkOffset; //file offset of the current link
+	//the link holding the loop start, so loops can return to it
+	int64_t markFrame; //-1 without a loop start
+	int markLink; //-1 until the link holding markFrame was started
+	unsigned int markOffset;
+	int64_t markLinkFrame;
 	ld_pcmstream_t pcm;
+	ld_allocator_t alloc;
 } ogg_userdata_t;
 
-size_t ogg_read(void* ptr, size_t size, ld_stream_t stream)
+//userdata, streams and the per-stream stb_vorbis state (decode buffers,
+//twiddle tables) of a typical stereo file, larger blocksizes spill to the
+//options allocator. codebooks live in the shared setup cache
+#define VORBIS_SETUP_ARENA_SIZE (64 * 1024)
+#define VORBIS_ARENA_SIZE (PCMSTREAM_ARENA_SIZE + STREAM_ARENA_SIZE + SBUFFER_ARENA_SIZE + \
+	sizeof(ogg_userdata_t) + VORBIS_SETUP_ARENA_SIZE)
+
+//output channels and sample type of the current link
+static void ogg_linkformat(ogg_userdata_t *userdata, int *channels, int *isFloat)
+{
+	ld_options_t options = &userdata->pcm->_internal->options;
+	stb_vorbis_info info = stb_vorbis_get_info(userdata->vorbis);
+	*channels = info.channels;
+	if(info.channels > 2 && info.channels > options_max_channels(options)) {
+		*channels = 2;
+	}
+	//stb_vorbis only downmixes 16-bit output
+	*isFloat = options_float(options) && *channels == info.channels;
+}
+
+static void ogg_setformat(ogg_userdata_t *userdata)
+{
+	ld_pcmstream_t pcm = userdata->pcm;
+	ogg_linkformat(userdata, &userdata->channels, &userdata->isFloat);
+	pcm->frequency = stb_vorbis_get_info(userdata->vorbis).sample_rate;
+	pcmstream_set_format(pcm, userdata->channels, userdata->isFloat);
+	const char *order = userdata->channels > 2 ? vorbis_channel_order(userdata->channels) : NULL;
+	if(order) {
+		set_property_string(pcm, LD_PROPERTY_ID_CHANNEL_ORDER, order);
+	} else {
+		clear_property(pcm, LD_PROPERTY_ID_CHANNEL_ORDER);
+	}
+}
+
+static int ogg_formatchanges(ogg_userdata_t *userdata)
+{
+	int channels, isFloat;
+	ogg_linkformat(userdata, &channels, &isFloat);
+	return channels != userdata->channels || isFloat != userdata->isFloat ||
+		stb_vorbis_get_info(userdata->vorbis).sample_rate != (unsigned int)userdata->pcm->frequency;
+}
+
+//restarts the decoder on the link at offset, its format is applied by the next read
+static int ogg_startlink(ogg_userdata_t *userdata, unsigned int offset, int link, int64_t frame)
+{
+	int err;
+	if(!stb_vorbis_start_link(userdata->vorbis, offset, &err)) {
+		LOG_S_ERROR_F(userdata->pcm, "Vorbis: chained link failed: %s", stb_vorbis_strerror(err));
+		return 0;
+	}
+	if(userdata->link == 0 && link == 1) {
+		userdata->firstLinkFrames = frame;
+	}
+	userdata->link = link;
+	userdata->linkFrame = frame;
+	userdata->linkOffset = offset;
+	userdata->position = frame;
+	if(userdata->markFrame >= frame && frame >= userdata->markLinkFrame) {
+		userdata->markLink = link;
+		userdata->markOffset = offset;
+		userdata->markLinkFrame = frame;
+	}
+	return 1;
+}
+
+//applies the current link's format once the frames before it were returned,
+//returns 1 instead when keep is set and the format changes
+static int ogg_applyformat(ogg_userdata_t *userdata, int keep)
+{
+	if(userdata->formatLink == userdata->link) return 0;
+	if(keep && ogg_formatchanges(userdata)) return 1;
+	userdata->formatLink = userdata->link;
+	ogg_setformat(userdata);
+	pcmstream_link_changed(userdata->pcm, userdata->link);
+	return 0;
+}
+
+static int ogg_nextformat(ld_pcmstream_t pcm, int keep)
+{
+	ogg_userdata_t *userdata = (ogg_userdata_t*)pcm->_internal->seeker.data;
+	//reads start the next link once the current one runs out, do it now
+	//so the format is known before the read
+	if(!stb_vorbis_fill_frame(userdata->vorbis)) {
+		unsigned int next = stb_vorbis_next_link_offset(userdata->vorbis);
+		if(next) ogg_startlink(userdata, next, userdata->link + 1, userdata->position);
+	}
+	return ogg_applyformat(userdata, keep);
+}
+
+static size_t ogg_readlink(ogg_userdata_t *userdata, void *ptr, size_t size)
 {
-	ogg_userdata_t *userdata = (ogg_userdata_t*)stream->userData;
 	size_t sz_bytes = size;
+	if(userdata->isFloat) {
+		if((sz_bytes % sizeof(float)) != 0) {
+			LOG_S_ERROR(userdata->pcm, "ogg_read: buffer size must be a multiple of sizeof(float)");
+			return 0;
+		}
+		int res = stb_vorbis_get_samples_float_interleaved(userdata->vorbis, userdata->channels, (float*)ptr, sz_bytes / sizeof(float));
+		userdata->position += res;
+		return res * sizeof(float) * userdata->channels;
+	}
 	if((sz_bytes % 2) != 0) {
 		LOG_S_ERROR(userdata->pcm, "ogg_read: buffer size must be a multiple of sizeof(short)");
 		return 0;
 	}
 	int num_shorts = sz_bytes / sizeof(short);
 	int res = stb_vorbis_get_samples_short_interleaved(userdata->vorbis, userdata->channels, (short*)ptr, num_shorts);
+	userdata->position += res;
 	return res * sizeof(short) * userdata->channels;
 }
 
+size_t ogg_read(void* ptr, size_t size, ld_stream_t stream)
+{
+	ogg_userdata_t *userdata = (ogg_userdata_t*)stream->userData;
+	size_t done = 0;
+	for(;;) {
+		//frames of a differently formatted link wait for the next read
+		if(ogg_applyformat(userdata, done > 0)) break;
+		done += ogg_readlink(userdata, (char*)ptr + done, size - done);
+		unsigned int next = stb_vorbis_next_link_offset(userdata->vorbis);
+		if(done == size || !next || !ogg_startlink(userdata, next, userdata->link + 1, userdata->position))
+			break;
+	}
+	return done;
+}
+
+static int32_t ogg_lendframes(ld_pcmstream_t pcm, float ***planes, int32_t maxFrames)
+{
+	ogg_userdata_t *userdata = (ogg_userdata_t*)pcm->_internal->lender.data;
+	for(;;) {
+		ogg_applyformat(userdata, 0);
+		//the channel buffers hold the source channels, downmixing needs read
+		if(userdata->channels != userdata->vorbis->channels) {
+			LOG_S_ERROR(pcm, "Vorbis: downmixed output can't be lent, use read");
+			return -1;
+		}
+		int res = stb_vorbis_lend_frame_float(userdata->vorbis, planes, maxFrames);
+		if(res) {
+			userdata->position += res;
+			return res;
+		}
+		unsigned int next = stb_vorbis_next_link_offset(userdata->vorbis);
+		if(!next || !ogg_startlink(userdata, next, userdata->link + 1, userdata->position))
+			return 0;
+	}
+}
+
 int ogg_seek(ld_stream_t stream, int32_t offset, LDSEEK origin)
 {
 	ogg_userdata_t *userdata = (ogg_userdata_t*)stream->userData;
@@ -87,55 +240,192 @@ int ogg_seek(ld_stream_t stream, int32_t offset, LDSEEK origin)
 		LOG_S_ERROR(userdata->pcm, "ogg_seek: only can seek to LDSEEK_SET 0");
 		return -1;
 	}
-	stb_vorbis_seek(userdata->vorbis, 0);
+	if(userdata->link) {
+		return ogg_startlink(userdata, userdata->firstLink, 0, 0) ? 0 : -1;
+	}
+	if(!stb_vorbis_seek(userdata->vorbis, 0)) {
+		LOG_S_ERROR(userdata->pcm, "ogg_seek: stb_vorbis_seek failed");
+		return -1;
+	}
+	userdata->position = 0;
+	return 0;
+}
+
+static int ogg_seekframe(ld_pcmstream_t pcm, int64_t frame)
+{
+	ogg_userdata_t *userdata = (ogg_userdata_t*)pcm->_internal->seeker.data;
+	//only the current link, link 0 and the loop start's link can be found
+	//again in a chained file
+	if(frame < userdata->linkFrame) {
+		int started;
+		if(userdata->markLink > 0 && frame >= userdata->markLinkFrame)
+			started = ogg_startlink(userdata, userdata->markOffset, userdata->markLink, userdata->markLinkFrame);
+		else if(frame < userdata->firstLinkFrames)
+			started = ogg_startlink(userdata, userdata->firstLink, 0, 0);
+		else
+			started = 0;
+		if(!started) return -1;
+	}
+	frame -= userdata->linkFrame;
+	if(frame > UINT32_MAX || !stb_vorbis_seek(userdata->vorbis, (unsigned int)frame)) {
+		return -1;
+	}
+	frame += userdata->linkFrame;
+	userdata->position = frame;
 	return 0;
 }
 
+static void ogg_markframe(ld_pcmstream_t pcm, int64_t frame)
+{
+	ogg_userdata_t *userdata = (ogg_userdata_t*)pcm->_internal->seeker.data;
+	userdata->markFrame = frame;
+	userdata->markLink = -1;
+	userdata->markLinkFrame = -1;
+	//a later link replaces this once it starts before frame
+	if(frame >= userdata->linkFrame) {
+		userdata->markLink = userdata->link;
+		userdata->markOffset = userdata->linkOffset;
+		userdata->markLinkFrame = userdata->linkFrame;
+	}
+}
+
+static int64_t ogg_tellframe(ld_pcmstream_t pcm)
+{
+	ogg_userdata_t *userdata = (ogg_userdata_t*)pcm->_internal->seeker.data;
+	return userdata->position;
+}
+
+//value of a NAME=value comment, names are case-insensitive ASCII
+static const char *ogg_commentvalue(const char *comment, const char *name)
+{
+	for(; *name; name++, comment++) {
+		char c = *comment;
+		if(c >= 'a' && c <= 'z') c -= 'a' - 'A';
+		if(c != *name) return NULL;
+	}
+	return *comment == '=' ? comment + 1 : NULL;
+}
+
+//LOOPSTART=frame and LOOPLENGTH=frames comments, as used by RPG Maker and others
+static void ogg_readloop(ld_pcmstream_t pcm, stb_vorbis *vorbis)
+{
+	stb_vorbis_comment comment = stb_vorbis_get_comment(vorbis);
+	long start = -1;
+	long length = -1;
+	for(int i = 0; i < comment.comment_list_length; i++) {
+		const char *value;
+		if((value = ogg_commentvalue(comment.comment_list[i], "LOOPSTART"))) {
+			start = strtol(value, NULL, 10);
+		} else if((value = ogg_commentvalue(comment.comment_list[i], "LOOPLENGTH"))) {
+			length = strtol(value, NULL, 10);
+		}
+	}
+	if(start >= 0 && start <= INT32_MAX) {
+		set_property_int(pcm, LD_PROPERTY_ID_LOOP_START, (int)start);
+		if(length > 0 && length <= INT32_MAX)
+			set_property_int(pcm, LD_PROPERTY_ID_LOOP_LENGTH, (int)length);
+	}
+}
+
 void ogg_close(ld_stream_t stream)
 {
 	ogg_userdata_t *userdata = (ogg_userdata_t*)stream->userData;
+	ld_allocator_t alloc = userdata->alloc;
 	stb_vorbis_close(userdata->vorbis);
     userdata->sbuffer->close(userdata->sbuffer);
-	free(userdata);
-	free(stream);
+	mem_free(&alloc, userdata);
+	mem_free(&alloc, stream);
+}
+
+const char *vorbis_channel_order(int channels)
+{
+	//Vorbis I specification, section 4.3.9
+	switch(channels) {
+		case 3: return "FL,FC,FR";
+		case 4: return "FL,FR,RL,RR";
+		case 5: return "FL,FC,FR,RL,RR";
+		case 6: return "FL,FC,FR,RL,RR,LFE";
+		case 7: return "FL,FC,FR,SL,SR,RC,LFE";
+		case 8: return "FL,FC,FR,SL,SR,RL,RR,LFE";
+		default: return NULL;
+	}
+}
+
+int32_t vorbis_score(const unsigned char *peek, int32_t peekSize, void *userdata)
+{
+	size_t length;
+	const unsigned char *packet = ogg_first_packet(peek, peekSize, &length);
+	if(packet && length >= 7 && !memcmp(packet, "\x01vorbis", 7)) return LD_SCORE_MAX;
+	//other and truncated Ogg files fall through to the vorbis header check, which reports them
+	return peekSize >= 4 && !memcmp(peek, "OggS", 4) ? 1 : 0;
 }
 
 ld_pcmstream_t vorbis_getstream(ld_stream_t stream, ld_options_t options, const char **error)
 {
 	int err;
-    ld_stream_t sbuffer = sbuffer_create(stream);
-	stb_vorbis *vorbis = stb_vorbis_open_file(sbuffer, 0, &err, NULL);
+	if(!vorbis_simd) vorbis_simd_init();
+	ld_allocator_t alloc = options_allocator(options);
+	ld_arena_t *arena = arena_create(&alloc, VORBIS_ARENA_SIZE);
+	if(!arena) {
+		LOG_O_ERROR(options, "Vorbis: out of memory");
+		*error = "Out of memory";
+		return NULL;
+	}
+	stb_vorbis_alloc vorbis_alloc;
+	memset(&vorbis_alloc, 0, sizeof(stb_vorbis_alloc));
+	vorbis_alloc.allocator = arena_allocator(arena, ARENA_DECODER);
+	//codebooks outlive this stream when another one shares them
+	vorbis_alloc.shared_allocator = options_allocator(options);
+	vorbis_alloc.share_setup = 1;
+	alloc = arena_allocator(arena, ARENA_BUFFERS);
+    ld_stream_t sbuffer = sbuffer_create(stream, &alloc);
+	unsigned int firstLink = (unsigned int)sbuffer->tell(sbuffer);
+	stb_vorbis *vorbis = stb_vorbis_open_file(sbuffer, 0, &err, &vorbis_alloc);
 	if(!vorbis) {
         sbuffer_free(sbuffer);
+		arena_destroy(arena);
 		LOG_O_ERROR_F(options, "Vorbis decode failed: %s", stb_vorbis_strerror(err));
 		*error = stb_vorbis_strerror(err);
-		stream->close(stream);
 		return NULL;
 	}
-	stb_vorbis_info info = stb_vorbis_get_info(vorbis);
-	ogg_userdata_t *userdata = (ogg_userdata_t*)malloc(sizeof(ogg_userdata_t));
-	userdata->channels = info.channels;
+	alloc = arena_allocator(arena, ARENA_OVERHEAD);
+	ogg_userdata_t *userdata = (ogg_userdata_t*)mem_alloc(&alloc, sizeof(ogg_userdata_t));
+	userdata->position = 0;
+	userdata->firstLink = firstLink;
+	userdata->link = 0;
+	userdata->formatLink = 0;
+	userdata->linkFrame = 0;
+	userdata->firstLinkFrames = -1;
+	userdata->linkOffset = firstLink;
+	userdata->markFrame = -1;
+	userdata->markLink = -1;
+	userdata->markOffset = 0;
+	userdata->markLinkFrame = -1;
 	userdata->vorbis = vorbis;
     userdata->sbuffer = sbuffer;
-	ld_stream_t data = ld_stream_new();
+	userdata->alloc = alloc;
+	ld_stream_t data = stream_new(&userdata->alloc);
 	data->read = &ogg_read;
 	data->seek = &ogg_seek;
 	data->close = &ogg_close;
 	data->userData = userdata;
 
-	ld_pcmstream_t retsound = pcmstream_init(options);
-	retsound->frequency = info.sample_rate;
+	ld_pcmstream_t retsound = pcmstream_init(options, arena);
 	userdata->pcm = retsound;
 	retsound->stream = data;
 	retsound->dataSize = -1;
-	retsound->blockSize = OGG_BUFFER_SIZE;
-    set_property_string(retsound, LD_PROPERTY_CONTAINER, "ogg");
-    set_property_string(retsound, LD_PROPERTY_CODEC, "vorbis");
-	if(info.channels == 2) {
-		retsound->format = LDFORMAT_STEREO16;
-	} else {
-		retsound->format = LDFORMAT_MONO16;
-	}
+	retsound->_internal->seeker.seek = &ogg_seekframe;
+	retsound->_internal->seeker.tell = &ogg_tellframe;
+	retsound->_internal->seeker.mark = &ogg_markframe;
+	retsound->_internal->seeker.nextformat = &ogg_nextformat;
+	retsound->_internal->seeker.data = userdata;
+	retsound->_internal->lender.acquire = &ogg_lendframes;
+	retsound->_internal->lender.data = userdata;
+    set_property_string(retsound, LD_PROPERTY_ID_CONTAINER, "ogg");
+    set_property_string(retsound, LD_PROPERTY_ID_CODEC, "vorbis");
+	ogg_readloop(retsound, vorbis);
+	ogg_setformat(userdata);
+	retsound->blockSize = OGG_BUFFER_SIZE * (userdata->isFloat ? 2 : 1);
 	return retsound;
 }
 
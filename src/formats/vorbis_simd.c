@@ -0,0 +1,342 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "vorbis_simd.h"
+#include "../cpu.h"
+#include <stddef.h>
+
+#if defined(CPU_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#elif defined(CPU_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Butterfly layout: a block is 8 floats e[-7..0] holding 4 complex pairs,
+ * pair p being (e[-2p], e[-2p-1]). Loaded forwards, a vector of 4 is
+ * [y1, x1, y0, x0] and each pair becomes
+ *   x' = x * A0 - y * A1
+ *   y' = y * A0 + x * A1
+ * which is v * [A0 A0] + swap(v) * [-A1 A1] with the sign folded into the
+ * constant; negation is exact so the rounding matches the scalar code.
+ */
+
+/*
+ * Inverse coupling without branches: with a' = (m > 0) ? -a : a the four
+ * cases of the spec collapse to
+ *   a > 0:  m2 = m,      a2 = m + a'
+ *   else:   m2 = m - a', a2 = m
+ */
+static inline void coupling_scalar(float *m, float *a)
+{
+    float m2, a2;
+    if(*m > 0)
+        if(*a > 0)
+            m2 = *m, a2 = *m - *a;
+        else
+            a2 = *m, m2 = *m + *a;
+    else
+        if(*a > 0)
+            m2 = *m, a2 = *m + *a;
+        else
+            a2 = *m, m2 = *m - *a;
+    *m = m2;
+    *a = a2;
+}
+
+#ifdef CPU_X86
+
+/* SSE2 */
+
+#define SWAP_PAIRS_SSE(v) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(2, 3, 0, 1))
+#define REVERSE_SSE(v) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(0, 1, 2, 3))
+
+TARGET_SSE2 static inline void butterfly_sse2(float *e0, float *e2, __m128 mul0, __m128 mul1)
+{
+    __m128 a = _mm_loadu_ps(e0);
+    __m128 b = _mm_loadu_ps(e2);
+    __m128 k = _mm_sub_ps(a, b);
+    _mm_storeu_ps(e0, _mm_add_ps(a, b));
+    _mm_storeu_ps(e2, _mm_add_ps(_mm_mul_ps(k, mul0), _mm_mul_ps(SWAP_PAIRS_SSE(k), mul1)));
+}
+
+TARGET_SSE2 static void imdct_butterfly_r_sse2(float *e0, float *e2, const float *A, int a_step, int blocks)
+{
+    for(int i = 0; i < blocks; i++) {
+        const float *p0 = A, *p1 = A + a_step, *p2 = A + a_step * 2, *p3 = A + a_step * 3;
+        butterfly_sse2(e0 - 3, e2 - 3,
+            _mm_setr_ps(p1[0], p1[0], p0[0], p0[0]),
+            _mm_setr_ps(p1[1], -p1[1], p0[1], -p0[1]));
+        butterfly_sse2(e0 - 7, e2 - 7,
+            _mm_setr_ps(p3[0], p3[0], p2[0], p2[0]),
+            _mm_setr_ps(p3[1], -p3[1], p2[1], -p2[1]));
+        A += a_step * 4;
+        e0 -= 8;
+        e2 -= 8;
+    }
+}
+
+TARGET_SSE2 static void imdct_butterfly_s_sse2(float *e0, float *e2, const float *A, int a_off, int stride, int blocks)
+{
+    const float *p0 = A, *p1 = A + a_off, *p2 = A + a_off * 2, *p3 = A + a_off * 3;
+    __m128 hi0 = _mm_setr_ps(p1[0], p1[0], p0[0], p0[0]);
+    __m128 hi1 = _mm_setr_ps(p1[1], -p1[1], p0[1], -p0[1]);
+    __m128 lo0 = _mm_setr_ps(p3[0], p3[0], p2[0], p2[0]);
+    __m128 lo1 = _mm_setr_ps(p3[1], -p3[1], p2[1], -p2[1]);
+    for(int i = 0; i < blocks; i++) {
+        butterfly_sse2(e0 - 3, e2 - 3, hi0, hi1);
+        butterfly_sse2(e0 - 7, e2 - 7, lo0, lo1);
+        e0 -= stride;
+        e2 -= stride;
+    }
+}
+
+TARGET_SSE2 static void overlap_add_sse2(float *out, const float *prev, const float *window, int n)
+{
+    int j = 0;
+    for(; j + 4 <= n; j += 4) {
+        __m128 wf = _mm_loadu_ps(window + j);
+        __m128 wr = REVERSE_SSE(_mm_loadu_ps(window + n - 4 - j));
+        __m128 o = _mm_mul_ps(_mm_loadu_ps(out + j), wf);
+        __m128 p = _mm_mul_ps(_mm_loadu_ps(prev + j), wr);
+        _mm_storeu_ps(out + j, _mm_add_ps(o, p));
+    }
+    for(; j < n; j++)
+        out[j] = out[j] * window[j] + prev[j] * window[n - 1 - j];
+}
+
+TARGET_SSE2 static void inverse_coupling_sse2(float *m, float *a, int n)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    int j = 0;
+    for(; j + 4 <= n; j += 4) {
+        __m128 mv = _mm_loadu_ps(m + j);
+        __m128 av = _mm_loadu_ps(a + j);
+        __m128 ap = _mm_xor_ps(av, _mm_and_ps(_mm_cmpgt_ps(mv, zero), sign));
+        __m128 apos = _mm_cmpgt_ps(av, zero);
+        __m128 m2 = _mm_or_ps(_mm_and_ps(apos, mv), _mm_andnot_ps(apos, _mm_sub_ps(mv, ap)));
+        __m128 a2 = _mm_or_ps(_mm_and_ps(apos, _mm_add_ps(mv, ap)), _mm_andnot_ps(apos, mv));
+        _mm_storeu_ps(m + j, m2);
+        _mm_storeu_ps(a + j, a2);
+    }
+    for(; j < n; j++)
+        coupling_scalar(m + j, a + j);
+}
+
+static const vorbis_simd_t simd_sse2 = {
+    "sse2",
+    imdct_butterfly_r_sse2,
+    imdct_butterfly_s_sse2,
+    overlap_add_sse2,
+    inverse_coupling_sse2
+};
+
+/* AVX2 */
+
+//one block of 8 is exactly one ymm register
+TARGET_AVX2 static inline void butterfly_avx2(float *e0, float *e2, __m256 mul0, __m256 mul1)
+{
+    __m256 a = _mm256_loadu_ps(e0);
+    __m256 b = _mm256_loadu_ps(e2);
+    __m256 k = _mm256_sub_ps(a, b);
+    _mm256_storeu_ps(e0, _mm256_add_ps(a, b));
+    _mm256_storeu_ps(e2, _mm256_add_ps(_mm256_mul_ps(k, mul0),
+        _mm256_mul_ps(_mm256_permute_ps(k, _MM_SHUFFLE(2, 3, 0, 1)), mul1)));
+}
+
+TARGET_AVX2 static void imdct_butterfly_r_avx2(float *e0, float *e2, const float *A, int a_step, int blocks)
+{
+    for(int i = 0; i < blocks; i++) {
+        const float *p0 = A, *p1 = A + a_step, *p2 = A + a_step * 2, *p3 = A + a_step * 3;
+        butterfly_avx2(e0 - 7, e2 - 7,
+            _mm256_setr_ps(p3[0], p3[0], p2[0], p2[0], p1[0], p1[0], p0[0], p0[0]),
+            _mm256_setr_ps(p3[1], -p3[1], p2[1], -p2[1], p1[1], -p1[1], p0[1], -p0[1]));
+        A += a_step * 4;
+        e0 -= 8;
+        e2 -= 8;
+    }
+}
+
+TARGET_AVX2 static void imdct_butterfly_s_avx2(float *e0, float *e2, const float *A, int a_off, int stride, int blocks)
+{
+    const float *p0 = A, *p1 = A + a_off, *p2 = A + a_off * 2, *p3 = A + a_off * 3;
+    __m256 mul0 = _mm256_setr_ps(p3[0], p3[0], p2[0], p2[0], p1[0], p1[0], p0[0], p0[0]);
+    __m256 mul1 = _mm256_setr_ps(p3[1], -p3[1], p2[1], -p2[1], p1[1], -p1[1], p0[1], -p0[1]);
+    for(int i = 0; i < blocks; i++) {
+        butterfly_avx2(e0 - 7, e2 - 7, mul0, mul1);
+        e0 -= stride;
+        e2 -= stride;
+    }
+}
+
+TARGET_AVX2 static void overlap_add_avx2(float *out, const float *prev, const float *window, int n)
+{
+    int j = 0;
+    for(; j + 8 <= n; j += 8) {
+        __m256 wf = _mm256_loadu_ps(window + j);
+        __m256 wr = _mm256_loadu_ps(window + n - 8 - j);
+        wr = _mm256_permute_ps(_mm256_permute2f128_ps(wr, wr, 1), _MM_SHUFFLE(0, 1, 2, 3));
+        __m256 o = _mm256_mul_ps(_mm256_loadu_ps(out + j), wf);
+        __m256 p = _mm256_mul_ps(_mm256_loadu_ps(prev + j), wr);
+        _mm256_storeu_ps(out + j, _mm256_add_ps(o, p));
+    }
+    for(; j < n; j++)
+        out[j] = out[j] * window[j] + prev[j] * window[n - 1 - j];
+}
+
+TARGET_AVX2 static void inverse_coupling_avx2(float *m, float *a, int n)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    int j = 0;
+    for(; j + 8 <= n; j += 8) {
+        __m256 mv = _mm256_loadu_ps(m + j);
+        __m256 av = _mm256_loadu_ps(a + j);
+        __m256 ap = _mm256_xor_ps(av, _mm256_and_ps(_mm256_cmp_ps(mv, zero, _CMP_GT_OQ), sign));
+        __m256 apos = _mm256_cmp_ps(av, zero, _CMP_GT_OQ);
+        _mm256_storeu_ps(m + j, _mm256_blendv_ps(_mm256_sub_ps(mv, ap), mv, apos));
+        _mm256_storeu_ps(a + j, _mm256_blendv_ps(mv, _mm256_add_ps(mv, ap), apos));
+    }
+    for(; j < n; j++)
+        coupling_scalar(m + j, a + j);
+}
+
+static const vorbis_simd_t simd_avx2 = {
+    "avx2",
+    imdct_butterfly_r_avx2,
+    imdct_butterfly_s_avx2,
+    overlap_add_avx2,
+    inverse_coupling_avx2
+};
+
+static const vorbis_simd_t *select_simd(void)
+{
+    int features = cpu_features();
+    if(features & CPU_FEATURE_AVX2) return &simd_avx2;
+    if(features & CPU_FEATURE_SSE2) return &simd_sse2;
+    return NULL;
+}
+
+#elif defined(CPU_NEON)
+
+/* NEON */
+
+static inline float32x4_t reverse_neon(float32x4_t v)
+{
+    v = vrev64q_f32(v);
+    return vcombine_f32(vget_high_f32(v), vget_low_f32(v));
+}
+
+static inline float32x4_t setr_neon(float a, float b, float c, float d)
+{
+    float v[4] = { a, b, c, d };
+    return vld1q_f32(v);
+}
+
+//mul + add rather than vmlaq/vfmaq so nothing gets fused
+static inline void butterfly_neon(float *e0, float *e2, float32x4_t mul0, float32x4_t mul1)
+{
+    float32x4_t a = vld1q_f32(e0);
+    float32x4_t b = vld1q_f32(e2);
+    float32x4_t k = vsubq_f32(a, b);
+    vst1q_f32(e0, vaddq_f32(a, b));
+    vst1q_f32(e2, vaddq_f32(vmulq_f32(k, mul0), vmulq_f32(vrev64q_f32(k), mul1)));
+}
+
+static void imdct_butterfly_r_neon(float *e0, float *e2, const float *A, int a_step, int blocks)
+{
+    for(int i = 0; i < blocks; i++) {
+        const float *p0 = A, *p1 = A + a_step, *p2 = A + a_step * 2, *p3 = A + a_step * 3;
+        butterfly_neon(e0 - 3, e2 - 3,
+            setr_neon(p1[0], p1[0], p0[0], p0[0]),
+            setr_neon(p1[1], -p1[1], p0[1], -p0[1]));
+        butterfly_neon(e0 - 7, e2 - 7,
+            setr_neon(p3[0], p3[0], p2[0], p2[0]),
+            setr_neon(p3[1], -p3[1], p2[1], -p2[1]));
+        A += a_step * 4;
+        e0 -= 8;
+        e2 -= 8;
+    }
+}
+
+static void imdct_butterfly_s_neon(float *e0, float *e2, const float *A, int a_off, int stride, int blocks)
+{
+    const float *p0 = A, *p1 = A + a_off, *p2 = A + a_off * 2, *p3 = A + a_off * 3;
+    float32x4_t hi0 = setr_neon(p1[0], p1[0], p0[0], p0[0]);
+    float32x4_t hi1 = setr_neon(p1[1], -p1[1], p0[1], -p0[1]);
+    float32x4_t lo0 = setr_neon(p3[0], p3[0], p2[0], p2[0]);
+    float32x4_t lo1 = setr_neon(p3[1], -p3[1], p2[1], -p2[1]);
+    for(int i = 0; i < blocks; i++) {
+        butterfly_neon(e0 - 3, e2 - 3, hi0, hi1);
+        butterfly_neon(e0 - 7, e2 - 7, lo0, lo1);
+        e0 -= stride;
+        e2 -= stride;
+    }
+}
+
+static void overlap_add_neon(float *out, const float *prev, const float *window, int n)
+{
+    int j = 0;
+    for(; j + 4 <= n; j += 4) {
+        float32x4_t wf = vld1q_f32(window + j);
+        float32x4_t wr = reverse_neon(vld1q_f32(window + n - 4 - j));
+        float32x4_t o = vmulq_f32(vld1q_f32(out + j), wf);
+        float32x4_t p = vmulq_f32(vld1q_f32(prev + j), wr);
+        vst1q_f32(out + j, vaddq_f32(o, p));
+    }
+    for(; j < n; j++)
+        out[j] = out[j] * window[j] + prev[j] * window[n - 1 - j];
+}
+
+static void inverse_coupling_neon(float *m, float *a, int n)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const uint32x4_t sign = vdupq_n_u32(0x80000000);
+    int j = 0;
+    for(; j + 4 <= n; j += 4) {
+        float32x4_t mv = vld1q_f32(m + j);
+        float32x4_t av = vld1q_f32(a + j);
+        uint32x4_t flip = vandq_u32(vcgtq_f32(mv, zero), sign);
+        float32x4_t ap = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(av), flip));
+        uint32x4_t apos = vcgtq_f32(av, zero);
+        vst1q_f32(m + j, vbslq_f32(apos, mv, vsubq_f32(mv, ap)));
+        vst1q_f32(a + j, vbslq_f32(apos, vaddq_f32(mv, ap), mv));
+    }
+    for(; j < n; j++)
+        coupling_scalar(m + j, a + j);
+}
+
+static const vorbis_simd_t simd_neon = {
+    "neon",
+    imdct_butterfly_r_neon,
+    imdct_butterfly_s_neon,
+    overlap_add_neon,
+    inverse_coupling_neon
+};
+
+static const vorbis_simd_t *select_simd(void)
+{
+    return (cpu_features() & CPU_FEATURE_NEON) ? &simd_neon : NULL;
+}
+
+#else
+
+static const vorbis_simd_t *select_simd(void)
+{
+    return NULL;
+}
+
+#endif
+
+const vorbis_simd_t *vorbis_simd = NULL;
+
+const vorbis_simd_t *vorbis_simd_init(void)
+{
+    //every caller selects the same table, so racing here is harmless
+    const vorbis_simd_t *selected = select_simd();
+    vorbis_simd = selected;
+    return selected;
+}
@@ -0,0 +1,30 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//VORBIS SIMD
+//vector versions of the stb_vorbis inner loops, picked at runtime from the CPU features
+//every kernel does the same float operations in the same order as the scalar loop it
+//replaces, so the output matches the scalar path bit for bit
+#ifndef _VORBIS_SIMD_H_
+#define _VORBIS_SIMD_H_
+
+typedef struct {
+    const char *name;
+    //imdct step 3 butterflies over blocks of 8 floats walking down from e0/e2,
+    //each complex pair takes its twiddle from A, advancing a_step floats per pair
+    void (*imdct_butterfly_r)(float *e0, float *e2, const float *A, int a_step, int blocks);
+    //as above, but every block uses the same 4 twiddles (a_off apart) and blocks are stride floats apart
+    void (*imdct_butterfly_s)(float *e0, float *e2, const float *A, int a_off, int stride, int blocks);
+    //out[j] = out[j] * window[j] + prev[j] * window[n - 1 - j]
+    void (*overlap_add)(float *out, const float *prev, const float *window, int n);
+    //magnitude/angle -> channel values
+    void (*inverse_coupling)(float *m, float *a, int n);
+} vorbis_simd_t;
+
+//NULL when there is nothing faster than the scalar code
+extern const vorbis_simd_t *vorbis_simd;
+//Selects the kernels for this CPU, safe to call more than once
+const vorbis_simd_t *vorbis_simd_init(void);
+
+#endif
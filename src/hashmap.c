@@ -38,6 +38,10 @@ struct hashmap {
     void *(*malloc)(size_t);
     void *(*realloc)(void *, size_t);
     void (*free)(void *);
+    void *(*malloc_ud)(size_t, void *);
+    void *(*realloc_ud)(void *, size_t, void *);
+    void (*free_ud)(void *, void *);
+    void *allocudata;
     size_t elsize;
     size_t cap;
     uint64_t seed0;
@@ -98,20 +102,25 @@ static uint64_t get_hash(struct hashmap *map, const void *key) {
     return clip_hash(map->hash(key, map->seed0, map->seed1));
 }
 
+static void *map_malloc(const struct hashmap *map, size_t size) {
+    return map->malloc_ud ? map->malloc_ud(size, map->allocudata) : map->malloc(size);
+}
 
-// hashmap_new_with_allocator returns a new hash map using a custom allocator.
-// See hashmap_new for more information information
-struct hashmap *hashmap_new_with_allocator(void *(*_malloc)(size_t),
-                                           void *(*_realloc)(void*, size_t), void (*_free)(void*),
-                                           size_t elsize, size_t cap, uint64_t seed0, uint64_t seed1,
-                                           uint64_t (*hash)(const void *item, uint64_t seed0, uint64_t seed1),
-                                           int (*compare)(const void *a, const void *b, void *udata),
-                                           void (*elfree)(void *item),
-                                           void *udata)
+static void map_free(const struct hashmap *map, void *ptr) {
+    if (map->free_ud) map->free_ud(ptr, map->allocudata);
+    else map->free(ptr);
+}
+
+
+// hashmap_new0 creates a map that allocates with the functions stored in
+// `alloc`. Only the allocator fields of `alloc` are read.
+static struct hashmap *hashmap_new0(const struct hashmap *alloc,
+                                    size_t elsize, size_t cap, uint64_t seed0, uint64_t seed1,
+                                    uint64_t (*hash)(const void *item, uint64_t seed0, uint64_t seed1),
+                                    int (*compare)(const void *a, const void *b, void *udata),
+                                    void (*elfree)(void *item),
+                                    void *udata)
 {
-    _malloc = _malloc ? _malloc : __malloc ? __malloc : malloc;
-    _realloc = _realloc ? _realloc : __realloc ? __realloc : realloc;
-    _free = _free ? _free : __free ? __free : free;
     size_t ncap = 16;
     if (cap < ncap) {
         cap = ncap;
@@ -127,11 +136,18 @@ struct hashmap *hashmap_new_with_allocator(void *(*_malloc)(size_t),
     }
     // hashmap + spare + edata
     size_t size = sizeof(struct hashmap)+bucketsz*2;
-    struct hashmap *map = _malloc(size);
+    struct hashmap *map = map_malloc(alloc, size);
     if (!map) {
         return NULL;
     }
     memset(map, 0, sizeof(struct hashmap));
+    map->malloc = alloc->malloc;
+    map->realloc = alloc->realloc;
+    map->free = alloc->free;
+    map->malloc_ud = alloc->malloc_ud;
+    map->realloc_ud = alloc->realloc_ud;
+    map->free_ud = alloc->free_ud;
+    map->allocudata = alloc->allocudata;
     map->elsize = elsize;
     map->bucketsz = bucketsz;
     map->seed0 = seed0;
@@ -145,9 +161,9 @@ struct hashmap *hashmap_new_with_allocator(void *(*_malloc)(size_t),
     map->cap = cap;
     map->nbuckets = cap;
     map->mask = map->nbuckets-1;
-    map->buckets = _malloc(map->bucketsz*map->nbuckets);
+    map->buckets = map_malloc(map, map->bucketsz*map->nbuckets);
     if (!map->buckets) {
-        _free(map);
+        map_free(map, map);
         return NULL;
     }
     memset(map->buckets, 0, map->bucketsz*map->nbuckets);
@@ -155,12 +171,52 @@ struct hashmap *hashmap_new_with_allocator(void *(*_malloc)(size_t),
     map->loadfactor = clamp_load_factor(HASHMAP_LOAD_FACTOR, GROW_AT) * 100;
     map->growat = map->nbuckets * (map->loadfactor / 100.0);
     map->shrinkat = map->nbuckets * SHRINK_AT;
-    map->malloc = _malloc;
-    map->realloc = _realloc;
-    map->free = _free;
     return map;
 }
 
+// hashmap_new_with_allocator returns a new hash map using a custom allocator.
+// See hashmap_new for more information information
+struct hashmap *hashmap_new_with_allocator(void *(*_malloc)(size_t),
+                                           void *(*_realloc)(void*, size_t), void (*_free)(void*),
+                                           size_t elsize, size_t cap, uint64_t seed0, uint64_t seed1,
+                                           uint64_t (*hash)(const void *item, uint64_t seed0, uint64_t seed1),
+                                           int (*compare)(const void *a, const void *b, void *udata),
+                                           void (*elfree)(void *item),
+                                           void *udata)
+{
+    struct hashmap alloc;
+    memset(&alloc, 0, sizeof(struct hashmap));
+    alloc.malloc = _malloc ? _malloc : __malloc ? __malloc : malloc;
+    alloc.realloc = _realloc ? _realloc : __realloc ? __realloc : realloc;
+    alloc.free = _free ? _free : __free ? __free : free;
+    return hashmap_new0(&alloc, elsize, cap, seed0, seed1, hash, compare,
+                        elfree, udata);
+}
+
+// hashmap_new_with_allocator_udata works like hashmap_new_with_allocator but
+// the allocator functions also receive `allocudata`.
+struct hashmap *hashmap_new_with_allocator_udata(void *(*_malloc)(size_t, void*),
+                                                 void *(*_realloc)(void*, size_t, void*), void (*_free)(void*, void*),
+                                                 void *allocudata, size_t elsize, size_t cap, uint64_t seed0, uint64_t seed1,
+                                                 uint64_t (*hash)(const void *item, uint64_t seed0, uint64_t seed1),
+                                                 int (*compare)(const void *a, const void *b, void *udata),
+                                                 void (*elfree)(void *item),
+                                                 void *udata)
+{
+    if (!_malloc || !_realloc || !_free) {
+        return hashmap_new_with_allocator(NULL, NULL, NULL, elsize, cap, seed0,
+                                          seed1, hash, compare, elfree, udata);
+    }
+    struct hashmap alloc;
+    memset(&alloc, 0, sizeof(struct hashmap));
+    alloc.malloc_ud = _malloc;
+    alloc.realloc_ud = _realloc;
+    alloc.free_ud = _free;
+    alloc.allocudata = allocudata;
+    return hashmap_new0(&alloc, elsize, cap, seed0, seed1, hash, compare,
+                        elfree, udata);
+}
+
 // hashmap_new returns a new hash map.
 // Param `elsize` is the size of each element in the tree. Every element that
 // is inserted, deleted, or retrieved will be this size.
@@ -210,9 +266,9 @@ void hashmap_clear(struct hashmap *map, bool update_cap) {
     if (update_cap) {
         map->cap = map->nbuckets;
     } else if (map->nbuckets != map->cap) {
-        void *new_buckets = map->malloc(map->bucketsz*map->cap);
+        void *new_buckets = map_malloc(map, map->bucketsz*map->cap);
         if (new_buckets) {
-            map->free(map->buckets);
+            map_free(map, map->buckets);
             map->buckets = new_buckets;
         }
         map->nbuckets = map->cap;
@@ -224,9 +280,8 @@ void hashmap_clear(struct hashmap *map, bool update_cap) {
 }
 
 static bool resize0(struct hashmap *map, size_t new_cap) {
-    struct hashmap *map2 = hashmap_new_with_allocator(map->malloc, map->realloc,
-                                                      map->free, map->elsize, new_cap, map->seed0, map->seed1, map->hash,
-                                                      map->compare, map->elfree, map->udata);
+    struct hashmap *map2 = hashmap_new0(map, map->elsize, new_cap, map->seed0,
+                                        map->seed1, map->hash, map->compare, map->elfree, map->udata);
     if (!map2) return false;
     for (size_t i = 0; i < map->nbuckets; i++) {
         struct bucket *entry = bucket_at(map, i);
@@ -250,13 +305,13 @@ static bool resize0(struct hashmap *map, size_t new_cap) {
             entry->dib += 1;
         }
     }
-    map->free(map->buckets);
+    map_free(map, map->buckets);
     map->buckets = map2->buckets;
     map->nbuckets = map2->nbuckets;
     map->mask = map2->mask;
     map->growat = map2->growat;
     map->shrinkat = map2->shrinkat;
-    map->free(map2);
+    map_free(map, map2);
     return true;
 }
 
@@ -421,8 +476,8 @@ size_t hashmap_count(struct hashmap *map) {
 void hashmap_free(struct hashmap *map) {
     if (!map) return;
     free_elements(map);
-    map->free(map->buckets);
-    map->free(map);
+    map_free(map, map->buckets);
+    map_free(map, map);
 }
 
 // hashmap_oom returns true if the last hashmap_set() call failed due to the
@@ -30,6 +30,15 @@ extern "C" {
                                                void (*elfree)(void *item),
                                                void *udata);
 
+    struct hashmap *hashmap_new_with_allocator_udata(void *(*malloc)(size_t, void*),
+                                                     void *(*realloc)(void *, size_t, void*), void (*free)(void*, void*),
+                                                     void *allocudata, size_t elsize,
+                                                     size_t cap, uint64_t seed0, uint64_t seed1,
+                                                     uint64_t (*hash)(const void *item, uint64_t seed0, uint64_t seed1),
+                                                     int (*compare)(const void *a, const void *b, void *udata),
+                                                     void (*elfree)(void *item),
+                                                     void *udata);
+
     void hashmap_free(struct hashmap *map);
     void hashmap_clear(struct hashmap *map, bool update_cap);
     size_t hashmap_count(struct hashmap *map);
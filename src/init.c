@@ -0,0 +1,30 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "lancerdecode.h"
+#include "formats.h"
+#include "threads.h"
+#include "convert.h"
+#include "ogg.h"
+#include "formats/vorbis_simd.h"
+#include "formats/flac_simd.h"
+
+static ld_once_t init_once = LD_ONCE_INIT;
+
+//Everything here is written once and only read afterwards, so streams can
+//be opened from any number of threads without further locking
+static void init_globals(void)
+{
+    convert_init();
+    ogg_crc_init();
+    vorbis_simd_init();
+    flac_simd_init();
+    flac_global_init();
+    mp3_global_init();
+}
+
+LDEXPORT void ld_init(void)
+{
+    once_call(&init_once, init_globals);
+}
@@ -6,21 +6,59 @@
 #include <stdarg.h>
 #include <stdio.h>
 
-void ld_logf(ld_options_t options, int error, const char *fmt, ...)
+static ld_msgcallback_t log_callback(ld_options_t options, LDLOGLEVEL level)
+{
+	if(!options)
+		return NULL;
+	return level <= LDLOG_WARNING
+		? options->msgerror
+		: options->msginfo;
+}
+
+void ld_log(ld_options_t options, LDLOGLEVEL level, const char *msg)
+{
+	ld_msgcallback_t callback = log_callback(options, level);
+	if(callback)
+        callback(msg);
+	else
+        fprintf(level <= LDLOG_WARNING ? stderr : stdout, "%s\n", msg);
+}
+
+void ld_logf(ld_options_t options, LDLOGLEVEL level, const char *fmt, ...)
 {
-	ld_msgcallback_t callback = NULL;
-	if(options) {
-		callback = error 
-			? options->msgerror
-			: options->msginfo;
-	}
     char buffer[1024];
 	va_list args;
 	va_start(args, fmt);
 	vsnprintf(buffer,1024,fmt,args);
-	if(callback)
-        callback(buffer);
-	else
-        fprintf(error ? stderr : stdout, "%s\n", buffer);
 	va_end(args);
+	ld_log(options, level, buffer);
+}
+
+int log_stream_check(ld_pcmstream_t stream, LDLOGLEVEL level, uint32_t category, const char *fmt)
+{
+    ld_pcmstream_internal_t internal = stream->_internal;
+    if(!log_enabled(&internal->options, level, category))
+        return 0;
+    //messages are told apart by their format string, so a repeat with
+    //different arguments still counts as a repeat
+    if(internal->logLast == fmt && internal->logLevel == level) {
+        internal->logRepeats++;
+        return internal->logRepeats < LOG_REPEAT_LIMIT;
+    }
+    log_stream_flush(stream);
+    internal->logLast = fmt;
+    internal->logLevel = level;
+    internal->logRepeats = 0;
+    return 1;
+}
+
+void log_stream_flush(ld_pcmstream_t stream)
+{
+    ld_pcmstream_internal_t internal = stream->_internal;
+    if(internal->logLast && internal->logRepeats >= LOG_REPEAT_LIMIT) {
+        ld_logf(&internal->options, internal->logLevel, "last message repeated %u more times",
+            (unsigned)(internal->logRepeats - LOG_REPEAT_LIMIT + 1));
+    }
+    internal->logLast = NULL;
+    internal->logRepeats = 0;
 }
@@ -8,17 +8,37 @@
 #include "pcmstream.h"
 #include "options.h"
 
-#define LOG_O_ERROR_F(o, x, ...) ld_logf((o), 0, x, __VA_ARGS__);
-#define LOG_O_ERROR(o, x) ld_logf((o), 0, x);
+//times a stream logs the same message in a row before repeats are only counted
+#define LOG_REPEAT_LIMIT 3
 
-#define LOG_O_INFO_F(o, x, ...) ld_logf((o), 1, x, __VA_ARGS__);
-#define LOG_O_INFO(o, x, ...) ld_logf((o), 1, x);
+//checked before the message arguments are evaluated or formatted
+static inline int log_enabled(ld_options_t options, LDLOGLEVEL level, uint32_t category)
+{
+    if(!options) return level <= LDLOG_INFO;
+    return level <= options->loglevel && (options->logcategories & category);
+}
 
-#define LOG_S_ERROR_F(o, x, ...) ld_logf(&((o)->_internal->options), 1, x, __VA_ARGS__);
-#define LOG_S_ERROR(o, x) ld_logf(&((o)->_internal->options), 1, x);
+#define LOG_O_ERROR_F(o, x, ...) do { if(log_enabled((o), LDLOG_ERROR, LDLOG_CAT_OPEN)) ld_logf((o), LDLOG_ERROR, x, __VA_ARGS__); } while(0)
+#define LOG_O_ERROR(o, x) do { if(log_enabled((o), LDLOG_ERROR, LDLOG_CAT_OPEN)) ld_log((o), LDLOG_ERROR, x); } while(0)
 
-#define LOG_S_INFO_F(o, x, ...) ld_logf(&((o)->_internal->options), 0, x, __VA_ARGS__);
-#define LOG_S_INFO(o, x, ...) ld_logf(&((o)->_internal->options), 0, x);
+#define LOG_O_INFO_F(o, x, ...) do { if(log_enabled((o), LDLOG_INFO, LDLOG_CAT_OPEN)) ld_logf((o), LDLOG_INFO, x, __VA_ARGS__); } while(0)
+#define LOG_O_INFO(o, x) do { if(log_enabled((o), LDLOG_INFO, LDLOG_CAT_OPEN)) ld_log((o), LDLOG_INFO, x); } while(0)
 
-void ld_logf(ld_options_t options, int error, const char *fmt, ...);
+//stream messages are repeat suppressed, see log_stream_check
+#define LOG_S_ERROR_F(o, x, ...) do { if(log_stream_check((o), LDLOG_ERROR, LDLOG_CAT_DECODE, x)) ld_logf(&((o)->_internal->options), LDLOG_ERROR, x, __VA_ARGS__); } while(0)
+#define LOG_S_ERROR(o, x) do { if(log_stream_check((o), LDLOG_ERROR, LDLOG_CAT_DECODE, x)) ld_log(&((o)->_internal->options), LDLOG_ERROR, x); } while(0)
+
+#define LOG_S_INFO_F(o, x, ...) do { if(log_stream_check((o), LDLOG_INFO, LDLOG_CAT_DECODE, x)) ld_logf(&((o)->_internal->options), LDLOG_INFO, x, __VA_ARGS__); } while(0)
+#define LOG_S_INFO(o, x) do { if(log_stream_check((o), LDLOG_INFO, LDLOG_CAT_DECODE, x)) ld_log(&((o)->_internal->options), LDLOG_INFO, x); } while(0)
+
+//output the host asked for, never repeat suppressed
+#define LOG_S_PROPERTY_F(o, x, ...) do { if(log_enabled(&((o)->_internal->options), LDLOG_INFO, LDLOG_CAT_PROPERTIES)) ld_logf(&((o)->_internal->options), LDLOG_INFO, x, __VA_ARGS__); } while(0)
+
+void ld_logf(ld_options_t options, LDLOGLEVEL level, const char *fmt, ...);
+//logs msg as is, without formatting
+void ld_log(ld_options_t options, LDLOGLEVEL level, const char *msg);
+//whether a stream message passes the filter and isn't a suppressed repeat of the last one
+int log_stream_check(ld_pcmstream_t stream, LDLOGLEVEL level, uint32_t category, const char *fmt);
+//reports repeats of the stream's last message that were suppressed
+void log_stream_flush(ld_pcmstream_t stream);
 #endif 
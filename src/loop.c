@@ -0,0 +1,182 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "pcmstream.h"
+#include "stream.h"
+#include "logging.h"
+
+//wraps pcm->stream from the first ld_pcmstream_set_loop, streams that never
+//loop are read directly
+struct loop_state {
+    ld_stream_t inner;
+    ld_pcmstream_t pcm;
+    int64_t position; //frame the next inner read returns
+    int32_t start; //-1 when not looping
+    int32_t end; //-1 for the end of the stream
+    ld_allocator_t alloc;
+};
+
+static int loop_wrap(struct loop_state *loop)
+{
+    frame_seeker_t *seeker = &loop->pcm->_internal->seeker;
+    if(seeker->seek(loop->pcm, loop->start)) {
+        LOG_S_ERROR(loop->pcm, "loop: seek to loop start failed");
+        loop->position = seeker->tell(loop->pcm);
+        return -1;
+    }
+    loop->position = loop->start;
+    return 0;
+}
+
+static size_t loop_read(void *buffer, size_t size, ld_stream_t stream)
+{
+    struct loop_state *loop = (struct loop_state*)stream->userData;
+    ld_pcmstream_t pcm = loop->pcm;
+    frame_seeker_t *seeker = &pcm->_internal->seeker;
+    if(loop->start < 0) {
+        size_t result = loop->inner->read(buffer, size, loop->inner);
+        //the read applied the format of the frames it returned
+        int frameSize = pcmstream_frame_size(pcm);
+        if(frameSize) loop->position += result / frameSize;
+        return result;
+    }
+    size_t done = 0;
+    int wrapped = 0;
+    for(;;) {
+        //links of a chained file can change format, a single read never
+        //returns frames of two formats
+        if(seeker->nextformat && seeker->nextformat(pcm, done > 0))
+            break;
+        int frameSize = pcmstream_frame_size(pcm);
+        if(!frameSize) break;
+        size_t want = (size - done) / frameSize;
+        if(!want) break;
+        if(loop->end >= 0 && loop->position + (int64_t)want > loop->end) {
+            want = loop->position < loop->end ? (size_t)(loop->end - loop->position) : 0;
+        }
+        if(want) {
+            size_t got = loop->inner->read((char*)buffer + done, want * frameSize, loop->inner) / frameSize;
+            loop->position += got;
+            done += got * frameSize;
+            if(got) {
+                wrapped = 0;
+                //decoders may return short reads before the end
+                if(loop->end < 0 || loop->position < loop->end)
+                    continue;
+            }
+        }
+        //at the loop end or the end of the stream. a second wrap without
+        //any frames in between means the region is empty
+        if(wrapped || loop_wrap(loop))
+            break;
+        wrapped = 1;
+    }
+    return done;
+}
+
+int32_t loop_acquire(ld_pcmstream_t pcm, float ***planes, int32_t maxFrames)
+{
+    struct loop_state *loop = pcm->_internal->loop;
+    frame_lender_t *lender = &pcm->_internal->lender;
+    int wrapped = 0;
+    for(;;) {
+        int32_t want = maxFrames;
+        if(loop->start >= 0 && loop->end >= 0 && loop->position + want > loop->end) {
+            want = loop->position < loop->end ? (int32_t)(loop->end - loop->position) : 0;
+        }
+        if(want) {
+            int32_t got = lender->acquire(pcm, planes, want);
+            if(got < 0) return -1;
+            loop->position += got;
+            if(got || loop->start < 0) return got;
+        }
+        //same as loop_read, a second wrap in a row means the region is empty
+        if(wrapped || loop_wrap(loop))
+            return 0;
+        wrapped = 1;
+    }
+}
+
+static int loop_seek(ld_stream_t stream, int32_t offset, LDSEEK origin)
+{
+    struct loop_state *loop = (struct loop_state*)stream->userData;
+    int result = loop->inner->seek(loop->inner, offset, origin);
+    loop->position = loop->pcm->_internal->seeker.tell(loop->pcm);
+    return result;
+}
+
+static void loop_close(ld_stream_t stream)
+{
+    struct loop_state *loop = (struct loop_state*)stream->userData;
+    ld_allocator_t alloc = loop->alloc;
+    loop->inner->close(loop->inner);
+    mem_free(&alloc, loop);
+    mem_free(&alloc, stream);
+}
+
+static struct loop_state *loop_install(ld_pcmstream_t pcm)
+{
+    ld_allocator_t alloc = arena_allocator(pcm->_internal->arena, ARENA_OVERHEAD);
+    struct loop_state *loop = (struct loop_state*)mem_alloc(&alloc, sizeof(struct loop_state));
+    if(!loop) return NULL;
+    ld_stream_t stream = stream_new(&alloc);
+    if(!stream) {
+        mem_free(&alloc, loop);
+        return NULL;
+    }
+    loop->inner = pcm->stream;
+    loop->pcm = pcm;
+    loop->position = pcm->_internal->seeker.tell(pcm);
+    loop->start = -1;
+    loop->end = -1;
+    loop->alloc = alloc;
+    stream->userData = loop;
+    stream->read = &loop_read;
+    stream->seek = &loop_seek;
+    //no byte position, like the decoder streams it wraps
+    stream->tell = NULL;
+    stream->close = &loop_close;
+    pcm->stream = stream;
+    pcm->_internal->loop = loop;
+    return loop;
+}
+
+LDEXPORT int ld_pcmstream_set_loop(ld_pcmstream_t stream, int32_t start, int32_t end)
+{
+    ld_pcmstream_internal_t internal = stream->_internal;
+    if(start < 0) {
+        if(internal->loop) internal->loop->start = -1;
+        return 0;
+    }
+    if(!internal->seeker.seek || !pcmstream_frame_size(stream)) {
+        LOG_S_ERROR(stream, "loop: decoder can't seek to frames");
+        return -1;
+    }
+    if(end >= 0 && end <= start) {
+        LOG_S_ERROR(stream, "loop: end must come after start");
+        return -1;
+    }
+    struct loop_state *loop = internal->loop;
+    if(!loop && !(loop = loop_install(stream))) {
+        return -1;
+    }
+    if(internal->seeker.mark) {
+        internal->seeker.mark(stream, start);
+    }
+    loop->start = start;
+    loop->end = end;
+    return 0;
+}
+
+LDEXPORT int ld_pcmstream_loop_file(ld_pcmstream_t stream)
+{
+    int start, length;
+    if(!ld_pcmstream_get_int_id(stream, LD_PROPERTY_ID_LOOP_START, &start)) {
+        return -1;
+    }
+    if(!ld_pcmstream_get_int_id(stream, LD_PROPERTY_ID_LOOP_LENGTH, &length) || length <= 0) {
+        return ld_pcmstream_set_loop(stream, start, -1);
+    }
+    return ld_pcmstream_set_loop(stream, start, start + length);
+}
@@ -0,0 +1,80 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "ogg.h"
+#include <string.h>
+
+#define OGG_CRC_POLY 0x04c11db7
+
+uint32_t ogg_crc_table[8][256];
+
+void ogg_crc_init(void)
+{
+    for(int i = 0; i < 256; i++) {
+        uint32_t r = (uint32_t)i << 24;
+        for(int j = 0; j < 8; j++)
+            r = (r << 1) ^ ((r & 0x80000000) ? OGG_CRC_POLY : 0);
+        ogg_crc_table[0][i] = r;
+    }
+    //table k is a byte followed by k zero bytes
+    for(int k = 1; k < 8; k++) {
+        for(int i = 0; i < 256; i++) {
+            uint32_t r = ogg_crc_table[k - 1][i];
+            ogg_crc_table[k][i] = (r << 8) ^ ogg_crc_table[0][r >> 24];
+        }
+    }
+}
+
+uint32_t ogg_crc32(uint32_t crc, const uint8_t *data, size_t length)
+{
+    //8 bytes per step, the CRC is most significant bit first so the
+    //first 4 bytes are folded into it big endian
+    while(length >= 8) {
+        crc ^= ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+            ((uint32_t)data[2] << 8) | data[3];
+        crc = ogg_crc_table[7][crc >> 24] ^ ogg_crc_table[6][(crc >> 16) & 0xff] ^
+            ogg_crc_table[5][(crc >> 8) & 0xff] ^ ogg_crc_table[4][crc & 0xff] ^
+            ogg_crc_table[3][data[4]] ^ ogg_crc_table[2][data[5]] ^
+            ogg_crc_table[1][data[6]] ^ ogg_crc_table[0][data[7]];
+        data += 8;
+        length -= 8;
+    }
+    while(length--) {
+        crc = ogg_crc32_byte(crc, *data++);
+    }
+    return crc;
+}
+
+static uint32_t read32(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+int ogg_parse_header(const uint8_t *data, ogg_page_header_t *header)
+{
+    if(memcmp(data, "OggS", 4) != 0 || data[4] != 0) {
+        return 0;
+    }
+    header->flags = data[5];
+    header->granule = (int64_t)((uint64_t)read32(&data[6]) | ((uint64_t)read32(&data[10]) << 32));
+    header->serial = read32(&data[14]);
+    header->sequence = read32(&data[18]);
+    header->checksum = read32(&data[22]);
+    header->segmentCount = data[26];
+    return 1;
+}
+
+const uint8_t *ogg_first_packet(const uint8_t *data, size_t size, size_t *length)
+{
+    ogg_page_header_t page;
+    if(size < OGG_PAGE_HEADER_SIZE || !ogg_parse_header(data, &page) || !page.segmentCount ||
+       size < OGG_PAGE_HEADER_SIZE + (size_t)page.segmentCount) {
+        return NULL;
+    }
+    size_t offset = OGG_PAGE_HEADER_SIZE + page.segmentCount;
+    //a packet is longer than its first lacing value only when that is 255
+    size_t packet = data[OGG_PAGE_HEADER_SIZE];
+    *length = size - offset < packet ? size - offset : packet;
+    return data + offset;
+}
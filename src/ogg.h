@@ -0,0 +1,49 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//OGG
+//page layer shared by the Ogg codecs: page headers and the page CRC
+//stb_vorbis, dr_flac and format detection use it, libopusfile has its own
+#ifndef _OGG_H_
+#define _OGG_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#define OGG_PAGE_HEADER_SIZE 27
+
+#define OGG_PAGE_CONTINUED 0x1
+#define OGG_PAGE_FIRST 0x2
+#define OGG_PAGE_LAST 0x4
+
+typedef struct {
+    uint8_t flags;
+    int64_t granule; //-1 when no packet ends on the page
+    uint32_t serial;
+    uint32_t sequence;
+    uint32_t checksum;
+    uint8_t segmentCount;
+} ogg_page_header_t;
+
+//slicing-by-8 tables, ogg_crc_table[0] is the bytewise table
+extern uint32_t ogg_crc_table[8][256];
+
+//builds the CRC tables, called once by ld_init
+void ogg_crc_init(void);
+
+//the page CRC (polynomial 0x04c11db7, not reflected, no final xor) of
+//data continued from crc, pages start from 0
+uint32_t ogg_crc32(uint32_t crc, const uint8_t *data, size_t length);
+
+static inline uint32_t ogg_crc32_byte(uint32_t crc, uint8_t byte)
+{
+    return (crc << 8) ^ ogg_crc_table[0][byte ^ (crc >> 24)];
+}
+
+//parses the OGG_PAGE_HEADER_SIZE bytes at data, returns 0 if they aren't a page header
+int ogg_parse_header(const uint8_t *data, ogg_page_header_t *header);
+
+//start of the first packet on the page at the start of data, NULL if data
+//doesn't start with a page. length is the part of the packet within size
+const uint8_t *ogg_first_packet(const uint8_t *data, size_t size, size_t *length);
+#endif
@@ -1 +1,71 @@
-#include "options.h"
\ No newline at end of file
+#include "options.h"
+#include <stdlib.h>
+#include <string.h>
+
+LDEXPORT ld_options_t ld_options_new()
+{
+    ld_options_t opts = (ld_options_t)malloc(sizeof(struct ld_options));
+    options_defaults(opts);
+    return opts;
+}
+
+LDEXPORT void ld_options_set_msginfo(ld_options_t opts, ld_msgcallback_t cb)
+{
+    opts->msginfo = cb;
+}
+
+LDEXPORT void ld_options_set_msgerror(ld_options_t opts, ld_msgcallback_t cb)
+{
+    opts->msgerror = cb;
+}
+
+LDEXPORT void ld_options_set_output(ld_options_t opts, LDFORMAT sampleType, int32_t maxChannels)
+{
+    if(sampleType == LDFORMAT_F32 || sampleType == LDFORMAT_S24 || sampleType == LDFORMAT_S32)
+        opts->sampleType = sampleType;
+    else
+        opts->sampleType = LDFORMAT_S16;
+    opts->maxChannels = maxChannels < 2 ? 2 : maxChannels;
+}
+
+LDEXPORT void ld_options_set_loglevel(ld_options_t opts, LDLOGLEVEL level, uint32_t categories)
+{
+    opts->loglevel = level;
+    opts->logcategories = categories;
+}
+
+LDEXPORT void ld_options_set_allocator(ld_options_t opts, ld_malloc_t mallocfn, ld_realloc_t reallocfn, ld_free_t freefn, void *userdata)
+{
+    if(mallocfn && reallocfn && freefn) {
+        opts->alloc.malloc = mallocfn;
+        opts->alloc.realloc = reallocfn;
+        opts->alloc.free = freefn;
+        opts->alloc.userdata = userdata;
+    } else {
+        memset(&opts->alloc, 0, sizeof(ld_allocator_t));
+    }
+}
+
+LDEXPORT void ld_options_set_tracing(ld_options_t opts, ld_spancallback_t begin, ld_spancallback_t end, void *userdata)
+{
+    if(begin && end) {
+        opts->spanbegin = begin;
+        opts->spanend = end;
+        opts->spanudata = userdata;
+    } else {
+        opts->spanbegin = NULL;
+        opts->spanend = NULL;
+        opts->spanudata = NULL;
+    }
+}
+
+LDEXPORT void ld_options_set_linkcallback(ld_options_t opts, ld_linkcallback_t cb, void *userdata)
+{
+    opts->linkcb = cb;
+    opts->linkudata = cb ? userdata : NULL;
+}
+
+LDEXPORT void ld_options_free(ld_options_t opts)
+{
+    free(opts);
+}
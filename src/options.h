@@ -1,8 +1,57 @@
 #ifndef _OPTIONS_H_
 #define _OPTIONS_H_
 #include <lancerdecode.h>
+#include <string.h>
+#include "alloc.h"
 struct ld_options {
     ld_msgcallback_t msginfo;
     ld_msgcallback_t msgerror;
+    ld_allocator_t alloc;
+    ld_spancallback_t spanbegin;
+    ld_spancallback_t spanend;
+    void *spanudata;
+    LDLOGLEVEL loglevel;
+    uint32_t logcategories;
+    LDFORMAT sampleType;
+    int32_t maxChannels;
+    ld_linkcallback_t linkcb;
+    void *linkudata;
 };
-#endif
\ No newline at end of file
+
+//settings of ld_options_new, also used for streams opened without options
+static inline void options_defaults(struct ld_options *options)
+{
+    memset(options, 0, sizeof(struct ld_options));
+    options->loglevel = LDLOG_INFO;
+    options->logcategories = LDLOG_CAT_ALL;
+    options->sampleType = LDFORMAT_S16;
+    options->maxChannels = 2;
+}
+
+//whether decoders that can should output LDFORMAT_F32
+static inline int options_float(ld_options_t options)
+{
+    return options && options->sampleType == LDFORMAT_F32;
+}
+
+//output sample type asked for, LDFORMAT_S16 when options is NULL
+static inline LDFORMAT options_sample_type(ld_options_t options)
+{
+    return options ? options->sampleType : LDFORMAT_S16;
+}
+
+//channel limit before decoders downmix to stereo
+static inline int options_max_channels(ld_options_t options)
+{
+    return options ? options->maxChannels : 2;
+}
+
+//allocator of the options, libc when options is NULL
+static inline ld_allocator_t options_allocator(ld_options_t options)
+{
+    ld_allocator_t alloc;
+    if(options) return options->alloc;
+    memset(&alloc, 0, sizeof(alloc));
+    return alloc;
+}
+#endif
@@ -1,27 +1,128 @@
 #include "pcmstream.h"
 #include "properties.h"
 #include "options.h"
+#include "logging.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <string.h>
 
-ld_pcmstream_t pcmstream_init(ld_options_t options)
+ld_pcmstream_t pcmstream_init(ld_options_t options, ld_arena_t *arena)
 {
-    ld_pcmstream_t retsound = (ld_pcmstream_t)malloc(sizeof(struct ld_pcmstream));
+    ld_allocator_t alloc = arena_allocator(arena, ARENA_OVERHEAD);
+    ld_pcmstream_t retsound = (ld_pcmstream_t)mem_alloc(&alloc, sizeof(struct ld_pcmstream));
     memset(retsound, 0, sizeof(struct ld_pcmstream));
-    retsound->_internal = (ld_pcmstream_internal_t)malloc(sizeof(struct ld_pcmstream_internal));
-    init_properties(retsound);
+    retsound->_internal = (ld_pcmstream_internal_t)mem_alloc(&alloc, sizeof(struct ld_pcmstream_internal));
     if(options) {
         retsound->_internal->options = *options;
     } else {
-        memset(&retsound->_internal->options, 0, sizeof(struct ld_options));
+        options_defaults(&retsound->_internal->options);
+    }
+    retsound->_internal->arena = arena;
+    retsound->_internal->logLast = NULL;
+    retsound->_internal->logRepeats = 0;
+    memset(&retsound->_internal->seeker, 0, sizeof(frame_seeker_t));
+    retsound->_internal->loop = NULL;
+    memset(&retsound->_internal->lender, 0, sizeof(frame_lender_t));
+    retsound->_internal->borrowed = 0;
+    init_properties(retsound);
+    return retsound;
+}
+
+LDEXPORT ld_pcmstream_t ld_pcmstream_new(ld_stream_t decoded, ld_options_t options, int32_t frequency, LDFORMAT format, int32_t channels)
+{
+    ld_allocator_t alloc = options_allocator(options);
+    ld_arena_t *arena = arena_create(&alloc, PCMSTREAM_ARENA_SIZE);
+    if(!arena) {
+        LOG_O_ERROR(options, "ld_pcmstream_new: out of memory");
+        return NULL;
     }
+    ld_pcmstream_t retsound = pcmstream_init(options, arena);
+    retsound->stream = decoded;
+    retsound->dataSize = -1;
+    retsound->frequency = frequency;
+    retsound->format = format;
+    retsound->channels = channels;
+    retsound->blockSize = 32768;
     return retsound;
 }
 
 LDEXPORT void ld_pcmstream_close(ld_pcmstream_t stream)
 {
+    ld_arena_t *arena = stream->_internal->arena;
+    ld_allocator_t alloc = arena_allocator(arena, ARENA_OVERHEAD);
 	stream->stream->close(stream->stream);
-    destroy_properties(stream);
-    free(stream->_internal);
-	free(stream);
-}
\ No newline at end of file
+    log_stream_flush(stream);
+    //only frees anything if these spilled out of the arena
+    mem_free(&alloc, stream->_internal);
+    mem_free(&alloc, stream);
+    arena_destroy(arena);
+}
+
+LDEXPORT int ld_pcmstream_acquire_frame(ld_pcmstream_t stream, float ***planes, int32_t *frames)
+{
+    ld_pcmstream_internal_t internal = stream->_internal;
+    *frames = 0;
+    if(!internal->lender.acquire) {
+        LOG_S_ERROR(stream, "acquire_frame: decoder can't lend its output, use read");
+        return -1;
+    }
+    if(internal->borrowed) {
+        LOG_S_ERROR(stream, "acquire_frame: the previous frames were not released");
+        return -1;
+    }
+    ld_span_t span;
+    trace_begin(&internal->options, &span, LDSPAN_READ, internal->properties.slots[LD_PROPERTY_ID_CODEC].string);
+    int32_t got = internal->loop ? loop_acquire(stream, planes, INT32_MAX) :
+        internal->lender.acquire(stream, planes, INT32_MAX);
+    span.frames = got > 0 ? got : 0;
+    span.bytes = span.frames * stream->channels * (int64_t)sizeof(float);
+    trace_end(&internal->options, &span);
+    if(got <= 0) {
+        return got;
+    }
+    *frames = got;
+    internal->borrowed = 1;
+    return 1;
+}
+
+LDEXPORT void ld_pcmstream_release_frame(ld_pcmstream_t stream)
+{
+    stream->_internal->borrowed = 0;
+}
+
+static void fill_usage(ld_memory_usage_t *usage, const size_t *categories, size_t total, size_t streams)
+{
+    usage->decoder = categories[ARENA_DECODER];
+    usage->buffers = categories[ARENA_BUFFERS];
+    //the slots live in the internal state, charge them to properties
+    usage->properties = streams * sizeof(property_table_t);
+    usage->total = total;
+    //totals are read without a lock and may be briefly out of step
+    size_t used = usage->decoder + usage->buffers + usage->properties;
+    usage->overhead = total > used ? total - used : 0;
+}
+
+LDEXPORT void ld_pcmstream_memory_usage(ld_pcmstream_t stream, ld_memory_usage_t *usage)
+{
+    ld_arena_t *arena = stream->_internal->arena;
+    size_t categories[ARENA_CATEGORY_COUNT];
+    for(int i = 0; i < ARENA_CATEGORY_COUNT; i++) {
+        categories[i] = arena_category_bytes(arena, (arena_category_t)i);
+    }
+    fill_usage(usage, categories, arena_total_bytes(arena), 1);
+}
+
+LDEXPORT void ld_memory_totals(ld_memory_totals_t *totals)
+{
+    arena_totals_t arenas;
+    arena_totals(&arenas);
+    fill_usage(&totals->current, arenas.categories, arenas.total, arenas.arenas);
+    totals->highWater = arenas.highWater;
+    totals->streams = (int32_t)arenas.arenas;
+    totals->streamsHighWater = (int32_t)arenas.arenasHighWater;
+}
+
+LDEXPORT void ld_memory_reset_high_water(void)
+{
+    arena_reset_high_water();
+}
@@ -1,9 +1,92 @@
 #ifndef PCMSTREAM_H_
 #define PCMSTREAM_H_
 #include "options.h"
+#include "arena.h"
+#include "properties.h"
+
+//arena space for the pcmstream and its internal state,
+//decoders add their own state on top of this when sizing the arena
+#define PCMSTREAM_ARENA_SIZE 512
+//one stream from stream_new or stream_wrap, with its wrapper data
+#define STREAM_ARENA_SIZE 160
+
+//sample accurate positioning for ld_pcmstream_set_loop, set by decoders that
+//support it. frames count from the first frame read returns
+typedef struct {
+    int (*seek)(ld_pcmstream_t pcm, int64_t frame); //returns 0 on success
+    int64_t (*tell)(ld_pcmstream_t pcm);
+    //optional, called when frame becomes a loop start so seeks to it are cheap
+    void (*mark)(ld_pcmstream_t pcm, int64_t frame);
+    //optional, for chained files whose links change format. applies the format
+    //of the frames the next read returns, or returns nonzero without applying
+    //it when keep is set and it differs from the current format
+    int (*nextformat)(ld_pcmstream_t pcm, int keep);
+    void *data; //the decoder's userdata, pcm->stream may be wrapped
+} frame_seeker_t;
+
+//the decoder's own planar float output for ld_pcmstream_acquire_frame, set by
+//decoders that can hand it out without copying
+typedef struct {
+    //lends up to maxFrames of the next frames, returns how many, 0 at the
+    //end of the stream or -1 if the output can't be lent
+    int32_t (*acquire)(ld_pcmstream_t pcm, float ***planes, int32_t maxFrames);
+    void *data;
+} frame_lender_t;
+
 struct ld_pcmstream_internal {
     struct ld_options options;
-    void *properties;
+    ld_arena_t *arena;
+    property_table_t properties;
+    //repeat suppression for messages logged against the stream
+    const char *logLast;
+    LDLOGLEVEL logLevel;
+    uint32_t logRepeats;
+    frame_seeker_t seeker;
+    struct loop_state *loop; //NULL until ld_pcmstream_set_loop
+    frame_lender_t lender;
+    int borrowed; //frames acquired and not yet released
 };
-ld_pcmstream_t pcmstream_init(ld_options_t options);
-#endif
\ No newline at end of file
+
+//bytes per PCM frame, 0 if unknown
+static inline int pcmstream_frame_size(ld_pcmstream_t pcm)
+{
+    switch(pcm->format) {
+        case LDFORMAT_MONO8: return 1;
+        case LDFORMAT_MONO16: return 2;
+        case LDFORMAT_STEREO8: return 2;
+        case LDFORMAT_STEREO16: return 4;
+        case LDFORMAT_S16: return 2 * pcm->channels;
+        case LDFORMAT_F32: return 4 * pcm->channels;
+        case LDFORMAT_S24: return 4 * pcm->channels;
+        case LDFORMAT_S32: return 4 * pcm->channels;
+        default: return 0;
+    }
+}
+
+//sets format and channels for 16-bit or float output
+static inline void pcmstream_set_format(ld_pcmstream_t pcm, int channels, int isFloat)
+{
+    pcm->channels = channels;
+    if(isFloat)
+        pcm->format = LDFORMAT_F32;
+    else if(channels == 1)
+        pcm->format = LDFORMAT_MONO16;
+    else if(channels == 2)
+        pcm->format = LDFORMAT_STEREO16;
+    else
+        pcm->format = LDFORMAT_S16;
+}
+
+//tells the link callback that read moved on to link of a chained file,
+//call once frequency, format and channels describe the new link
+static inline void pcmstream_link_changed(ld_pcmstream_t pcm, int32_t link)
+{
+    ld_options_t options = &pcm->_internal->options;
+    if(options->linkcb) options->linkcb(pcm, link, options->linkudata);
+}
+
+//allocates the pcmstream from arena, which it then owns
+ld_pcmstream_t pcmstream_init(ld_options_t options, ld_arena_t *arena);
+//lender.acquire through the loop region once ld_pcmstream_set_loop was called
+int32_t loop_acquire(ld_pcmstream_t pcm, float ***planes, int32_t maxFrames);
+#endif
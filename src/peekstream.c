@@ -0,0 +1,197 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "peekstream.h"
+#include "pcmstream.h"
+#include "stream.h"
+#include <string.h>
+
+//forward seeks are read through this many bytes at a time
+#define SKIP_BUFFER_SIZE 1024
+//the history is moved to the front of the buffer once it fills
+#define HISTORY_CAPACITY (PEEKSTREAM_HISTORY * 2)
+
+typedef struct {
+    ld_stream_t source;
+    int32_t position; //of the next read
+    int32_t start; //position of buffer[0], buffer holds the bytes up to end
+    int32_t end; //bytes read from source
+    unsigned char *buffer;
+    int32_t capacity;
+    int keep; //0 once open, then only the history is kept
+    ld_allocator_t alloc;
+} peekstream_t;
+
+//makes room to keep size more bytes, stops keeping when out of memory
+static void peek_grow(peekstream_t *p, int32_t size)
+{
+    int32_t length = p->end - p->start;
+    if(length + size <= p->capacity) return;
+    int32_t capacity = p->capacity * 2 > length + size ? p->capacity * 2 : length + size;
+    unsigned char *buffer = (unsigned char*)mem_realloc(&p->alloc, p->buffer, capacity);
+    if(buffer) {
+        p->buffer = buffer;
+        p->capacity = capacity;
+    } else {
+        //out of memory, seeks back to what was read before fail
+        p->keep = 0;
+    }
+}
+
+//the bytes from end to end + size were just read from source,
+//size must be below PEEKSTREAM_HISTORY once they are no longer kept
+static void peek_store(peekstream_t *p, const unsigned char *data, int32_t size)
+{
+    if(p->keep) peek_grow(p, size);
+    int32_t length = p->end - p->start;
+    if(!p->keep && length + size > p->capacity) {
+        int32_t drop = length + size - PEEKSTREAM_HISTORY;
+        memmove(p->buffer, p->buffer + drop, length - drop);
+        p->start += drop;
+        length -= drop;
+    }
+    memcpy(p->buffer + length, data, size);
+    p->end += size;
+}
+
+//peek_store for reads of any size
+static void peek_storeread(peekstream_t *p, const unsigned char *data, int32_t size)
+{
+    if(p->keep) peek_grow(p, size);
+    if(p->keep || size < PEEKSTREAM_HISTORY) {
+        peek_store(p, data, size);
+        return;
+    }
+    memcpy(p->buffer, data + size - PEEKSTREAM_HISTORY, PEEKSTREAM_HISTORY);
+    p->end += size;
+    p->start = p->end - PEEKSTREAM_HISTORY;
+}
+
+//gives back what was kept while opening, call once it has all been read
+static void peek_trim(peekstream_t *p)
+{
+    if(p->capacity <= HISTORY_CAPACITY) return;
+    int32_t length = p->end - p->start;
+    if(length > PEEKSTREAM_HISTORY) {
+        memmove(p->buffer, p->buffer + length - PEEKSTREAM_HISTORY, PEEKSTREAM_HISTORY);
+        p->start = p->end - PEEKSTREAM_HISTORY;
+    }
+    unsigned char *buffer = (unsigned char*)mem_realloc(&p->alloc, p->buffer, HISTORY_CAPACITY);
+    if(buffer) {
+        p->buffer = buffer;
+        p->capacity = HISTORY_CAPACITY;
+    }
+}
+
+static size_t peekstream_read(void *buffer, size_t size, ld_stream_t stream)
+{
+    peekstream_t *p = (peekstream_t*)stream->userData;
+    size_t done = 0;
+    if(p->position < p->end) {
+        done = (size_t)(p->end - p->position) < size ? (size_t)(p->end - p->position) : size;
+        memcpy(buffer, p->buffer + (p->position - p->start), done);
+        p->position += (int32_t)done;
+    }
+    if(!p->keep && p->position == p->end) peek_trim(p);
+    //pipes return what is available, decoders take short reads as the end
+    while(done < size) {
+        int32_t got = (int32_t)p->source->read((char*)buffer + done, size - done, p->source);
+        if(!got) break;
+        peek_storeread(p, (unsigned char*)buffer + done, got);
+        p->position += got;
+        done += got;
+    }
+    return done;
+}
+
+static int peekstream_seek(ld_stream_t stream, int32_t offset, LDSEEK origin)
+{
+    peekstream_t *p = (peekstream_t*)stream->userData;
+    //the length is unknown until the end is read
+    if(origin == LDSEEK_END) return -1;
+    int32_t target = origin == LDSEEK_CUR ? p->position + offset : offset;
+    if(target < p->start) return -1;
+    if(target <= p->end) {
+        p->position = target;
+        return 0;
+    }
+    unsigned char skip[SKIP_BUFFER_SIZE];
+    p->position = p->end;
+    while(p->position < target) {
+        int32_t want = target - p->position < SKIP_BUFFER_SIZE ? target - p->position : SKIP_BUFFER_SIZE;
+        int32_t got = (int32_t)p->source->read(skip, want, p->source);
+        if(!got) return -1;
+        peek_store(p, skip, got);
+        p->position += got;
+    }
+    return 0;
+}
+
+static int32_t peekstream_tell(ld_stream_t stream)
+{
+    return ((peekstream_t*)stream->userData)->position;
+}
+
+static void peekstream_free(ld_stream_t stream)
+{
+    peekstream_t *p = (peekstream_t*)stream->userData;
+    ld_allocator_t alloc = p->alloc;
+    mem_free(&alloc, p->buffer);
+    mem_free(&alloc, p);
+    mem_free(&alloc, stream);
+}
+
+static void peekstream_close(ld_stream_t stream)
+{
+    peekstream_t *p = (peekstream_t*)stream->userData;
+    p->source->close(p->source);
+    peekstream_free(stream);
+}
+
+ld_stream_t peekstream_source(ld_stream_t stream, ld_options_t options)
+{
+    if(stream->seek) return stream;
+    ld_allocator_t alloc = options_allocator(options);
+    peekstream_t *p = (peekstream_t*)mem_alloc(&alloc, sizeof(peekstream_t));
+    ld_stream_t peek = stream_new(&alloc);
+    unsigned char *buffer = (unsigned char*)mem_alloc(&alloc, HISTORY_CAPACITY);
+    if(!p || !peek || !buffer) {
+        mem_free(&alloc, buffer);
+        mem_free(&alloc, peek);
+        mem_free(&alloc, p);
+        return NULL;
+    }
+    memset(p, 0, sizeof(peekstream_t));
+    p->source = stream;
+    p->buffer = buffer;
+    p->capacity = HISTORY_CAPACITY;
+    p->keep = 1;
+    p->alloc = alloc;
+    peek->userData = p;
+    peek->read = &peekstream_read;
+    peek->seek = &peekstream_seek;
+    peek->tell = &peekstream_tell;
+    peek->close = &peekstream_close;
+    return peek;
+}
+
+void peekstream_release(ld_stream_t peek, ld_stream_t stream)
+{
+    if(peek != stream) peekstream_free(peek);
+}
+
+//the start of the stream is no longer kept
+static int peekstream_noseek(ld_stream_t stream, int32_t offset, LDSEEK origin)
+{
+    return -1;
+}
+
+void peekstream_opened(ld_stream_t peek, ld_stream_t stream, ld_pcmstream_t pcm)
+{
+    if(peek == stream || !pcm) return;
+    ((peekstream_t*)peek->userData)->keep = 0;
+    pcm->_internal->seeker.seek = NULL;
+    pcm->_internal->seeker.mark = NULL;
+    pcm->stream->seek = &peekstream_noseek;
+}
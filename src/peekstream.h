@@ -0,0 +1,25 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//PEEKSTREAM
+//lets decoders open forward-only streams (seek set to NULL). while the decoder
+//opens, every byte read is kept so it can seek back, forward seeks read and
+//discard. once open only the last PEEKSTREAM_HISTORY bytes stay seekable
+#ifndef _PEEKSTREAM_H_
+#define _PEEKSTREAM_H_
+#include "lancerdecode.h"
+#include "options.h"
+
+//covers the rewind over a Vorbis setup header when a chained link starts
+#define PEEKSTREAM_HISTORY 16384
+
+//returns stream itself when it can seek, NULL when out of memory
+ld_stream_t peekstream_source(ld_stream_t stream, ld_options_t options);
+//Frees the wrapper made by peekstream_source without closing the stream it wraps
+void peekstream_release(ld_stream_t peek, ld_stream_t stream);
+//Call once pcm opened from peek: stops keeping bytes and makes frame seeks and
+//pcm->stream seeks fail, they would need the whole stream
+void peekstream_opened(ld_stream_t peek, ld_stream_t stream, ld_pcmstream_t pcm);
+
+#endif
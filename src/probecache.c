@@ -0,0 +1,137 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "lancerdecode.h"
+#include "formats.h"
+#include "hashmap.h"
+#include "peekstream.h"
+#include "threads.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *key;
+    ld_header_t header;
+} probecache_entry;
+
+struct ld_probecache {
+    ld_mutex_t lock;
+    struct hashmap *entries;
+};
+
+static int probecache_compare(const void *a, const void *b, void *udata)
+{
+    const probecache_entry *ea = a;
+    const probecache_entry *eb = b;
+    return strcmp(ea->key, eb->key);
+}
+
+static uint64_t probecache_hash(const void *item, uint64_t seed0, uint64_t seed1)
+{
+    const probecache_entry *e = item;
+    return hashmap_sip(e->key, strlen(e->key), seed0, seed1);
+}
+
+static void probecache_elfree(void *item)
+{
+    probecache_entry *e = item;
+    free(e->key);
+}
+
+LDEXPORT ld_probecache_t ld_probecache_new()
+{
+    ld_probecache_t cache = (ld_probecache_t)malloc(sizeof(struct ld_probecache));
+    mutex_init(&cache->lock);
+    cache->entries = hashmap_new(sizeof(probecache_entry), 0, 0, 0, probecache_hash, probecache_compare, probecache_elfree, NULL);
+    return cache;
+}
+
+LDEXPORT void ld_probecache_clear(ld_probecache_t cache)
+{
+    mutex_lock(&cache->lock);
+    hashmap_clear(cache->entries, false);
+    mutex_unlock(&cache->lock);
+}
+
+LDEXPORT void ld_probecache_free(ld_probecache_t cache)
+{
+    hashmap_free(cache->entries);
+    mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+LDEXPORT ld_pcmstream_t ld_pcmstream_open_cached(ld_stream_t stream, ld_probecache_t cache, const char *key, ld_options_t options, const char **error)
+{
+    const char *errorStack = NULL;
+    const char **errorOut = error ? error : &errorStack;
+
+    ld_init();
+    ld_span_t openSpan, detectSpan;
+    trace_begin(options, &openSpan, LDSPAN_OPEN, NULL);
+    ld_stream_t peek = open_peek(stream, options, errorOut);
+    if(!peek) {
+        trace_end(options, &openSpan);
+        return NULL;
+    }
+    ld_stream_t source = trace_source(peek, options);
+    //Only the lookups are locked, decoders are initialised concurrently
+    ld_header_t header;
+    ld_pcmstream_t retsound;
+    mutex_lock(&cache->lock);
+    const probecache_entry *cached = hashmap_get(cache->entries, &(probecache_entry){ .key = (char*)key });
+    if(cached) header = cached->header;
+    mutex_unlock(&cache->lock);
+    if(cached) {
+        retsound = open_header_traced(source, options, &header, errorOut);
+        peekstream_opened(peek, stream, retsound);
+        if(!retsound) {
+            source->close(source);
+            //Don't trust this entry again
+            mutex_lock(&cache->lock);
+            const probecache_entry *removed = hashmap_delete(cache->entries, &(probecache_entry){ .key = (char*)key });
+            if(removed) free(removed->key);
+            mutex_unlock(&cache->lock);
+        }
+        openSpan.codec = trace_codec(&header);
+        openSpan.result = retsound != NULL;
+        trace_end(options, &openSpan);
+        return retsound;
+    }
+
+    probecache_entry entry;
+    trace_begin(options, &detectSpan, LDSPAN_DETECT, NULL);
+    int result = detect_header(source, options, &entry.header, errorOut);
+    detectSpan.result = result > 0;
+    trace_end(options, &detectSpan);
+    if(result <= 0) {
+        if(!result) source->close(source);
+        else {
+            trace_source_release(source, peek);
+            peekstream_release(peek, stream);
+        }
+        trace_end(options, &openSpan);
+        return NULL;
+    }
+    header = entry.header;
+    size_t keyLength = strlen(key) + 1;
+    entry.key = (char*)malloc(keyLength);
+    //Out of memory only skips caching, the header is still opened
+    if(entry.key) {
+        memcpy(entry.key, key, keyLength);
+        mutex_lock(&cache->lock);
+        //Another thread may have probed the same key in the meantime
+        const probecache_entry *replaced = hashmap_set(cache->entries, &entry);
+        if(replaced) free(replaced->key);
+        else if(hashmap_oom(cache->entries)) free(entry.key);
+        mutex_unlock(&cache->lock);
+    }
+    retsound = open_header_traced(source, options, &header, errorOut);
+    peekstream_opened(peek, stream, retsound);
+    if(!retsound) source->close(source);
+    openSpan.codec = trace_codec(&header);
+    openSpan.result = retsound != NULL;
+    trace_end(options, &openSpan);
+    return retsound;
+}
@@ -1,6 +1,5 @@
 #define __USE_MINGW_ANSI_STDIO
 #include <lancerdecode.h>
-#include "hashmap.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -44,96 +43,131 @@ __inline int c99_snprintf(char *outBuf, size_t size, const char *format, ...)
 
 #endif
 
-typedef struct {
-    const char *name;
-    int isInteger;
-    int integer;
-    const char *string;
-} property_entry;
-
-int property_compare(const void *a, const void *b, void *udata)
+static const char *property_names[LD_PROPERTY_ID_COUNT] = {
+    LD_PROPERTY_CODEC,
+    LD_PROPERTY_CONTAINER,
+    LD_PROPERTY_FL_TRIM,
+    LD_PROPERTY_FL_SAMPLES,
+    LD_PROPERTY_MP3_TRIM,
+    LD_PROPERTY_MP3_SAMPLES,
+    LD_PROPERTY_LOOP_START,
+    LD_PROPERTY_LOOP_LENGTH,
+    LD_PROPERTY_CHANNEL_ORDER,
+    LD_PROPERTY_BITS_PER_SAMPLE
+};
+
+LDEXPORT int ld_property_id(const char *property)
 {
-    const property_entry *pa = a;
-    const property_entry *pb = b;
-    return strcmp_i(pa->name, pb->name);
+    int i;
+    if(!property) return -1;
+    for(i = 0; i < LD_PROPERTY_ID_COUNT; i++) {
+        if(property == property_names[i]) return i;
+    }
+    for(i = 0; i < LD_PROPERTY_ID_COUNT; i++) {
+        if(!strcmp_i(property, property_names[i])) return i;
+    }
+    return -1;
 }
 
-uint64_t property_hash(const void *item, uint64_t seed0, uint64_t seed1)
+int init_properties(ld_pcmstream_t pcmstream)
 {
-    const property_entry *p = item;
-    return hashmap_sip(p->name, strlen(p->name), seed0, seed1);
+    memset(&pcmstream->_internal->properties, 0, sizeof(property_table_t));
+    return 1;
 }
 
-int init_properties(ld_pcmstream_t pcmstream)
+static const property_slot_t *get_slot(ld_pcmstream_t pcmstream, int id)
 {
-    struct hashmap *h = hashmap_new(sizeof(property_entry), 0, 0, 0, property_hash, property_compare, NULL, NULL);
-    pcmstream->_internal->properties = h;
+    if(id < 0 || id >= LD_PROPERTY_ID_COUNT) return NULL;
+    const property_slot_t *slot = &pcmstream->_internal->properties.slots[id];
+    return slot->isSet ? slot : NULL;
 }
 
-void destroy_properties(ld_pcmstream_t pcmstream)
+static const property_slot_t *get_named(ld_pcmstream_t pcmstream, const char *property)
 {
-    if(pcmstream->_internal->properties) {
-        hashmap_free((struct hashmap*)pcmstream->_internal->properties);
-        pcmstream->_internal->properties = NULL;
-    }
+    return get_slot(pcmstream, ld_property_id(property));
 }
 
-void set_property_int(ld_pcmstream_t pcmstream, const char *property, int value)
+void set_property_int(ld_pcmstream_t pcmstream, int id, int value)
 {
-    hashmap_set(pcmstream->_internal->properties, &(property_entry){
-        .name = property,
-        .isInteger = 1,
-        .integer = value,
-        .string = NULL
-    });
+    property_slot_t *slot = &pcmstream->_internal->properties.slots[id];
+    slot->isSet = 1;
+    slot->isInteger = 1;
+    slot->integer = value;
+    slot->string = NULL;
 }
 
-void set_property_string(ld_pcmstream_t pcmstream, const char *property, const char *value)
+void set_property_string(ld_pcmstream_t pcmstream, int id, const char *value)
 {
-    hashmap_set(pcmstream->_internal->properties, &(property_entry){
-        .name = property,
-        .isInteger = 0,
-        .integer = 0,
-        .string = value
-    });
+    property_slot_t *slot = &pcmstream->_internal->properties.slots[id];
+    slot->isSet = 1;
+    slot->isInteger = 0;
+    slot->integer = 0;
+    slot->string = value;
 }
 
+void clear_property(ld_pcmstream_t pcmstream, int id)
+{
+    memset(&pcmstream->_internal->properties.slots[id], 0, sizeof(property_slot_t));
+}
 
-LDEXPORT int ld_pcmstream_get_int(ld_pcmstream_t stream, const char *property, int* value)
+static int slot_get_int(const property_slot_t *slot, int *value)
 {
-    const property_entry *result = hashmap_get(stream->_internal->properties, &(property_entry){ .name = property });
-    if(result && result->isInteger) {
+    if(slot && slot->isInteger) {
         if(value) {
-            *value = result->integer;
-        } 
+            *value = slot->integer;
+        }
         return 1;
     }
     return 0;
 }
 
-LDEXPORT int ld_pcmstream_get_string(ld_pcmstream_t stream, const char *property, char *buffer, int size)
+static int slot_get_string(const property_slot_t *slot, char *buffer, int size)
 {
-    const property_entry *result = hashmap_get(stream->_internal->properties, &(property_entry){ .name = property });
-    if(result) {
-        if(result->isInteger) {
-            return snprintf(buffer, size, "%d", result->integer);
+    if(slot) {
+        if(slot->isInteger) {
+            return snprintf(buffer, size, "%d", slot->integer);
         } else {
-            return snprintf(buffer, size, "%s", result->string);
+            return snprintf(buffer, size, "%s", slot->string);
         }
     }
     return 0;
 }
 
+LDEXPORT int ld_pcmstream_get_int(ld_pcmstream_t stream, const char *property, int* value)
+{
+    return slot_get_int(get_named(stream, property), value);
+}
+
+LDEXPORT int ld_pcmstream_get_int_id(ld_pcmstream_t stream, int id, int* value)
+{
+    return slot_get_int(get_slot(stream, id), value);
+}
+
+LDEXPORT int ld_pcmstream_get_string(ld_pcmstream_t stream, const char *property, char *buffer, int size)
+{
+    return slot_get_string(get_named(stream, property), buffer, size);
+}
+
+LDEXPORT int ld_pcmstream_get_string_id(ld_pcmstream_t stream, int id, char *buffer, int size)
+{
+    return slot_get_string(get_slot(stream, id), buffer, size);
+}
+
+static void print_property(ld_pcmstream_t stream, const char *name, const property_slot_t *slot)
+{
+    if(slot->isInteger) {
+        LOG_S_PROPERTY_F(stream, "%s: %d", name, slot->integer);
+    } else {
+        LOG_S_PROPERTY_F(stream, "%s: %s", name, slot->string);
+    }
+}
+
 LDEXPORT void ld_pcmstream_print_properties(ld_pcmstream_t stream)
 {
-    size_t iter = 0;
-    void *iter_val;
-    while (hashmap_iter (stream->_internal->properties, &iter, &iter_val)) {
-        property_entry *pa = iter_val;
-        if(pa->isInteger) {
-            LOG_S_INFO_F(stream, "%s: %d", pa->name, pa->integer);
-        } else {
-            LOG_S_INFO_F(stream, "%s: %s", pa->name, pa->string);
+    property_table_t *table = &stream->_internal->properties;
+    for(int i = 0; i < LD_PROPERTY_ID_COUNT; i++) {
+        if(table->slots[i].isSet) {
+            print_property(stream, property_names[i], &table->slots[i]);
         }
     }
-}
\ No newline at end of file
+}
@@ -1,8 +1,22 @@
 #ifndef _PROPERTIES_H_
 #define _PROPERTIES_H_
 #include <lancerdecode.h>
+
+//one slot per LD_PROPERTY_ID_*
+typedef struct {
+    uint8_t isSet;
+    uint8_t isInteger;
+    int integer;
+    const char *string;
+} property_slot_t;
+
+typedef struct {
+    property_slot_t slots[LD_PROPERTY_ID_COUNT];
+} property_table_t;
+
 int init_properties(ld_pcmstream_t pcmstream);
-void set_property_int(ld_pcmstream_t pcmstream, const char *property, int value);
-void set_property_string(ld_pcmstream_t pcmstream, const char *property, const char *value);
-void destroy_properties(ld_pcmstream_t pcmstream);
-#endif
\ No newline at end of file
+//id is an LD_PROPERTY_ID_*, string values are not copied
+void set_property_int(ld_pcmstream_t pcmstream, int id, int value);
+void set_property_string(ld_pcmstream_t pcmstream, int id, const char *value);
+void clear_property(ld_pcmstream_t pcmstream, int id);
+#endif
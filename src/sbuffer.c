@@ -1,4 +1,5 @@
 #include "sbuffer.h"
+#include "stream.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -11,6 +12,7 @@ typedef struct {
     int32_t readOffset;
     int32_t readLength;
     int32_t bufferFilled;
+    ld_allocator_t alloc;
     char readbuffer[READ_BUFFER_SIZE];
 } sbuffer_userdata_t;
 
@@ -68,19 +70,23 @@ static void sbuffer_close(ld_stream_t stream)
 {
     sbuffer_userdata_t *userdata = (sbuffer_userdata_t*)stream->userData;
     userdata->source->close(userdata->source);
-    free(userdata);
-    free(stream);
+    sbuffer_free(stream);
 }
 
-ld_stream_t sbuffer_create(ld_stream_t basestream)
+ld_stream_t sbuffer_create(ld_stream_t basestream, const ld_allocator_t *alloc)
 {
-    sbuffer_userdata_t *userdata = (sbuffer_userdata_t*)malloc(sizeof(sbuffer_userdata_t));
+    sbuffer_userdata_t *userdata = (sbuffer_userdata_t*)mem_alloc(alloc, sizeof(sbuffer_userdata_t));
     userdata->source = basestream;
     userdata->filePos = basestream->tell(basestream);
     userdata->readOffset = 0;
     userdata->readLength = 0;
     userdata->bufferFilled = 0;
-    ld_stream_t stream = ld_stream_new();
+    if(alloc) {
+        userdata->alloc = *alloc;
+    } else {
+        memset(&userdata->alloc, 0, sizeof(ld_allocator_t));
+    }
+    ld_stream_t stream = stream_new(alloc);
     stream->userData = userdata;
     stream->read = &sbuffer_read;
     stream->seek = &sbuffer_seek;
@@ -91,6 +97,8 @@ ld_stream_t sbuffer_create(ld_stream_t basestream)
 
 void sbuffer_free(ld_stream_t stream)
 {
-    free(stream->userData);
-    free(stream);
+    sbuffer_userdata_t *userdata = (sbuffer_userdata_t*)stream->userData;
+    ld_allocator_t alloc = userdata->alloc;
+    mem_free(&alloc, userdata);
+    mem_free(&alloc, stream);
 }
@@ -4,8 +4,13 @@
 #ifndef _SBUFFER_H_
 #define _SBUFFER_H_
 #include "lancerdecode.h"
+#include "alloc.h"
 
-ld_stream_t sbuffer_create(ld_stream_t basestream);
+//arena space used by one sbuffer_create
+#define SBUFFER_ARENA_SIZE 1280
+
+//alloc may be NULL for libc
+ld_stream_t sbuffer_create(ld_stream_t basestream, const ld_allocator_t *alloc);
 //Use when there are errors but you don't want to close the base stream
 void sbuffer_free(ld_stream_t sbuffer);
 
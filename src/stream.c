@@ -1,9 +1,19 @@
 #include "lancerdecode.h"
+#include "stream.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 LDEXPORT ld_stream_t ld_stream_new()
 {
-	return (ld_stream_t)malloc(sizeof(struct ld_stream));
+	return stream_new(NULL);
+}
+
+ld_stream_t stream_new(const ld_allocator_t *alloc)
+{
+	//zeroed, decoders don't set every callback (tell)
+	ld_stream_t stream = (ld_stream_t)mem_alloc(alloc, sizeof(struct ld_stream));
+	if(stream) memset(stream, 0, sizeof(struct ld_stream));
+	return stream;
 }
 
 LDEXPORT void ld_stream_destroy(ld_stream_t stream)
@@ -25,6 +35,7 @@ typedef struct {
 	int32_t offset;
 	int len;
 	int closeparent;
+	ld_allocator_t alloc;
 } wrapper_data_t;
 
 #define MIN(x,y) ((x) > (y) ? (y) : (x))
@@ -67,20 +78,31 @@ int32_t stream_wraptell(ld_stream_t stream)
 void stream_wrapclose(ld_stream_t stream)
 {
 	wrapper_data_t *data = (wrapper_data_t*)stream->userData;
+	ld_allocator_t alloc = data->alloc;
 	if(data->closeparent)
 		data->source->close(data->source);
-	free(data);
-	free(stream);
+	mem_free(&alloc, data);
+	mem_free(&alloc, stream);
 }
 
 LDEXPORT ld_stream_t ld_stream_wrap(ld_stream_t src, int32_t len, int closeparent)
 {
-    ld_stream_t stream = (ld_stream_t)malloc(sizeof(struct ld_stream));
-    wrapper_data_t *data = (wrapper_data_t*)malloc(sizeof(wrapper_data_t));
+    return stream_wrap(src, len, closeparent, NULL);
+}
+
+ld_stream_t stream_wrap(ld_stream_t src, int32_t len, int closeparent, const ld_allocator_t *alloc)
+{
+    ld_stream_t stream = stream_new(alloc);
+    wrapper_data_t *data = (wrapper_data_t*)mem_alloc(alloc, sizeof(wrapper_data_t));
     data->offset = src->tell(src);
     data->len = len;
     data->source = src;
     data->closeparent = closeparent;
+    if(alloc) {
+        data->alloc = *alloc;
+    } else {
+        memset(&data->alloc, 0, sizeof(ld_allocator_t));
+    }
     stream->userData = (void*)data;
     stream->read = &stream_wrapread;
     stream->seek = &stream_wrapseek;
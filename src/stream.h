@@ -0,0 +1,18 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//STREAM
+//ld_stream_new/ld_stream_wrap for streams owned by a decoder,
+//allocated with the allocator of its options (NULL for libc)
+#ifndef _STREAM_H_
+#define _STREAM_H_
+#include "lancerdecode.h"
+#include "alloc.h"
+
+//all callbacks NULL until set
+ld_stream_t stream_new(const ld_allocator_t *alloc);
+//the wrapper stores a copy of alloc and frees itself with it on close
+ld_stream_t stream_wrap(ld_stream_t src, int32_t len, int closeparent, const ld_allocator_t *alloc);
+
+#endif
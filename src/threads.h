@@ -0,0 +1,89 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//THREADS
+//mutexes and one-time initialisation for state shared between streams
+#ifndef _THREADS_H_
+#define _THREADS_H_
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+typedef SRWLOCK ld_mutex_t;
+#define LD_MUTEX_INIT SRWLOCK_INIT
+typedef INIT_ONCE ld_once_t;
+#define LD_ONCE_INIT INIT_ONCE_STATIC_INIT
+
+static inline void mutex_init(ld_mutex_t *mutex)
+{
+    InitializeSRWLock(mutex);
+}
+
+static inline void mutex_destroy(ld_mutex_t *mutex)
+{
+    (void)mutex;
+}
+
+static inline void mutex_lock(ld_mutex_t *mutex)
+{
+    AcquireSRWLockExclusive(mutex);
+}
+
+static inline void mutex_unlock(ld_mutex_t *mutex)
+{
+    ReleaseSRWLockExclusive(mutex);
+}
+
+static BOOL CALLBACK once_trampoline(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+    (void)once; (void)context;
+    ((void (*)(void))param)();
+    return TRUE;
+}
+
+//runs fn exactly once, other callers wait until it has finished
+static inline void once_call(ld_once_t *once, void (*fn)(void))
+{
+    InitOnceExecuteOnce(once, once_trampoline, (PVOID)fn, NULL);
+}
+#else
+#include <pthread.h>
+typedef pthread_mutex_t ld_mutex_t;
+#define LD_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+typedef pthread_once_t ld_once_t;
+#define LD_ONCE_INIT PTHREAD_ONCE_INIT
+
+static inline void mutex_init(ld_mutex_t *mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+}
+
+static inline void mutex_destroy(ld_mutex_t *mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+static inline void mutex_lock(ld_mutex_t *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+static inline void mutex_unlock(ld_mutex_t *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+//runs fn exactly once, other callers wait until it has finished
+static inline void once_call(ld_once_t *once, void (*fn)(void))
+{
+    pthread_once(once, fn);
+}
+#endif
+
+#endif
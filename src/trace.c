@@ -0,0 +1,156 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+#include "trace.h"
+#include "pcmstream.h"
+#include "stream.h"
+#include "arena.h"
+
+typedef struct {
+    ld_stream_t inner;
+    ld_spancallback_t begin;
+    ld_spancallback_t end;
+    void *udata;
+    const char *codec;
+    LDSPAN readType;
+    LDSPAN seekType;
+    ld_pcmstream_t pcm; /* NULL when frames are not reported */
+    ld_allocator_t alloc;
+} trace_stream_t;
+
+static size_t trace_frames(trace_stream_t *t, size_t bytes)
+{
+    int frameSize = t->pcm ? pcmstream_frame_size(t->pcm) : 0;
+    return frameSize ? bytes / frameSize : 0;
+}
+
+static size_t trace_read(void *buffer, size_t size, ld_stream_t stream)
+{
+    trace_stream_t *t = (trace_stream_t*)stream->userData;
+    ld_span_t span;
+    memset(&span, 0, sizeof(ld_span_t));
+    span.type = t->readType;
+    span.codec = t->codec;
+    span.bytes = size;
+    span.frames = trace_frames(t, size);
+    t->begin(&span, t->udata);
+    size_t result = t->inner->read(buffer, size, t->inner);
+    span.bytes = result;
+    //a read that starts a new link of a chained file changes the frame size
+    span.frames = trace_frames(t, result);
+    t->end(&span, t->udata);
+    return result;
+}
+
+static int trace_seek(ld_stream_t stream, int32_t offset, LDSEEK origin)
+{
+    trace_stream_t *t = (trace_stream_t*)stream->userData;
+    ld_span_t span;
+    memset(&span, 0, sizeof(ld_span_t));
+    span.type = t->seekType;
+    span.codec = t->codec;
+    span.offset = offset;
+    t->begin(&span, t->udata);
+    int result = t->inner->seek(t->inner, offset, origin);
+    span.result = result;
+    t->end(&span, t->udata);
+    return result;
+}
+
+static int32_t trace_tell(ld_stream_t stream)
+{
+    trace_stream_t *t = (trace_stream_t*)stream->userData;
+    return t->inner->tell(t->inner);
+}
+
+static void trace_close(ld_stream_t stream)
+{
+    trace_stream_t *t = (trace_stream_t*)stream->userData;
+    ld_allocator_t alloc = t->alloc;
+    t->inner->close(t->inner);
+    mem_free(&alloc, t);
+    mem_free(&alloc, stream);
+}
+
+static ld_stream_t trace_wrap(ld_stream_t inner, ld_options_t options, const ld_allocator_t *alloc,
+    LDSPAN readType, LDSPAN seekType, ld_pcmstream_t pcm, const char *codec)
+{
+    trace_stream_t *t = (trace_stream_t*)mem_alloc(alloc, sizeof(trace_stream_t));
+    if(!t) return NULL;
+    ld_stream_t stream = stream_new(alloc);
+    if(!stream) {
+        mem_free(alloc, t);
+        return NULL;
+    }
+    t->inner = inner;
+    t->begin = options->spanbegin;
+    t->end = options->spanend;
+    t->udata = options->spanudata;
+    t->codec = codec;
+    t->readType = readType;
+    t->seekType = seekType;
+    t->pcm = pcm;
+    t->alloc = *alloc;
+    stream->userData = t;
+    stream->read = &trace_read;
+    stream->seek = &trace_seek;
+    stream->tell = inner->tell ? &trace_tell : NULL;
+    stream->close = &trace_close;
+    return stream;
+}
+
+const char *trace_codec(const ld_header_t *header)
+{
+    switch(header->kind) {
+        case LD_HEADER_RIFF_PCM:
+            return "pcm";
+        case LD_HEADER_RIFF_MP3:
+        case LD_HEADER_MP3:
+            return "mp3";
+        case LD_HEADER_VORBIS:
+            return "vorbis";
+        case LD_HEADER_OGG_FLAC:
+        case LD_HEADER_FLAC:
+            return "flac";
+        case LD_HEADER_OPUS:
+            return "opus";
+        case LD_HEADER_CODEC:
+            return header->codec->codec.name;
+        default:
+            return NULL;
+    }
+}
+
+ld_stream_t trace_source(ld_stream_t stream, ld_options_t options)
+{
+    if(!trace_enabled(options)) return stream;
+    ld_allocator_t alloc = options_allocator(options);
+    ld_stream_t traced = trace_wrap(stream, options, &alloc, LDSPAN_IO_READ, LDSPAN_IO_SEEK, NULL, NULL);
+    //tracing is best effort, keep going untraced when out of memory
+    return traced ? traced : stream;
+}
+
+void trace_source_codec(ld_stream_t source, ld_options_t options, const char *codec)
+{
+    if(!trace_enabled(options) || source->read != &trace_read) return;
+    ((trace_stream_t*)source->userData)->codec = codec;
+}
+
+void trace_source_release(ld_stream_t source, ld_stream_t stream)
+{
+    if(source == stream) return;
+    trace_stream_t *t = (trace_stream_t*)source->userData;
+    ld_allocator_t alloc = t->alloc;
+    mem_free(&alloc, t);
+    mem_free(&alloc, source);
+}
+
+void trace_pcmstream(ld_pcmstream_t pcm, const char *codec)
+{
+    ld_options_t options = &pcm->_internal->options;
+    if(!trace_enabled(options)) return;
+    ld_allocator_t alloc = arena_allocator(pcm->_internal->arena, ARENA_OVERHEAD);
+    ld_stream_t traced = trace_wrap(pcm->stream, options, &alloc, LDSPAN_READ, LDSPAN_SEEK, pcm, codec);
+    if(traced) pcm->stream = traced;
+}
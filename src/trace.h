@@ -0,0 +1,45 @@
+// MIT License - Copyright (c) Callum McGing
+// This file is subject to the terms and conditions defined in
+// LICENSE, which is part of this source code package
+
+//TRACE
+//optional span callbacks set with ld_options_set_tracing. streams are only
+//wrapped when the options have callbacks, so untraced streams pay nothing
+#ifndef _TRACE_H_
+#define _TRACE_H_
+#include "options.h"
+#include "formats.h"
+
+static inline int trace_enabled(ld_options_t options)
+{
+    return options && options->spanbegin;
+}
+
+static inline void trace_begin(ld_options_t options, ld_span_t *span, LDSPAN type, const char *codec)
+{
+    if(!trace_enabled(options)) return;
+    memset(span, 0, sizeof(ld_span_t));
+    span->type = type;
+    span->codec = codec;
+    options->spanbegin(span, options->spanudata);
+}
+
+static inline void trace_end(ld_options_t options, ld_span_t *span)
+{
+    if(!trace_enabled(options)) return;
+    options->spanend(span, options->spanudata);
+}
+
+//LD_PROPERTY_CODEC value of the decoder that open_header will pick
+const char *trace_codec(const ld_header_t *header);
+//Wraps the source stream with IO_READ and IO_SEEK spans, returns stream itself
+//when tracing is off
+ld_stream_t trace_source(ld_stream_t stream, ld_options_t options);
+//Tags the spans of a stream returned by trace_source with the detected codec
+void trace_source_codec(ld_stream_t source, ld_options_t options, const char *codec);
+//Frees the wrapper made by trace_source without closing the stream it wraps
+void trace_source_release(ld_stream_t source, ld_stream_t stream);
+//Wraps pcm->stream with READ and SEEK spans
+void trace_pcmstream(ld_pcmstream_t pcm, const char *codec);
+
+#endif